@@ -0,0 +1,374 @@
+/*
+ * SM4 性能基准测试
+ * 不依赖 PostgreSQL，独立编译运行
+ * 编译: make bench
+ * 运行: ./bench_sm4
+ *
+ * x86 上以 RDTSC 计数输出 cycles/byte，其他平台输出 ns/byte
+ */
+
+#include "sm4.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles/byte"
+static uint64_t bench_now(void)
+{
+    return __rdtsc();
+}
+#else
+#define BENCH_UNIT "ns/byte"
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/* 每组测试至少处理的字节数，保证计时稳定 */
+#define BENCH_MIN_BYTES (8UL * 1024 * 1024)
+
+static const uint8_t bench_key[16] = {0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef,
+                                      0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10};
+static const uint8_t bench_iv[16] = {0};
+
+static size_t bench_iterations(size_t len)
+{
+    size_t n = BENCH_MIN_BYTES / (len ? len : 1);
+    return n > 0 ? n : 1;
+}
+
+/* 标量路径: 逐块调用 sm4_encrypt_block */
+static double bench_scalar_blocks(const uint8_t *in, uint8_t *out, size_t len)
+{
+    sm4_context ctx;
+    size_t iters = bench_iterations(len);
+    size_t it, i;
+    uint64_t start;
+
+    sm4_setkey(&ctx, bench_key);
+    start = bench_now();
+    for (it = 0; it < iters; it++) {
+        for (i = 0; i < len; i += SM4_BLOCK_SIZE) {
+            sm4_encrypt_block(&ctx, in + i, out + i);
+        }
+    }
+    sm4_context_clean(&ctx);
+    return (double)(bench_now() - start) / ((double)iters * len);
+}
+
+/* 密钥扩展: 每个密钥的周期数(multi=1为逐个sm4_setkey) */
+#define BENCH_KEYS 64
+
+static double bench_setkey(int multi)
+{
+    static uint8_t key_bytes[BENCH_KEYS][16];
+    const uint8_t *keys[BENCH_KEYS];
+    sm4_context ctx[BENCH_KEYS];
+    size_t iters = 20000;
+    size_t it, i;
+    uint64_t start;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        memset(key_bytes[i], (int)i, 16);
+        keys[i] = key_bytes[i];
+    }
+
+    start = bench_now();
+    for (it = 0; it < iters; it++) {
+        if (multi) {
+            sm4_setkey_multi(ctx, keys, BENCH_KEYS);
+        } else {
+            for (i = 0; i < BENCH_KEYS; i++) {
+                sm4_setkey(&ctx[i], keys[i]);
+            }
+        }
+    }
+    return (double)(bench_now() - start) / ((double)iters * BENCH_KEYS);
+}
+
+/* 每行一个密钥的短消息: 逐条sm4_ecb_encrypt与多密钥引擎，返回每条消息的周期数 */
+static double bench_rows(size_t msg_len, int multi)
+{
+    static uint8_t key_bytes[BENCH_KEYS][16];
+    static uint8_t data[BENCH_KEYS][32];
+    static uint8_t cipher[BENCH_KEYS][48];
+    const uint8_t *keys[BENCH_KEYS];
+    const uint8_t *inputs[BENCH_KEYS];
+    uint8_t *outputs[BENCH_KEYS];
+    size_t lens[BENCH_KEYS], out_lens[BENCH_KEYS];
+    size_t iters = 20000;
+    size_t it, i;
+    uint64_t start;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        memset(key_bytes[i], (int)i, 16);
+        memset(data[i], '0' + (int)(i % 10), sizeof(data[i]));
+        keys[i] = key_bytes[i];
+        inputs[i] = data[i];
+        outputs[i] = cipher[i];
+        lens[i] = msg_len;
+    }
+
+    start = bench_now();
+    for (it = 0; it < iters; it++) {
+        if (multi) {
+            sm4_ecb_encrypt_multi(keys, inputs, lens, outputs, out_lens, BENCH_KEYS);
+        } else {
+            for (i = 0; i < BENCH_KEYS; i++) {
+                sm4_ecb_encrypt(keys[i], inputs[i], lens[i], outputs[i], &out_lens[i]);
+            }
+        }
+    }
+    return (double)(bench_now() - start) / ((double)iters * BENCH_KEYS);
+}
+
+/* 同一密钥的多行CBC: 逐条sm4_cbc_encrypt与多消息CBC，返回每条消息的周期数 */
+static double bench_cbc_rows(size_t msg_len, int multi)
+{
+    static uint8_t data[BENCH_KEYS][1024];
+    static uint8_t cipher[BENCH_KEYS][1024 + 16];
+    const uint8_t *ivs[BENCH_KEYS];
+    const uint8_t *inputs[BENCH_KEYS];
+    uint8_t *outputs[BENCH_KEYS];
+    size_t lens[BENCH_KEYS], out_lens[BENCH_KEYS];
+    size_t iters = 4000000 / (msg_len + 64);
+    size_t it, i;
+    uint64_t start;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        memset(data[i], '0' + (int)(i % 10), sizeof(data[i]));
+        ivs[i] = bench_iv;
+        inputs[i] = data[i];
+        outputs[i] = cipher[i];
+        lens[i] = msg_len;
+    }
+
+    start = bench_now();
+    for (it = 0; it < iters; it++) {
+        if (multi) {
+            sm4_cbc_encrypt_multi(bench_key, ivs, inputs, lens, outputs, out_lens, BENCH_KEYS);
+        } else {
+            for (i = 0; i < BENCH_KEYS; i++) {
+                sm4_cbc_encrypt(bench_key, ivs[i], inputs[i], lens[i], outputs[i], &out_lens[i]);
+            }
+        }
+    }
+    return (double)(bench_now() - start) / ((double)iters * BENCH_KEYS);
+}
+
+/* 短消息单次调用延迟(每次调用的周期数) */
+static double bench_short_call(size_t msg_len, int cbc)
+{
+    uint8_t in[32], out[48];
+    size_t iters = 200000;
+    size_t it, out_len;
+    uint64_t start;
+
+    memset(in, 'a', sizeof(in));
+    start = bench_now();
+    for (it = 0; it < iters; it++) {
+        if (cbc) {
+            sm4_cbc_encrypt(bench_key, bench_iv, in, msg_len, out, &out_len);
+        } else {
+            sm4_ecb_encrypt(bench_key, in, msg_len, out, &out_len);
+        }
+    }
+    return (double)(bench_now() - start) / (double)iters;
+}
+
+/* 多块并行路径: ECB 批量加密 */
+static double bench_ecb(const uint8_t *in, uint8_t *out, size_t len)
+{
+    size_t iters = bench_iterations(len);
+    size_t it, out_len;
+    uint64_t start = bench_now();
+
+    for (it = 0; it < iters; it++) {
+        sm4_ecb_encrypt(bench_key, in, len, out, &out_len);
+    }
+    return (double)(bench_now() - start) / ((double)iters * len);
+}
+
+/* CBC 解密(各块并行解密后与错开一块的密文异或) */
+static double bench_cbc_dec(const uint8_t *in, uint8_t *out, size_t len)
+{
+    size_t iters = bench_iterations(len);
+    size_t it, out_len;
+    uint64_t start = bench_now();
+
+    for (it = 0; it < iters; it++) {
+        sm4_cbc_decrypt(bench_key, bench_iv, in, len, out, &out_len);
+    }
+    return (double)(bench_now() - start) / ((double)iters * len);
+}
+
+/* GCM 加密(与 sm4_c_encrypt_gcm_auto_iv 相同的调用方式) */
+static double bench_gcm(const uint8_t *in, uint8_t *out, size_t len)
+{
+    size_t iters = bench_iterations(len);
+    size_t it;
+    uint8_t tag[SM4_GCM_TAG_SIZE];
+    uint64_t start = bench_now();
+
+    for (it = 0; it < iters; it++) {
+        sm4_gcm_encrypt(bench_key, bench_iv, SM4_GCM_IV_SIZE, NULL, 0, in, len, out, tag);
+    }
+    return (double)(bench_now() - start) / ((double)iters * len);
+}
+
+/* XTS: 按8KB页逐页处理(上下文只扩展一次密钥，页号作tweak) */
+#define BENCH_PAGE_SIZE 8192
+
+static double bench_xts_pages(const uint8_t *in, uint8_t *out, size_t len)
+{
+    static const uint8_t xts_key[SM4_XTS_KEY_SIZE] = {
+        0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef,0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10,
+        0x10,0x32,0x54,0x76,0x98,0xba,0xdc,0xfe,0xef,0xcd,0xab,0x89,0x67,0x45,0x23,0x01};
+    sm4_xts_context ctx;
+    size_t iters = bench_iterations(len);
+    size_t it, off;
+    uint64_t start;
+
+    sm4_xts_setkey(&ctx, xts_key, 0);
+    start = bench_now();
+    for (it = 0; it < iters; it++) {
+        for (off = 0; off + BENCH_PAGE_SIZE <= len; off += BENCH_PAGE_SIZE) {
+            sm4_xts_crypt(&ctx, off / BENCH_PAGE_SIZE, in + off, BENCH_PAGE_SIZE, out + off);
+        }
+    }
+    sm4_xts_context_clean(&ctx);
+    return (double)(bench_now() - start) / ((double)iters * len);
+}
+
+/* 大数据: 缓存写入与流式路径(预取+非临时存储)对比，stream为0时关闭流式路径 */
+#define BENCH_STREAM_MAX (64UL * 1024 * 1024)
+
+static double bench_stream(const uint8_t *in, uint8_t *out, size_t len, int stream, int gcm)
+{
+    size_t saved = sm4_stream_threshold();
+    double r;
+
+    sm4_set_stream_threshold(stream ? 0 : (size_t)-1);
+    r = gcm ? bench_gcm(in, out, len) : bench_ecb(in, out, len);
+    sm4_set_stream_threshold(saved);
+    return r;
+}
+
+/* 多线程GCM加密(单个大值)，nthreads为0时按在线CPU数 */
+static double bench_gcm_mt(const uint8_t *in, uint8_t *out, size_t len, int nthreads)
+{
+    size_t iters = bench_iterations(len);
+    size_t it;
+    uint8_t tag[SM4_GCM_TAG_SIZE];
+    uint64_t start = bench_now();
+
+    for (it = 0; it < iters; it++) {
+        sm4_gcm_encrypt_mt(bench_key, bench_iv, SM4_GCM_IV_SIZE, NULL, 0, in, len, out, tag,
+                           nthreads);
+    }
+    return (double)(bench_now() - start) / ((double)iters * len);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = {1024, 4096, 16384, 65536};
+    static const char *kernels[] = {"gfni-avx512", "aesni-avx2", "aesni", "bitslice-avx2",
+                                    "bitslice", "bitslice-block", "ttable-x4", "ttable", "scalar"};
+    size_t max_len = 65536;
+    uint8_t *in = (uint8_t *)malloc(max_len);
+    uint8_t *out = (uint8_t *)malloc(max_len + SM4_BLOCK_SIZE);
+    size_t i;
+
+    if (!in || !out) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < max_len; i++) {
+        in[i] = (uint8_t)i;
+    }
+
+    printf("SM4 Benchmark (%s)\n", BENCH_UNIT);
+    printf("==============\n\n");
+    printf("kernel: %s\n\n", sm4_kernel_name());
+    printf("%-10s %14s %14s %14s %14s\n", "size", "scalar-block", "ecb-multi", "cbc-dec", "gcm");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        printf("%-10zu %14.2f %14.2f %14.2f %14.2f\n", sizes[i],
+               bench_scalar_blocks(in, out, sizes[i]),
+               bench_ecb(in, out, sizes[i]),
+               bench_cbc_dec(in, out, sizes[i]),
+               bench_gcm(in, out, sizes[i]));
+    }
+
+    /* 各内核的ECB吞吐(64KB) */
+    printf("\n%-14s %14s\n", "kernel", "ecb-64K");
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (sm4_set_kernel(kernels[i]) != 0) {
+            printf("%-14s %14s\n", kernels[i], "n/a");
+            continue;
+        }
+        printf("%-14s %14.2f\n", kernels[i], bench_ecb(in, out, max_len));
+    }
+    sm4_set_kernel(NULL);
+
+    /* 8KB页XTS与同长度ECB对比(64KB) */
+    printf("\n%-14s %14s %14s\n", "page 8K", "ecb-64K", "xts-64K");
+    printf("%-14s %14.2f %14.2f\n", sm4_kernel_name(), bench_ecb(in, out, max_len),
+           bench_xts_pages(in, out, max_len));
+
+    /* 密钥扩展(每个密钥) */
+    printf("\n%-14s %14s\n", "key schedule", "per key");
+    printf("%-14s %14.1f\n", "sm4_setkey", bench_setkey(0));
+    printf("%-14s %14.1f\n", "setkey_multi", bench_setkey(1));
+
+    /* 短消息单次调用 */
+    printf("\n%-14s %14s %14s\n", "per call", "11 bytes", "18 bytes");
+    printf("%-14s %14.1f %14.1f\n", "ecb_encrypt", bench_short_call(11, 0), bench_short_call(18, 0));
+    printf("%-14s %14.1f %14.1f\n", "cbc_encrypt", bench_short_call(11, 1), bench_short_call(18, 1));
+
+    /* 每行密钥不同的短字段(每条消息) */
+    printf("\n%-14s %14s %14s\n", "per-row key", "11 bytes", "18 bytes");
+    printf("%-14s %14.1f %14.1f\n", "ecb_encrypt", bench_rows(11, 0), bench_rows(18, 0));
+    printf("%-14s %14.1f %14.1f\n", "ecb_multi", bench_rows(11, 1), bench_rows(18, 1));
+
+    /* 同一密钥的多行CBC加密(每条消息) */
+    printf("\n%-14s %14s %14s %14s\n", "cbc rows", "11 bytes", "100 bytes", "1000 bytes");
+    printf("%-14s %14.1f %14.1f %14.1f\n", "cbc_encrypt",
+           bench_cbc_rows(11, 0), bench_cbc_rows(100, 0), bench_cbc_rows(1000, 0));
+    printf("%-14s %14.1f %14.1f %14.1f\n", "cbc_multi",
+           bench_cbc_rows(11, 1), bench_cbc_rows(100, 1), bench_cbc_rows(1000, 1));
+
+    /* 流式路径阈值扫描(4KB-64MB) */
+    free(in);
+    free(out);
+    in = (uint8_t *)malloc(BENCH_STREAM_MAX);
+    out = (uint8_t *)malloc(BENCH_STREAM_MAX + SM4_BLOCK_SIZE);
+    if (!in || !out) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(in, 0x5a, BENCH_STREAM_MAX);
+    memset(out, 0, BENCH_STREAM_MAX + SM4_BLOCK_SIZE);
+    printf("\nstream threshold: %zu\n", sm4_stream_threshold());
+    printf("%-10s %14s %14s %14s %14s\n", "size", "ecb-cached", "ecb-stream", "gcm-cached", "gcm-stream");
+    for (i = 4096; i <= BENCH_STREAM_MAX; i *= 4) {
+        printf("%-10zu %14.2f %14.2f %14.2f %14.2f\n", i,
+               bench_stream(in, out, i, 0, 0), bench_stream(in, out, i, 1, 0),
+               bench_stream(in, out, i, 0, 1), bench_stream(in, out, i, 1, 1));
+    }
+
+    /* 多线程GCM(64MB单个值，按墙钟计) */
+    printf("\n%-10s %14s %14s %14s %14s\n", "gcm-mt", "1 thread", "2 threads", "4 threads", "auto");
+    printf("%-10lu %14.2f %14.2f %14.2f %14.2f\n", BENCH_STREAM_MAX,
+           bench_gcm_mt(in, out, BENCH_STREAM_MAX, 1), bench_gcm_mt(in, out, BENCH_STREAM_MAX, 2),
+           bench_gcm_mt(in, out, BENCH_STREAM_MAX, 4), bench_gcm_mt(in, out, BENCH_STREAM_MAX, 0));
+
+    free(in);
+    free(out);
+    return 0;
+}
@@ -28,6 +28,33 @@ LANGUAGE C STRICT IMMUTABLE;
 COMMENT ON FUNCTION sm4_c_encrypt_cbc(text, text, text) IS 
 'SM4 CBC模式加密(C扩展)。参数: plaintext-明文, key-密钥, iv-初始向量(16字节或32位十六进制)。';
 
+-- CBC模式批量加密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_encrypt_cbc_batch(plaintexts text[], key text, iv text)
+RETURNS bytea[]
+AS 'sm4', 'sm4_encrypt_cbc_batch'
+LANGUAGE C STRICT IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_encrypt_cbc_batch(text[], text, text) IS 
+'SM4 CBC模式批量加密(C扩展)，多条消息经并行内核同时加密，结果与逐条调用sm4_c_encrypt_cbc相同。参数: plaintexts-明文数组, key-密钥, iv-初始向量(16字节或32位十六进制)。返回密文数组(NULL或空字符串元素为NULL)。';
+
+-- ECB模式每行密钥批量加密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_encrypt_multi(plaintexts text[], keys text[])
+RETURNS bytea[]
+AS 'sm4', 'sm4_encrypt_multi'
+LANGUAGE C STRICT IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_encrypt_multi(text[], text[]) IS 
+'SM4 ECB模式每行密钥批量加密(C扩展)，第i条明文用第i个密钥，多条消息经多密钥内核同时加密，结果与逐条调用sm4_c_encrypt相同。参数: plaintexts-明文数组, keys-密钥数组(与明文数组下标相同，每个16字节或32位十六进制)。返回密文数组(明文或密钥为NULL、明文为空字符串的元素为NULL)。';
+
+-- ECB模式每行密钥批量解密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_decrypt_multi(ciphertexts bytea[], keys text[])
+RETURNS text[]
+AS 'sm4', 'sm4_decrypt_multi'
+LANGUAGE C STRICT IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_decrypt_multi(bytea[], text[]) IS 
+'SM4 ECB模式每行密钥批量解密(C扩展)，结果与逐条调用sm4_c_decrypt相同。参数: ciphertexts-密文数组, keys-密钥数组(与密文数组下标相同)。返回明文数组(密文或密钥为NULL、密文为空的元素为NULL，任一条解密失败即报错)。';
+
 -- CBC模式解密 - C扩展版本
 CREATE OR REPLACE FUNCTION sm4_c_decrypt_cbc(ciphertext bytea, key text, iv text)
 RETURNS text
@@ -129,3 +156,79 @@ LANGUAGE C IMMUTABLE;
 COMMENT ON FUNCTION sm4_c_decrypt_gcm_auto_iv_base64(text, text, text) IS
 'SM4 GCM模式解密(C扩展)，从Base64解码后自动提取IV。参数: ciphertext_base64-Base64编码的密文, key-密钥, aad-附加认证数据(可选)。返回明文。';
 
+-- 大值GCM加密 (多线程) - C扩展版本
+-- 普通列值请使用sm4_c_encrypt_gcm；本函数需显式传入threads才会在后端进程内创建线程
+CREATE OR REPLACE FUNCTION sm4_c_encrypt_gcm_large(data bytea, key text, iv text, aad text DEFAULT NULL, threads integer DEFAULT 1)
+RETURNS bytea
+AS 'sm4', 'sm4_encrypt_gcm_large'
+LANGUAGE C IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_encrypt_gcm_large(bytea, text, text, text, integer) IS
+'SM4 GCM模式大值加密(C扩展)，用于扫描件、导出文件等大对象。不小于2MB的数据按threads个线程分段并行，默认1即单线程，0为按CPU核数(最多64)。参数: data-明文, key-密钥, iv-初始向量, aad-附加认证数据(可选), threads-线程数。返回密文+Tag。';
+
+-- 大值GCM解密 (多线程) - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_decrypt_gcm_large(ciphertext_with_tag bytea, key text, iv text, aad text DEFAULT NULL, threads integer DEFAULT 1)
+RETURNS bytea
+AS 'sm4', 'sm4_decrypt_gcm_large'
+LANGUAGE C IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_decrypt_gcm_large(bytea, text, text, text, integer) IS
+'SM4 GCM模式大值解密(C扩展)，与sm4_c_encrypt_gcm_large配对。参数: ciphertext_with_tag-密文+Tag, key-密钥, iv-初始向量, aad-附加认证数据(可选), threads-线程数(默认1)。返回明文(bytea)。';
+
+
+-- CTR模式加密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_encrypt_ctr(plaintext text, key text, nonce text)
+RETURNS bytea
+AS 'sm4', 'sm4_encrypt_ctr'
+LANGUAGE C STRICT IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_encrypt_ctr(text, text, text) IS
+'SM4 CTR模式加密(C扩展)，无填充，密文与明文等长。参数: plaintext-明文, key-密钥, nonce-初始计数器(16字节或32位十六进制，同一密钥下不可重复使用)。';
+
+-- CTR模式解密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_decrypt_ctr(ciphertext bytea, key text, nonce text)
+RETURNS text
+AS 'sm4', 'sm4_decrypt_ctr'
+LANGUAGE C STRICT IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_decrypt_ctr(bytea, text, text) IS
+'SM4 CTR模式解密(C扩展)。参数: ciphertext-密文, key-密钥, nonce-初始计数器。返回明文。';
+
+-- CTR模式随机访问解密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_decrypt_ctr_range(ciphertext bytea, key text, nonce text, byte_offset bigint, byte_length integer)
+RETURNS text
+AS 'sm4', 'sm4_decrypt_ctr_range'
+LANGUAGE C STRICT IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_decrypt_ctr_range(bytea, text, text, bigint, integer) IS
+'SM4 CTR模式随机访问解密(C扩展)，只解密密文中从byte_offset(从0开始)起的byte_length字节，不解密前面的数据；末尾被截断的多字节字符会被去掉，UTF-8库中起始偏移落在字符中间时跳过该字符的残余字节(其他编码下报错)。密文列设置ALTER TABLE ... ALTER COLUMN ... SET STORAGE EXTERNAL(不压缩)后只读取所需的TOAST块。参数: ciphertext-密文, key-密钥, nonce-初始计数器, byte_offset-字节偏移, byte_length-字节长度。';
+
+
+-- SIV模式确定性加密 - C扩展版本
+-- 返回: V(16字节) + 密文；相同明文得到相同密文，可在密文列上建btree/hash索引做等值查询
+CREATE OR REPLACE FUNCTION sm4_c_encrypt_siv(plaintext text, key text, aad text DEFAULT NULL)
+RETURNS bytea
+AS 'sm4', 'sm4_encrypt_siv'
+LANGUAGE C IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_encrypt_siv(text, text, text) IS
+'SM4 SIV模式确定性认证加密(C扩展，RFC 5297，S2V基于CMAC-SM4)。相同的密钥、AAD和明文总是得到相同密文，等值查询可写成 WHERE col = sm4_c_encrypt_siv(''值'', key) 并走索引；会暴露哪些行的值相同。参数: plaintext-明文, key-密钥(32字节或64位十六进制), aad-附加认证数据(可选)。返回V(16)+密文。';
+
+-- SIV模式解密 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_decrypt_siv(ciphertext bytea, key text, aad text DEFAULT NULL)
+RETURNS text
+AS 'sm4', 'sm4_decrypt_siv'
+LANGUAGE C IMMUTABLE;
+
+COMMENT ON FUNCTION sm4_c_decrypt_siv(bytea, text, text) IS
+'SM4 SIV模式解密(C扩展)，验证V后返回明文。参数: ciphertext-密文(V+密文), key-密钥(32字节或64位十六进制), aad-附加认证数据(须与加密时相同)。';
+
+
+-- 查询当前使用的SM4内核 - C扩展版本
+CREATE OR REPLACE FUNCTION sm4_c_kernel()
+RETURNS text
+AS 'sm4', 'sm4_kernel'
+LANGUAGE C STABLE;
+
+COMMENT ON FUNCTION sm4_c_kernel() IS
+'返回当前使用的SM4内核名称(加载时按CPU特性自动选择)，如gfni-avx512、aesni-avx2、aesni、bitslice-avx2、bitslice、ttable-x4。bitslice开头表示没有AES-NI/GFNI时的常量时间模式，所有数据长度与密钥扩展都不按密钥或数据查表；硬件内核下短数据的剩余块和密钥扩展仍使用T表。';
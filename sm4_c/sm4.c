@@ -6,8 +6,12 @@
  */
 
 #include "sm4.h"
+#include "sm4.hpp"
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 
 #ifdef USE_OPENSSL_KDF
 #include <openssl/evp.h>
@@ -53,6 +57,9 @@ static const uint32_t SM4_CK[32] = {
     0x10171e25, 0x2c333a41, 0x484f565d, 0x646b7279
 };
 
+/* 多密钥并行扩展的最大通道数(AVX-512为16) */
+#define SM4_MULTI_KEY_LANES 16
+
 /* 循环左移 */
 #define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
 
@@ -97,18 +104,62 @@ static uint32_t sm4_l_prime(uint32_t x)
     return x ^ ROTL(x, 13) ^ ROTL(x, 23);
 }
 
-/* T变换 */
-static uint32_t sm4_t(uint32_t x)
+/*
+ * T变换查找表: 将S盒与L变换合并
+ * SM4_T[k][b] = L(S(b) << (24 - 8k))，由于L是线性变换，
+ * T(x) = SM4_T[0][x>>24] ^ SM4_T[1][(x>>16)&0xff] ^ SM4_T[2][(x>>8)&0xff] ^ SM4_T[3][x&0xff]
+ * 表在sm4_init中生成一次
+ */
+static uint32_t SM4_T[4][256];
+
+/* 密钥扩展用的T'查找表: SM4_TK[k][b] = L'(S(b) << (24 - 8k)) */
+static uint32_t SM4_TK[4][256];
+
+static void sm4_t_table_init(void)
+{
+    int b;
+
+    for (b = 0; b < 256; b++) {
+        uint32_t s = SM4_SBOX[b];
+        SM4_T[0][b] = sm4_l(s << 24);
+        SM4_T[1][b] = sm4_l(s << 16);
+        SM4_T[2][b] = sm4_l(s << 8);
+        SM4_T[3][b] = sm4_l(s);
+        SM4_TK[0][b] = sm4_l_prime(s << 24);
+        SM4_TK[1][b] = sm4_l_prime(s << 16);
+        SM4_TK[2][b] = sm4_l_prime(s << 8);
+        SM4_TK[3][b] = sm4_l_prime(s);
+    }
+}
+
+/* T变换(查表实现) */
+static inline uint32_t sm4_t(uint32_t x)
 {
-    return sm4_l(sm4_tau(x));
+    return SM4_T[0][(x >> 24) & 0xff] ^
+           SM4_T[1][(x >> 16) & 0xff] ^
+           SM4_T[2][(x >> 8) & 0xff] ^
+           SM4_T[3][x & 0xff];
 }
 
-/* T'变换 (密钥扩展用) */
-static uint32_t sm4_t_prime(uint32_t x)
+/* T'变换 (密钥扩展用，查表实现) */
+static inline uint32_t sm4_t_prime(uint32_t x)
 {
-    return sm4_l_prime(sm4_tau(x));
+    return SM4_TK[0][(x >> 24) & 0xff] ^
+           SM4_TK[1][(x >> 16) & 0xff] ^
+           SM4_TK[2][(x >> 8) & 0xff] ^
+           SM4_TK[3][x & 0xff];
 }
 
+/*
+ * 块加密内核: 以正序遍历的轮密钥处理若干相互独立的块
+ * (解密时传入逆序轮密钥)，具体实现由sm4_init根据CPU特性选择
+ */
+typedef void (*sm4_kernel_fn)(const uint32_t *rk, const uint8_t *input, uint8_t *output);
+
+static pthread_once_t sm4_once = PTHREAD_ONCE_INIT;
+static sm4_kernel_fn sm4_single_block;
+static sm4_kernel_fn sm4_single_block_rev;
+
 /* 清零SM4上下文 */
 void sm4_context_clean(sm4_context *ctx)
 {
@@ -119,638 +170,2923 @@ void sm4_context_clean(sm4_context *ctx)
     }
 }
 
-/* 密钥扩展 */
-void sm4_setkey(sm4_context *ctx, const uint8_t *key)
+/*
+ * 位切片(常量时间)模式: 没有硬件S盒指令时由sm4_select_auto开启，
+ * 单块内核与密钥扩展都改用S盒电路，不再按密钥或数据查表
+ */
+static int sm4_ct_mode = 0;
+
+static uint32_t sm4_t_prime_ct(uint32_t x);
+
+/* 密钥扩展，生成32个轮密钥(4个字滚动使用，不保留中间数组) */
+template<uint32_t (*TP)(uint32_t)>
+static void sm4_key_schedule_with(const uint8_t *key, uint32_t *rk)
 {
-    uint32_t k[36];
+    uint32_t k0, k1, k2, k3;
     int i;
 
     /* 初始密钥与FK异或 */
-    k[0] = load_u32_be(key) ^ SM4_FK[0];
-    k[1] = load_u32_be(key + 4) ^ SM4_FK[1];
-    k[2] = load_u32_be(key + 8) ^ SM4_FK[2];
-    k[3] = load_u32_be(key + 12) ^ SM4_FK[3];
+    k0 = load_u32_be(key) ^ SM4_FK[0];
+    k1 = load_u32_be(key + 4) ^ SM4_FK[1];
+    k2 = load_u32_be(key + 8) ^ SM4_FK[2];
+    k3 = load_u32_be(key + 12) ^ SM4_FK[3];
 
     /* 生成32个轮密钥 */
-    for (i = 0; i < SM4_NUM_ROUNDS; i++) {
-        k[i + 4] = k[i] ^ sm4_t_prime(k[i + 1] ^ k[i + 2] ^ k[i + 3] ^ SM4_CK[i]);
-        ctx->rk[i] = k[i + 4];
+    for (i = 0; i < SM4_NUM_ROUNDS; i += 4) {
+        rk[i] = k0 ^= TP(k1 ^ k2 ^ k3 ^ SM4_CK[i]);
+        rk[i + 1] = k1 ^= TP(k2 ^ k3 ^ k0 ^ SM4_CK[i + 1]);
+        rk[i + 2] = k2 ^= TP(k3 ^ k0 ^ k1 ^ SM4_CK[i + 2]);
+        rk[i + 3] = k3 ^= TP(k0 ^ k1 ^ k2 ^ SM4_CK[i + 3]);
     }
-
-    /* 清零中间状态，防止密钥材料残留在栈上 */
-    memset(k, 0, sizeof(k));
 }
 
-/* 加密单个块 */
-void sm4_encrypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output)
+static void sm4_key_schedule(const uint8_t *key, uint32_t *rk)
 {
-    uint32_t x[36];
-    int i;
-
-    /* 加载输入 */
-    x[0] = load_u32_be(input);
-    x[1] = load_u32_be(input + 4);
-    x[2] = load_u32_be(input + 8);
-    x[3] = load_u32_be(input + 12);
-
-    /* 32轮迭代 */
-    for (i = 0; i < SM4_NUM_ROUNDS; i++) {
-        x[i + 4] = x[i] ^ sm4_t(x[i + 1] ^ x[i + 2] ^ x[i + 3] ^ ctx->rk[i]);
+    if (sm4_ct_mode) {
+        sm4_key_schedule_with<sm4_t_prime_ct>(key, rk);
+    } else {
+        sm4_key_schedule_with<sm4_t_prime>(key, rk);
     }
+}
 
-    /* 反序变换输出 */
-    store_u32_be(output, x[35]);
-    store_u32_be(output + 4, x[34]);
-    store_u32_be(output + 8, x[33]);
-    store_u32_be(output + 12, x[32]);
+/* 密钥扩展 */
+void sm4_setkey(sm4_context *ctx, const uint8_t *key)
+{
+    /* 加解密均以密钥扩展为前提，在此确保运行时已初始化 */
+    sm4_init();
 
-    /* 清零中间状态 */
-    memset(x, 0, sizeof(x));
+    sm4_key_schedule(key, ctx->rk);
 }
 
-/* 解密单个块 */
-void sm4_decrypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output)
+/* 解密密钥扩展: 轮密钥按逆序存放，之后可与加密共用同一内核 */
+void sm4_setkey_dec(sm4_context *ctx, const uint8_t *key)
 {
-    uint32_t x[36];
+    uint32_t rk[SM4_NUM_ROUNDS];
     int i;
 
-    /* 加载输入 */
-    x[0] = load_u32_be(input);
-    x[1] = load_u32_be(input + 4);
-    x[2] = load_u32_be(input + 8);
-    x[3] = load_u32_be(input + 12);
-
-    /* 32轮迭代(使用逆序轮密钥) */
+    sm4_setkey(ctx, key);
+    memcpy(rk, ctx->rk, sizeof(rk));
     for (i = 0; i < SM4_NUM_ROUNDS; i++) {
-        x[i + 4] = x[i] ^ sm4_t(x[i + 1] ^ x[i + 2] ^ x[i + 3] ^ ctx->rk[SM4_NUM_ROUNDS - 1 - i]);
+        ctx->rk[i] = rk[SM4_NUM_ROUNDS - 1 - i];
     }
 
-    /* 反序变换输出 */
-    store_u32_be(output, x[35]);
-    store_u32_be(output + 4, x[34]);
-    store_u32_be(output + 8, x[33]);
-    store_u32_be(output + 12, x[32]);
-
-    /* 清零中间状态 */
-    memset(x, 0, sizeof(x));
+    memset(rk, 0, sizeof(rk));
 }
 
-/* PKCS7填充 */
-static size_t pkcs7_pad(const uint8_t *input, size_t input_len, uint8_t *output)
+/* 按上下文中的轮密钥顺序处理单个块 */
+void sm4_crypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output)
 {
-    size_t pad_len = SM4_BLOCK_SIZE - (input_len % SM4_BLOCK_SIZE);
-    size_t total_len = input_len + pad_len;
-    size_t i;
+    sm4_single_block(ctx->rk, input, output);
+}
 
-    memcpy(output, input, input_len);
-    for (i = input_len; i < total_len; i++) {
-        output[i] = (uint8_t)pad_len;
-    }
-    return total_len;
+/* 加密单个块 */
+void sm4_encrypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output)
+{
+    sm4_single_block(ctx->rk, input, output);
 }
 
-/* PKCS7去填充 */
-static int pkcs7_unpad(uint8_t *data, size_t data_len, size_t *out_len)
+/* 解密单个块(ctx为加密密钥扩展结果，单块内核逆序读取轮密钥) */
+void sm4_decrypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output)
 {
-    uint8_t pad_len;
-    size_t i;
+    sm4_single_block_rev(ctx->rk, input, output);
+}
 
-    if (data_len == 0 || data_len % SM4_BLOCK_SIZE != 0) {
-        return -1;
-    }
+/*
+ * 单块T表实现: 32轮完全展开，4个状态字滚动使用，全程驻留寄存器，
+ * 不在栈上保留中间状态数组；栈清理由各模式在调用结束时统一完成
+ */
+#define SM4_TT_ROUND(a, b, c, d, k) \
+    (a) ^= sm4_t((b) ^ (c) ^ (d) ^ (k))
 
-    pad_len = data[data_len - 1];
-    if (pad_len == 0 || pad_len > SM4_BLOCK_SIZE) {
-        return -1;
-    }
+#define SM4_TT_ROUNDS4(i) do {                                \
+    SM4_TT_ROUND(x0, x1, x2, x3, SM4_RK_AT(rk, (i)));         \
+    SM4_TT_ROUND(x1, x2, x3, x0, SM4_RK_AT(rk, (i) + 1));     \
+    SM4_TT_ROUND(x2, x3, x0, x1, SM4_RK_AT(rk, (i) + 2));     \
+    SM4_TT_ROUND(x3, x0, x1, x2, SM4_RK_AT(rk, (i) + 3));     \
+} while (0)
 
-    for (i = data_len - pad_len; i < data_len; i++) {
-        if (data[i] != pad_len) {
-            return -1;
-        }
-    }
+/*
+ * 单块内核按模板参数Rev决定轮密钥遍历方向: Rev为true时从末尾逆序读取，
+ * sm4_decrypt_block可直接用加密上下文解密，不必先复制出逆序轮密钥
+ */
+#define SM4_RK_AT(rk, i) ((rk)[Rev ? SM4_NUM_ROUNDS - 1 - (i) : (i)])
 
-    *out_len = data_len - pad_len;
-    return 0;
+template<bool Rev>
+static void sm4_crypt_block_ttable(const uint32_t *rk, const uint8_t *input, uint8_t *output)
+{
+    uint32_t x0 = load_u32_be(input);
+    uint32_t x1 = load_u32_be(input + 4);
+    uint32_t x2 = load_u32_be(input + 8);
+    uint32_t x3 = load_u32_be(input + 12);
+
+    SM4_TT_ROUNDS4(0);
+    SM4_TT_ROUNDS4(4);
+    SM4_TT_ROUNDS4(8);
+    SM4_TT_ROUNDS4(12);
+    SM4_TT_ROUNDS4(16);
+    SM4_TT_ROUNDS4(20);
+    SM4_TT_ROUNDS4(24);
+    SM4_TT_ROUNDS4(28);
+
+    /* 反序变换输出 */
+    store_u32_be(output, x3);
+    store_u32_be(output + 4, x2);
+    store_u32_be(output + 8, x1);
+    store_u32_be(output + 12, x0);
 }
 
-/* ECB模式加密 */
-int sm4_ecb_encrypt(const uint8_t *key, const uint8_t *input, size_t input_len,
-                    uint8_t *output, size_t *output_len)
+/* 4块交织的一轮: 4个块的轮函数互不依赖，可充分利用指令级并行 */
+#define SM4_TT_ROUND4(a, b, c, d, k) do {                     \
+    a[0] ^= sm4_t(b[0] ^ c[0] ^ d[0] ^ (k));                  \
+    a[1] ^= sm4_t(b[1] ^ c[1] ^ d[1] ^ (k));                  \
+    a[2] ^= sm4_t(b[2] ^ c[2] ^ d[2] ^ (k));                  \
+    a[3] ^= sm4_t(b[3] ^ c[3] ^ d[3] ^ (k));                  \
+} while (0)
+
+/* 4块交织T表实现(无SIMD指令时的多块路径) */
+static void sm4_crypt4_ttable(const uint32_t *rk, const uint8_t *input, uint8_t *output)
 {
-    sm4_context ctx;
-    size_t padded_len;
-    size_t i;
-    uint8_t *padded;
+    uint32_t x0[4], x1[4], x2[4], x3[4];
+    int i;
 
-    if (!key || !input || !output || !output_len) {
-        return -1;
+    for (i = 0; i < 4; i++) {
+        x0[i] = load_u32_be(input + 16 * i);
+        x1[i] = load_u32_be(input + 16 * i + 4);
+        x2[i] = load_u32_be(input + 16 * i + 8);
+        x3[i] = load_u32_be(input + 16 * i + 12);
     }
 
-    /* 输入长度溢出检查 (Feature-15) */
-    if (input_len > (SIZE_MAX - SM4_BLOCK_SIZE)) {
-        return -1;
+    /* 每4轮状态字轮换一圈，无需移动数据 */
+    for (i = 0; i < SM4_NUM_ROUNDS; i += 4) {
+        SM4_TT_ROUND4(x0, x1, x2, x3, rk[i]);
+        SM4_TT_ROUND4(x1, x2, x3, x0, rk[i + 1]);
+        SM4_TT_ROUND4(x2, x3, x0, x1, rk[i + 2]);
+        SM4_TT_ROUND4(x3, x0, x1, x2, rk[i + 3]);
     }
 
-    /* 计算填充后的长度 */
-    padded_len = input_len + SM4_BLOCK_SIZE - (input_len % SM4_BLOCK_SIZE);
-
-    /* 临时缓冲区用于填充 */
-    padded = (uint8_t *)malloc(padded_len);
-    if (!padded) {
-        return -1;
+    for (i = 0; i < 4; i++) {
+        store_u32_be(output + 16 * i, x3[i]);
+        store_u32_be(output + 16 * i + 4, x2[i]);
+        store_u32_be(output + 16 * i + 8, x1[i]);
+        store_u32_be(output + 16 * i + 12, x0[i]);
     }
+}
 
-    pkcs7_pad(input, input_len, padded);
-    sm4_setkey(&ctx, key);
+/* 单块S盒实现(按标准逐步计算τ与L，作为自检的参考实现) */
+template<bool Rev>
+static void sm4_crypt_block_sbox(const uint32_t *rk, const uint8_t *input, uint8_t *output)
+{
+    uint32_t x0 = load_u32_be(input);
+    uint32_t x1 = load_u32_be(input + 4);
+    uint32_t x2 = load_u32_be(input + 8);
+    uint32_t x3 = load_u32_be(input + 12);
+    int i;
 
-    /* 分块加密 */
-    for (i = 0; i < padded_len; i += SM4_BLOCK_SIZE) {
-        sm4_encrypt_block(&ctx, padded + i, output + i);
+    for (i = 0; i < SM4_NUM_ROUNDS; i += 4) {
+        x0 ^= sm4_l(sm4_tau(x1 ^ x2 ^ x3 ^ SM4_RK_AT(rk, i)));
+        x1 ^= sm4_l(sm4_tau(x2 ^ x3 ^ x0 ^ SM4_RK_AT(rk, i + 1)));
+        x2 ^= sm4_l(sm4_tau(x3 ^ x0 ^ x1 ^ SM4_RK_AT(rk, i + 2)));
+        x3 ^= sm4_l(sm4_tau(x0 ^ x1 ^ x2 ^ SM4_RK_AT(rk, i + 3)));
     }
 
-    /* 清零敏感数据 */
-    sm4_context_clean(&ctx);
-    memset(padded, 0, padded_len);
-    free(padded);
-    *output_len = padded_len;
-    return 0;
+    store_u32_be(output, x3);
+    store_u32_be(output + 4, x2);
+    store_u32_be(output + 8, x1);
+    store_u32_be(output + 12, x0);
 }
 
-/* ECB模式解密 */
-int sm4_ecb_decrypt(const uint8_t *key, const uint8_t *input, size_t input_len,
-                    uint8_t *output, size_t *output_len)
-{
-    sm4_context ctx;
-    size_t i;
+/* CPU特性(sm4_init时探测) */
+static int sm4_cpu_aesni = 0;
+static int sm4_cpu_avx2 = 0;
+static int sm4_cpu_gfni_avx512 = 0;
+static int sm4_cpu_pclmul = 0;
+static int sm4_cpu_vpclmul_avx512 = 0;
 
-    if (!key || !input || !output || !output_len) {
-        return -1;
-    }
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SM4_HAVE_X86_SIMD 1
+#include <immintrin.h>
 
-    if (input_len == 0 || input_len % SM4_BLOCK_SIZE != 0) {
-        return -1;
-    }
+static void sm4_cpu_probe(void)
+{
+    __builtin_cpu_init();
+    sm4_cpu_aesni = __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("aes");
+    sm4_cpu_avx2 = __builtin_cpu_supports("avx2");
+    sm4_cpu_gfni_avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                          __builtin_cpu_supports("gfni");
+    sm4_cpu_pclmul = __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("pclmul");
+    sm4_cpu_vpclmul_avx512 = sm4_cpu_pclmul && __builtin_cpu_supports("avx512f") &&
+                             __builtin_cpu_supports("avx512bw") &&
+                             __builtin_cpu_supports("vpclmulqdq");
+}
 
-    sm4_setkey(&ctx, key);
+/*
+ * AES-NI多块SM4实现
+ *
+ * SM4与AES的S盒都是GF(2^8)上的求逆再加仿射变换，两者的域同构，
+ * 因此 S_sm4(x) = Post(S_aes(Pre(x)))，其中Pre/Post均为仿射变换。
+ * Pre/Post按高低半字节拆分后用PSHUFB查表完成，S_aes由AESENCLAST(零轮密钥)完成，
+ * 事先做一次逆行移位以抵消AESENCLAST中的ShiftRows。
+ *
+ * 数据按字转置: 每个向量寄存器的第k个32位通道属于第k个块，
+ * 这样4个(SSE)或8个(AVX2)块同时走完32轮。
+ */
+/* 仿射变换查找表(按半字节)，由SM4与AES的域同构推导 */
+static const uint8_t SM4_PRE_LO[16] __attribute__((aligned(16))) = {
+    0x3e, 0xb2, 0x0e, 0x82, 0xbb, 0x37, 0x8b, 0x07, 0xa1, 0x2d, 0x91, 0x1d, 0x24, 0xa8, 0x14, 0x98
+};
+static const uint8_t SM4_PRE_HI[16] __attribute__((aligned(16))) = {
+    0x00, 0xdc, 0x2e, 0xf2, 0xc5, 0x19, 0xeb, 0x37, 0x08, 0xd4, 0x26, 0xfa, 0xcd, 0x11, 0xe3, 0x3f
+};
+static const uint8_t SM4_POST_LO[16] __attribute__((aligned(16))) = {
+    0x6c, 0xd4, 0xa6, 0x1e, 0x52, 0xea, 0x98, 0x20, 0x0b, 0xb3, 0xc1, 0x79, 0x35, 0x8d, 0xff, 0x47
+};
+static const uint8_t SM4_POST_HI[16] __attribute__((aligned(16))) = {
+    0x00, 0xe0, 0x50, 0xb0, 0x9d, 0x7d, 0xcd, 0x2d, 0xc0, 0x20, 0x90, 0x70, 0x5d, 0xbd, 0x0d, 0xed
+};
 
-    /* 分块解密 */
-    for (i = 0; i < input_len; i += SM4_BLOCK_SIZE) {
-        sm4_decrypt_block(&ctx, input + i, output + i);
-    }
+/* 逆行移位，抵消AESENCLAST中的ShiftRows */
+static const uint8_t SM4_INV_SHIFT_ROWS[16] __attribute__((aligned(16))) = {
+    0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3
+};
 
-    /* 清零上下文 */
-    sm4_context_clean(&ctx);
+/* 32位字内字节序翻转，以及循环左移8/16/24位 */
+static const uint8_t SM4_BSWAP32[16] __attribute__((aligned(16))) = {
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+static const uint8_t SM4_ROL8[16] __attribute__((aligned(16))) = {
+    3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14
+};
+static const uint8_t SM4_ROL16[16] __attribute__((aligned(16))) = {
+    2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13
+};
+static const uint8_t SM4_ROL24[16] __attribute__((aligned(16))) = {
+    1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12
+};
 
-    /* 去除填充 */
-    if (pkcs7_unpad(output, input_len, output_len) != 0) {
-        return -1;
-    }
+#define SM4_M128(tbl) _mm_load_si128((const __m128i *)(tbl))
+#define SM4_M256(tbl) _mm256_broadcastsi128_si256(SM4_M128(tbl))
 
-    return 0;
+/* 4路SSE: S盒(τ变换): Pre仿射 -> AES S盒 -> Post仿射 */
+__attribute__((target("ssse3,aes")))
+static inline __m128i sm4_aesni_sbox4(__m128i x)
+{
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    __m128i lo, hi;
+
+    lo = _mm_and_si128(x, m4);
+    hi = _mm_and_si128(_mm_srli_epi32(x, 4), m4);
+    x = _mm_xor_si128(_mm_shuffle_epi8(SM4_M128(SM4_PRE_LO), lo),
+                      _mm_shuffle_epi8(SM4_M128(SM4_PRE_HI), hi));
+    x = _mm_shuffle_epi8(x, SM4_M128(SM4_INV_SHIFT_ROWS));
+    x = _mm_aesenclast_si128(x, _mm_setzero_si128());
+    lo = _mm_and_si128(x, m4);
+    hi = _mm_and_si128(_mm_srli_epi32(x, 4), m4);
+    return _mm_xor_si128(_mm_shuffle_epi8(SM4_M128(SM4_POST_LO), lo),
+                         _mm_shuffle_epi8(SM4_M128(SM4_POST_HI), hi));
 }
 
-/* CBC模式加密 */
-int sm4_cbc_encrypt(const uint8_t *key, const uint8_t *iv,
-                    const uint8_t *input, size_t input_len,
-                    uint8_t *output, size_t *output_len)
+/* 4路SSE: 一次τ+L变换 */
+__attribute__((target("ssse3,aes")))
+static inline __m128i sm4_aesni_t4(__m128i x)
 {
-    sm4_context ctx;
-    size_t padded_len;
-    size_t i, j;
-    uint8_t block[SM4_BLOCK_SIZE];
-    uint8_t prev[SM4_BLOCK_SIZE];
-    uint8_t *padded;
+    __m128i t;
 
-    if (!key || !iv || !input || !output || !output_len) {
-        return -1;
-    }
-
-    /* 输入长度溢出检查 */
-    if (input_len > (SIZE_MAX - SM4_BLOCK_SIZE)) {
-        return -1;
-    }
+    x = sm4_aesni_sbox4(x);
 
-    padded_len = input_len + SM4_BLOCK_SIZE - (input_len % SM4_BLOCK_SIZE);
+    /* L(x) = x ^ rol(x,24) ^ rol(x ^ rol(x,8) ^ rol(x,16), 2) */
+    t = _mm_xor_si128(x, _mm_shuffle_epi8(x, SM4_M128(SM4_ROL8)));
+    t = _mm_xor_si128(t, _mm_shuffle_epi8(x, SM4_M128(SM4_ROL16)));
+    t = _mm_or_si128(_mm_slli_epi32(t, 2), _mm_srli_epi32(t, 30));
+    x = _mm_xor_si128(x, _mm_shuffle_epi8(x, SM4_M128(SM4_ROL24)));
+    return _mm_xor_si128(x, t);
+}
 
-    padded = (uint8_t *)malloc(padded_len);
-    if (!padded) {
-        return -1;
-    }
+/* 4路SSE: 密钥扩展用的τ+L'变换，L'(x) = x ^ rol(x,13) ^ rol(x,23) */
+__attribute__((target("ssse3,aes")))
+static inline __m128i sm4_aesni_tk4(__m128i x)
+{
+    x = sm4_aesni_sbox4(x);
+    return _mm_xor_si128(x, _mm_xor_si128(_mm_or_si128(_mm_slli_epi32(x, 13), _mm_srli_epi32(x, 19)),
+                                          _mm_or_si128(_mm_slli_epi32(x, 23), _mm_srli_epi32(x, 9))));
+}
 
-    pkcs7_pad(input, input_len, padded);
-    sm4_setkey(&ctx, key);
-    memcpy(prev, iv, SM4_BLOCK_SIZE);
+/* 4个块转置为按字组织 */
+#define SM4_TRANSPOSE4(unpacklo32, unpackhi32, unpacklo64, unpackhi64, x0, x1, x2, x3, t0, t1, t2, t3) \
+    do { \
+        t0 = unpacklo32(x0, x1); \
+        t1 = unpacklo32(x2, x3); \
+        t2 = unpackhi32(x0, x1); \
+        t3 = unpackhi32(x2, x3); \
+        x0 = unpacklo64(t0, t1); \
+        x1 = unpackhi64(t0, t1); \
+        x2 = unpacklo64(t2, t3); \
+        x3 = unpackhi64(t2, t3); \
+    } while (0)
 
-    /* 分块加密 */
-    for (i = 0; i < padded_len; i += SM4_BLOCK_SIZE) {
-        /* 与前一密文块(或IV)异或 */
-        for (j = 0; j < SM4_BLOCK_SIZE; j++) {
-            block[j] = padded[i + j] ^ prev[j];
-        }
-        sm4_encrypt_block(&ctx, block, output + i);
-        memcpy(prev, output + i, SM4_BLOCK_SIZE);
-    }
+/*
+ * 32轮迭代，RKV(rk, i)给出第i轮的轮密钥向量:
+ * 单密钥时广播rk[i]，多密钥时按SoA布局读取各通道自己的轮密钥
+ */
+#define SM4_ROUNDS4(T, XOR, RKV, rk, x0, x1, x2, x3) \
+    do { \
+        int r_; \
+        for (r_ = 0; r_ < SM4_NUM_ROUNDS; r_ += 4) { \
+            x0 = XOR(x0, T(XOR(XOR(x1, x2), XOR(x3, RKV(rk, r_))))); \
+            x1 = XOR(x1, T(XOR(XOR(x2, x3), XOR(x0, RKV(rk, r_ + 1))))); \
+            x2 = XOR(x2, T(XOR(XOR(x3, x0), XOR(x1, RKV(rk, r_ + 2))))); \
+            x3 = XOR(x3, T(XOR(XOR(x0, x1), XOR(x2, RKV(rk, r_ + 3))))); \
+        } \
+    } while (0)
+
+#define SM4_RK128(rk, i)     _mm_set1_epi32((int)(rk)[i])
+#define SM4_RK128_SOA(rk, i) _mm_loadu_si128((const __m128i *)((rk) + (i) * 4))
+#define SM4_RK256(rk, i)     _mm256_set1_epi32((int)(rk)[i])
+#define SM4_RK256_SOA(rk, i) _mm256_loadu_si256((const __m256i *)((rk) + (i) * 8))
+
+/* AES-NI 4块并行 */
+__attribute__((target("ssse3,aes")))
+static void sm4_aesni_crypt4(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    const __m128i bswap = SM4_M128(SM4_BSWAP32);
+    __m128i x0, x1, x2, x3, t0, t1, t2, t3;
+
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in)), bswap);
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), bswap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 32)), bswap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 48)), bswap);
+    SM4_TRANSPOSE4(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64,
+                   x0, x1, x2, x3, t0, t1, t2, t3);
+
+    SM4_ROUNDS4(sm4_aesni_t4, _mm_xor_si128, SM4_RK128, rk, x0, x1, x2, x3);
+
+    /* 反序变换R后转置回按块组织 */
+    SM4_TRANSPOSE4(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64,
+                   x3, x2, x1, x0, t0, t1, t2, t3);
+    _mm_storeu_si128((__m128i *)(out), _mm_shuffle_epi8(x3, bswap));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_shuffle_epi8(x2, bswap));
+    _mm_storeu_si128((__m128i *)(out + 32), _mm_shuffle_epi8(x1, bswap));
+    _mm_storeu_si128((__m128i *)(out + 48), _mm_shuffle_epi8(x0, bswap));
+}
 
-    /* 清零敏感数据 */
-    sm4_context_clean(&ctx);
-    memset(block, 0, sizeof(block));
-    memset(prev, 0, sizeof(prev));
-    memset(padded, 0, padded_len);
-    free(padded);
-    *output_len = padded_len;
-    return 0;
+/* AES-NI 4块并行，多密钥: 第j块使用SoA轮密钥的第j个通道 */
+__attribute__((target("ssse3,aes")))
+static void sm4_aesni_crypt4_mk(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    const __m128i bswap = SM4_M128(SM4_BSWAP32);
+    __m128i x0, x1, x2, x3, t0, t1, t2, t3;
+
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in)), bswap);
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 16)), bswap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 32)), bswap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + 48)), bswap);
+    SM4_TRANSPOSE4(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64,
+                   x0, x1, x2, x3, t0, t1, t2, t3);
+
+    SM4_ROUNDS4(sm4_aesni_t4, _mm_xor_si128, SM4_RK128_SOA, rk, x0, x1, x2, x3);
+
+    SM4_TRANSPOSE4(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64,
+                   x3, x2, x1, x0, t0, t1, t2, t3);
+    _mm_storeu_si128((__m128i *)(out), _mm_shuffle_epi8(x3, bswap));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_shuffle_epi8(x2, bswap));
+    _mm_storeu_si128((__m128i *)(out + 32), _mm_shuffle_epi8(x1, bswap));
+    _mm_storeu_si128((__m128i *)(out + 48), _mm_shuffle_epi8(x0, bswap));
 }
 
-/* CBC模式解密 */
-int sm4_cbc_decrypt(const uint8_t *key, const uint8_t *iv,
-                    const uint8_t *input, size_t input_len,
-                    uint8_t *output, size_t *output_len)
+/* 8路AVX2: S盒(AESENCLAST按128位通道拆分执行) */
+__attribute__((target("avx2,aes")))
+static inline __m256i sm4_aesni_sbox8(__m256i x)
 {
-    sm4_context ctx;
-    size_t i, j;
-    uint8_t block[SM4_BLOCK_SIZE];
-    uint8_t prev[SM4_BLOCK_SIZE];
+    const __m256i m4 = _mm256_set1_epi8(0x0f);
+    __m256i lo, hi;
+    __m128i a, b;
+
+    lo = _mm256_and_si256(x, m4);
+    hi = _mm256_and_si256(_mm256_srli_epi32(x, 4), m4);
+    x = _mm256_xor_si256(_mm256_shuffle_epi8(SM4_M256(SM4_PRE_LO), lo),
+                         _mm256_shuffle_epi8(SM4_M256(SM4_PRE_HI), hi));
+    x = _mm256_shuffle_epi8(x, SM4_M256(SM4_INV_SHIFT_ROWS));
+    a = _mm_aesenclast_si128(_mm256_castsi256_si128(x), _mm_setzero_si128());
+    b = _mm_aesenclast_si128(_mm256_extracti128_si256(x, 1), _mm_setzero_si128());
+    x = _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1);
+    lo = _mm256_and_si256(x, m4);
+    hi = _mm256_and_si256(_mm256_srli_epi32(x, 4), m4);
+    return _mm256_xor_si256(_mm256_shuffle_epi8(SM4_M256(SM4_POST_LO), lo),
+                            _mm256_shuffle_epi8(SM4_M256(SM4_POST_HI), hi));
+}
 
-    if (!key || !iv || !input || !output || !output_len) {
-        return -1;
-    }
+/* 8路AVX2: 一次τ+L变换 */
+__attribute__((target("avx2,aes")))
+static inline __m256i sm4_aesni_t8(__m256i x)
+{
+    __m256i t;
 
-    if (input_len == 0 || input_len % SM4_BLOCK_SIZE != 0) {
-        return -1;
-    }
+    x = sm4_aesni_sbox8(x);
 
-    sm4_setkey(&ctx, key);
-    memcpy(prev, iv, SM4_BLOCK_SIZE);
+    t = _mm256_xor_si256(x, _mm256_shuffle_epi8(x, SM4_M256(SM4_ROL8)));
+    t = _mm256_xor_si256(t, _mm256_shuffle_epi8(x, SM4_M256(SM4_ROL16)));
+    t = _mm256_or_si256(_mm256_slli_epi32(t, 2), _mm256_srli_epi32(t, 30));
+    x = _mm256_xor_si256(x, _mm256_shuffle_epi8(x, SM4_M256(SM4_ROL24)));
+    return _mm256_xor_si256(x, t);
+}
 
-    /* 分块解密 */
-    for (i = 0; i < input_len; i += SM4_BLOCK_SIZE) {
-        sm4_decrypt_block(&ctx, input + i, block);
-        /* 与前一密文块(或IV)异或 */
-        for (j = 0; j < SM4_BLOCK_SIZE; j++) {
-            output[i + j] = block[j] ^ prev[j];
-        }
-        memcpy(prev, input + i, SM4_BLOCK_SIZE);
-    }
+/* 8路AVX2: 密钥扩展用的τ+L'变换 */
+__attribute__((target("avx2,aes")))
+static inline __m256i sm4_aesni_tk8(__m256i x)
+{
+    x = sm4_aesni_sbox8(x);
+    return _mm256_xor_si256(x, _mm256_xor_si256(
+        _mm256_or_si256(_mm256_slli_epi32(x, 13), _mm256_srli_epi32(x, 19)),
+        _mm256_or_si256(_mm256_slli_epi32(x, 23), _mm256_srli_epi32(x, 9))));
+}
 
-    /* 清零敏感数据 */
-    sm4_context_clean(&ctx);
-    memset(block, 0, sizeof(block));
-    memset(prev, 0, sizeof(prev));
+/* AES-NI + AVX2 8块并行(每个128位通道内转置，通道间互不相干) */
+__attribute__((target("avx2,aes")))
+static void sm4_aesni_avx2_crypt8(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    const __m256i bswap = SM4_M256(SM4_BSWAP32);
+    __m256i x0, x1, x2, x3, t0, t1, t2, t3;
+
+    x0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in)), bswap);
+    x1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + 32)), bswap);
+    x2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + 64)), bswap);
+    x3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + 96)), bswap);
+    SM4_TRANSPOSE4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+                   x0, x1, x2, x3, t0, t1, t2, t3);
+
+    SM4_ROUNDS4(sm4_aesni_t8, _mm256_xor_si256, SM4_RK256, rk, x0, x1, x2, x3);
+
+    SM4_TRANSPOSE4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+                   x3, x2, x1, x0, t0, t1, t2, t3);
+    _mm256_storeu_si256((__m256i *)(out), _mm256_shuffle_epi8(x3, bswap));
+    _mm256_storeu_si256((__m256i *)(out + 32), _mm256_shuffle_epi8(x2, bswap));
+    _mm256_storeu_si256((__m256i *)(out + 64), _mm256_shuffle_epi8(x1, bswap));
+    _mm256_storeu_si256((__m256i *)(out + 96), _mm256_shuffle_epi8(x0, bswap));
+}
 
-    /* 去除填充 */
-    if (pkcs7_unpad(output, input_len, output_len) != 0) {
-        return -1;
-    }
+/*
+ * AES-NI + AVX2 8块并行，多密钥
+ * 先在128位通道间重排为[b0|b4] [b1|b5] [b2|b6] [b3|b7]，
+ * 使字转置后第j个32位通道对应第j块，与SoA轮密钥的通道顺序一致
+ */
+__attribute__((target("avx2,aes")))
+static void sm4_aesni_avx2_crypt8_mk(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    const __m256i bswap = SM4_M256(SM4_BSWAP32);
+    __m256i x0, x1, x2, x3, t0, t1, t2, t3;
+
+    t0 = _mm256_loadu_si256((const __m256i *)(in));
+    t1 = _mm256_loadu_si256((const __m256i *)(in + 32));
+    t2 = _mm256_loadu_si256((const __m256i *)(in + 64));
+    t3 = _mm256_loadu_si256((const __m256i *)(in + 96));
+    x0 = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t0, t2, 0x20), bswap);
+    x1 = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t0, t2, 0x31), bswap);
+    x2 = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t1, t3, 0x20), bswap);
+    x3 = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t1, t3, 0x31), bswap);
+    SM4_TRANSPOSE4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+                   x0, x1, x2, x3, t0, t1, t2, t3);
+
+    SM4_ROUNDS4(sm4_aesni_t8, _mm256_xor_si256, SM4_RK256_SOA, rk, x0, x1, x2, x3);
+
+    SM4_TRANSPOSE4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+                   x3, x2, x1, x0, t0, t1, t2, t3);
+    x3 = _mm256_shuffle_epi8(x3, bswap);
+    x2 = _mm256_shuffle_epi8(x2, bswap);
+    x1 = _mm256_shuffle_epi8(x1, bswap);
+    x0 = _mm256_shuffle_epi8(x0, bswap);
+    _mm256_storeu_si256((__m256i *)(out), _mm256_permute2x128_si256(x3, x2, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(x1, x0, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 64), _mm256_permute2x128_si256(x3, x2, 0x31));
+    _mm256_storeu_si256((__m256i *)(out + 96), _mm256_permute2x128_si256(x1, x0, 0x31));
+}
 
-    return 0;
+/*
+ * 多密钥并行密钥扩展: 每个32位通道对应一个密钥，
+ * 轮密钥按SoA布局输出，rk[i * 通道数 + j]为第j个密钥的第i个轮密钥
+ */
+#define SM4_KEY_ROUNDS4(TK, XOR, SET1, STORE, lanes, rk, k0, k1, k2, k3) \
+    do { \
+        int r_; \
+        for (r_ = 0; r_ < SM4_NUM_ROUNDS; r_ += 4) { \
+            k0 = XOR(k0, TK(XOR(XOR(k1, k2), XOR(k3, SET1((int)SM4_CK[r_]))))); \
+            STORE(rk + (r_) * (lanes), k0); \
+            k1 = XOR(k1, TK(XOR(XOR(k2, k3), XOR(k0, SET1((int)SM4_CK[r_ + 1]))))); \
+            STORE(rk + (r_ + 1) * (lanes), k1); \
+            k2 = XOR(k2, TK(XOR(XOR(k3, k0), XOR(k1, SET1((int)SM4_CK[r_ + 2]))))); \
+            STORE(rk + (r_ + 2) * (lanes), k2); \
+            k3 = XOR(k3, TK(XOR(XOR(k0, k1), XOR(k2, SET1((int)SM4_CK[r_ + 3]))))); \
+            STORE(rk + (r_ + 3) * (lanes), k3); \
+        } \
+    } while (0)
+
+#define SM4_STORE128(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define SM4_STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+/* AES-NI 4密钥并行扩展 */
+__attribute__((target("ssse3,aes")))
+static void sm4_aesni_expand4(const uint8_t *const *keys, uint32_t *rk)
+{
+    const __m128i bswap = SM4_M128(SM4_BSWAP32);
+    __m128i k0, k1, k2, k3, t0, t1, t2, t3;
+
+    k0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)keys[0]), bswap);
+    k1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)keys[1]), bswap);
+    k2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)keys[2]), bswap);
+    k3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)keys[3]), bswap);
+    SM4_TRANSPOSE4(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64,
+                   k0, k1, k2, k3, t0, t1, t2, t3);
+    k0 = _mm_xor_si128(k0, _mm_set1_epi32((int)SM4_FK[0]));
+    k1 = _mm_xor_si128(k1, _mm_set1_epi32((int)SM4_FK[1]));
+    k2 = _mm_xor_si128(k2, _mm_set1_epi32((int)SM4_FK[2]));
+    k3 = _mm_xor_si128(k3, _mm_set1_epi32((int)SM4_FK[3]));
+
+    SM4_KEY_ROUNDS4(sm4_aesni_tk4, _mm_xor_si128, _mm_set1_epi32, SM4_STORE128, 4, rk, k0, k1, k2, k3);
 }
 
-/* GF(2^128)中的乘法运算 (用于GHASH) */
-static void gf128_mul(const uint8_t *x, const uint8_t *y, uint8_t *result)
+/* AES-NI + AVX2 8密钥并行扩展(低128位通道为密钥0-3，高128位通道为密钥4-7) */
+__attribute__((target("avx2,aes")))
+static void sm4_aesni_avx2_expand8(const uint8_t *const *keys, uint32_t *rk)
 {
-    uint8_t v[16];
-    uint8_t z[16] = {0};
-    int i, j, k;
-    uint8_t lsb;
+    const __m256i bswap = SM4_M256(SM4_BSWAP32);
+    __m256i k0, k1, k2, k3, t0, t1, t2, t3;
+
+#define SM4_LOAD_KEY2(a, b) \
+    _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256( \
+        _mm_loadu_si128((const __m128i *)keys[a])), _mm_loadu_si128((const __m128i *)keys[b]), 1), bswap)
+    k0 = SM4_LOAD_KEY2(0, 4);
+    k1 = SM4_LOAD_KEY2(1, 5);
+    k2 = SM4_LOAD_KEY2(2, 6);
+    k3 = SM4_LOAD_KEY2(3, 7);
+#undef SM4_LOAD_KEY2
+    SM4_TRANSPOSE4(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+                   k0, k1, k2, k3, t0, t1, t2, t3);
+    k0 = _mm256_xor_si256(k0, _mm256_set1_epi32((int)SM4_FK[0]));
+    k1 = _mm256_xor_si256(k1, _mm256_set1_epi32((int)SM4_FK[1]));
+    k2 = _mm256_xor_si256(k2, _mm256_set1_epi32((int)SM4_FK[2]));
+    k3 = _mm256_xor_si256(k3, _mm256_set1_epi32((int)SM4_FK[3]));
+
+    SM4_KEY_ROUNDS4(sm4_aesni_tk8, _mm256_xor_si256, _mm256_set1_epi32, SM4_STORE256, 8, rk, k0, k1, k2, k3);
+}
 
-    memcpy(v, y, 16);
+/*
+ * GFNI + AVX-512 16块并行
+ *
+ * GF2P8AFFINEINVQB在AES域上求逆后再做仿射变换，配合一次GF2P8AFFINEQB
+ * 即可直接得到SM4 S盒: S(x) = A2 * inv(A1 * x + c1) + c2。
+ * 16个块各占zmm寄存器的一个32位通道，L变换用VPROLD完成。
+ */
+/* GCC 12的avx512fintrin.h内部使用自初始化的未定义值，会误报-Wuninitialized */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
 
-    for (i = 0; i < 16; i++) {
-        for (j = 0; j < 8; j++) {
-            /* 如果 x[i] 的第 (7-j) 位为1 */
-            if (x[i] & (1 << (7 - j))) {
-                /* z = z ⊕ v */
-                for (k = 0; k < 16; k++) {
-                    z[k] ^= v[k];
-                }
-            }
+#define SM4_GFNI_PRE_MATRIX   0x4c287db91a22505dULL
+#define SM4_GFNI_PRE_CONST    0x3e
+#define SM4_GFNI_POST_MATRIX  0xf3ab34a974a6b589ULL
+#define SM4_GFNI_POST_CONST   0xd3
 
-            /* v右移1位 */
-            lsb = v[15] & 1;
-            for (k = 15; k > 0; k--) {
-                v[k] = (v[k] >> 1) | (v[k - 1] << 7);
-            }
-            v[0] = v[0] >> 1;
+__attribute__((target("avx512f,avx512bw,gfni")))
+static inline __m512i sm4_gfni_sbox16(__m512i x)
+{
+    x = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64((long long)SM4_GFNI_PRE_MATRIX),
+                                      SM4_GFNI_PRE_CONST);
+    return _mm512_gf2p8affineinv_epi64_epi8(x, _mm512_set1_epi64((long long)SM4_GFNI_POST_MATRIX),
+                                            SM4_GFNI_POST_CONST);
+}
 
-            /* 如果最低位为1,则与R异或 */
-            if (lsb) {
-                v[0] ^= 0xe1;
-            }
-        }
-    }
+__attribute__((target("avx512f,avx512bw,gfni")))
+static inline __m512i sm4_gfni_t16(__m512i x)
+{
+    x = sm4_gfni_sbox16(x);
+    /* L(x) = x ^ rol(x,2) ^ rol(x,10) ^ rol(x,18) ^ rol(x,24)，0x96为三输入异或 */
+    return _mm512_ternarylogic_epi32(
+        _mm512_ternarylogic_epi32(x, _mm512_rol_epi32(x, 2), _mm512_rol_epi32(x, 10), 0x96),
+        _mm512_rol_epi32(x, 18), _mm512_rol_epi32(x, 24), 0x96);
+}
 
-    memcpy(result, z, 16);
+/* 密钥扩展用的τ+L'变换 */
+__attribute__((target("avx512f,avx512bw,gfni")))
+static inline __m512i sm4_gfni_tk16(__m512i x)
+{
+    x = sm4_gfni_sbox16(x);
+    return _mm512_ternarylogic_epi32(x, _mm512_rol_epi32(x, 13), _mm512_rol_epi32(x, 23), 0x96);
 }
 
-/* GHASH函数 */
-static void ghash(const uint8_t *h, const uint8_t *data, size_t data_len, uint8_t *result)
+__attribute__((target("avx512f,avx512bw,gfni")))
+static inline __m512i sm4_gfni_xor4(__m512i a, __m512i b, __m512i c, __m512i rk)
 {
-    size_t i;
-    uint8_t block[16];
+    return _mm512_ternarylogic_epi32(a, b, _mm512_xor_si512(c, rk), 0x96);
+}
 
-    memset(result, 0, 16);
+#define SM4_RK512(rk, i)     _mm512_set1_epi32((int)(rk)[i])
+#define SM4_RK512_SOA(rk, i) _mm512_loadu_si512((const void *)((rk) + (i) * 16))
+
+#define SM4_GFNI_ROUNDS(RKV, rk, x0, x1, x2, x3) \
+    do { \
+        int r_; \
+        for (r_ = 0; r_ < SM4_NUM_ROUNDS; r_ += 4) { \
+            x0 = _mm512_xor_si512(x0, sm4_gfni_t16(sm4_gfni_xor4(x1, x2, x3, RKV(rk, r_)))); \
+            x1 = _mm512_xor_si512(x1, sm4_gfni_t16(sm4_gfni_xor4(x2, x3, x0, RKV(rk, r_ + 1)))); \
+            x2 = _mm512_xor_si512(x2, sm4_gfni_t16(sm4_gfni_xor4(x3, x0, x1, RKV(rk, r_ + 2)))); \
+            x3 = _mm512_xor_si512(x3, sm4_gfni_t16(sm4_gfni_xor4(x0, x1, x2, RKV(rk, r_ + 3)))); \
+        } \
+    } while (0)
+
+__attribute__((target("avx512f,avx512bw,gfni")))
+static void sm4_gfni_avx512_crypt16(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    const __m512i bswap = _mm512_broadcast_i32x4(SM4_M128(SM4_BSWAP32));
+    __m512i x0, x1, x2, x3, t0, t1, t2, t3;
+
+    x0 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in)), bswap);
+    x1 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in + 64)), bswap);
+    x2 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in + 128)), bswap);
+    x3 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in + 192)), bswap);
+    SM4_TRANSPOSE4(_mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64,
+                   x0, x1, x2, x3, t0, t1, t2, t3);
+
+    SM4_GFNI_ROUNDS(SM4_RK512, rk, x0, x1, x2, x3);
+
+    SM4_TRANSPOSE4(_mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64,
+                   x3, x2, x1, x0, t0, t1, t2, t3);
+    _mm512_storeu_si512((void *)(out), _mm512_shuffle_epi8(x3, bswap));
+    _mm512_storeu_si512((void *)(out + 64), _mm512_shuffle_epi8(x2, bswap));
+    _mm512_storeu_si512((void *)(out + 128), _mm512_shuffle_epi8(x1, bswap));
+    _mm512_storeu_si512((void *)(out + 192), _mm512_shuffle_epi8(x0, bswap));
+}
 
-    for (i = 0; i < data_len; i += 16) {
-        size_t block_len = (data_len - i < 16) ? (data_len - i) : 16;
-        int j;
+/* 4个zmm寄存器之间按128位通道做4x4转置 */
+#define SM4_LANE_TRANSPOSE512(x0, x1, x2, x3, t0, t1, t2, t3) \
+    do { \
+        t0 = _mm512_shuffle_i64x2(x0, x1, 0x44); \
+        t1 = _mm512_shuffle_i64x2(x0, x1, 0xee); \
+        t2 = _mm512_shuffle_i64x2(x2, x3, 0x44); \
+        t3 = _mm512_shuffle_i64x2(x2, x3, 0xee); \
+        x0 = _mm512_shuffle_i64x2(t0, t2, 0x88); \
+        x1 = _mm512_shuffle_i64x2(t0, t2, 0xdd); \
+        x2 = _mm512_shuffle_i64x2(t1, t3, 0x88); \
+        x3 = _mm512_shuffle_i64x2(t1, t3, 0xdd); \
+    } while (0)
 
-        memset(block, 0, 16);
-        memcpy(block, data + i, block_len);
+/*
+ * GFNI + AVX-512 16块并行，多密钥
+ * 先按128位通道转置为x_a = [b_a, b_(a+4), b_(a+8), b_(a+12)]，
+ * 使字转置后第j个32位通道对应第j块，与SoA轮密钥的通道顺序一致
+ */
+__attribute__((target("avx512f,avx512bw,gfni")))
+static void sm4_gfni_avx512_crypt16_mk(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    const __m512i bswap = _mm512_broadcast_i32x4(SM4_M128(SM4_BSWAP32));
+    __m512i x0, x1, x2, x3, t0, t1, t2, t3;
+
+    x0 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in)), bswap);
+    x1 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in + 64)), bswap);
+    x2 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in + 128)), bswap);
+    x3 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(in + 192)), bswap);
+    SM4_LANE_TRANSPOSE512(x0, x1, x2, x3, t0, t1, t2, t3);
+    SM4_TRANSPOSE4(_mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64,
+                   x0, x1, x2, x3, t0, t1, t2, t3);
+
+    SM4_GFNI_ROUNDS(SM4_RK512_SOA, rk, x0, x1, x2, x3);
+
+    SM4_TRANSPOSE4(_mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64,
+                   x3, x2, x1, x0, t0, t1, t2, t3);
+    SM4_LANE_TRANSPOSE512(x3, x2, x1, x0, t0, t1, t2, t3);
+    _mm512_storeu_si512((void *)(out), _mm512_shuffle_epi8(x3, bswap));
+    _mm512_storeu_si512((void *)(out + 64), _mm512_shuffle_epi8(x2, bswap));
+    _mm512_storeu_si512((void *)(out + 128), _mm512_shuffle_epi8(x1, bswap));
+    _mm512_storeu_si512((void *)(out + 192), _mm512_shuffle_epi8(x0, bswap));
+}
 
-        /* result = result ⊕ block */
-        for (j = 0; j < 16; j++) {
-            result[j] ^= block[j];
-        }
+#define SM4_STORE512(p, v) _mm512_storeu_si512((void *)(p), v)
 
-        /* result = result * H */
-        gf128_mul(result, h, result);
-    }
+/* GFNI + AVX-512 16密钥并行扩展(第L个128位通道为密钥4L..4L+3) */
+__attribute__((target("avx512f,avx512bw,gfni")))
+static void sm4_gfni_avx512_expand16(const uint8_t *const *keys, uint32_t *rk)
+{
+    const __m512i bswap = _mm512_broadcast_i32x4(SM4_M128(SM4_BSWAP32));
+    __m512i k0, k1, k2, k3, t0, t1, t2, t3;
+
+#define SM4_LOAD_KEY4(a) \
+    _mm512_shuffle_epi8(_mm512_inserti32x4(_mm512_inserti32x4(_mm512_inserti32x4( \
+        _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)keys[a])), \
+        _mm_loadu_si128((const __m128i *)keys[(a) + 4]), 1), \
+        _mm_loadu_si128((const __m128i *)keys[(a) + 8]), 2), \
+        _mm_loadu_si128((const __m128i *)keys[(a) + 12]), 3), bswap)
+    k0 = SM4_LOAD_KEY4(0);
+    k1 = SM4_LOAD_KEY4(1);
+    k2 = SM4_LOAD_KEY4(2);
+    k3 = SM4_LOAD_KEY4(3);
+#undef SM4_LOAD_KEY4
+    SM4_TRANSPOSE4(_mm512_unpacklo_epi32, _mm512_unpackhi_epi32, _mm512_unpacklo_epi64, _mm512_unpackhi_epi64,
+                   k0, k1, k2, k3, t0, t1, t2, t3);
+    k0 = _mm512_xor_si512(k0, _mm512_set1_epi32((int)SM4_FK[0]));
+    k1 = _mm512_xor_si512(k1, _mm512_set1_epi32((int)SM4_FK[1]));
+    k2 = _mm512_xor_si512(k2, _mm512_set1_epi32((int)SM4_FK[2]));
+    k3 = _mm512_xor_si512(k3, _mm512_set1_epi32((int)SM4_FK[3]));
+
+    SM4_KEY_ROUNDS4(sm4_gfni_tk16, _mm512_xor_si512, _mm512_set1_epi32, SM4_STORE512, 16, rk,
+                    k0, k1, k2, k3);
 }
 
-/* 增量函数 (用于GCM的计数器) */
-static void gcm_inc32(uint8_t *counter)
+#pragma GCC diagnostic pop
+#else
+static void sm4_cpu_probe(void)
 {
-    uint32_t val;
+}
+#endif /* SM4_HAVE_X86_SIMD */
+
+/*
+ * 位切片SM4实现(常量时间)
+ *
+ * 64个块为一组: 每个状态字拆为8个位平面寄存器(字节内第i位)，
+ * 寄存器的4个64位通道对应字内的4个字节，通道内每一位对应一个块。
+ * S盒以布尔电路计算(复合域GF((2^4)^2)上求逆，同构映射并入输入/输出线性层)，
+ * 整个过程没有依赖密钥或数据的查表与分支，可抵御缓存计时侧信道。
+ * 代码用GCC通用向量类型编写: 默认编译为64位通用寄存器/SSE2运算，
+ * 在target("avx2")的包装函数中内联后即为AVX2实现。
+ */
+#define SM4_BS_BLOCKS 64
+
+typedef uint64_t sm4_bs_word __attribute__((vector_size(32)));
 
-    /* 读取最后4字节作为大端序32位整数 */
-    val = ((uint32_t)counter[12] << 24) |
-          ((uint32_t)counter[13] << 16) |
-          ((uint32_t)counter[14] << 8) |
-          ((uint32_t)counter[15]);
+#define SM4_BS_INLINE static inline __attribute__((always_inline))
 
-    val++;
+/* GF(2^4)乘法(模 z^4 + z + 1) */
+template<class W>
+SM4_BS_INLINE void sm4_bs_gf16_mul(const W *a, const W *b, W *r)
+{
+    W c0, c1, c2, c3, c4, c5, c6;
+
+    c0 = a[0] & b[0];
+    c1 = (a[0] & b[1]) ^ (a[1] & b[0]);
+    c2 = (a[0] & b[2]) ^ (a[1] & b[1]) ^ (a[2] & b[0]);
+    c3 = (a[0] & b[3]) ^ (a[1] & b[2]) ^ (a[2] & b[1]) ^ (a[3] & b[0]);
+    c4 = (a[1] & b[3]) ^ (a[2] & b[2]) ^ (a[3] & b[1]);
+    c5 = (a[2] & b[3]) ^ (a[3] & b[2]);
+    c6 = a[3] & b[3];
+
+    r[0] = c0 ^ c4;
+    r[1] = c1 ^ c4 ^ c5;
+    r[2] = c2 ^ c5 ^ c6;
+    r[3] = c3 ^ c6;
+}
 
-    /* 写回 */
-    counter[12] = (uint8_t)(val >> 24);
-    counter[13] = (uint8_t)(val >> 16);
-    counter[14] = (uint8_t)(val >> 8);
-    counter[15] = (uint8_t)(val);
+/* GF(2^4)平方(线性变换) */
+template<class W>
+SM4_BS_INLINE void sm4_bs_gf16_sq(const W *a, W *r)
+{
+    r[0] = a[0] ^ a[2];
+    r[1] = a[2];
+    r[2] = a[1] ^ a[3];
+    r[3] = a[3];
 }
 
-/* GCTR函数 (GCM的计数器模式加密) */
-static void gctr(const sm4_context *ctx, const uint8_t *icb, 
-                 const uint8_t *input, size_t input_len, uint8_t *output)
+/*
+ * S盒布尔电路: x[0..7]为字节的8个位平面(x[0]为最低位)，原地替换
+ * 复合域元素 a = a1*y + a0，y^2 = y + λ (λ = z^3)，
+ * a^-1 = (a1*y + a0 + a1) * Δ^-1，Δ = λ*a1^2 + a1*a0 + a0^2，Δ^-1 = Δ^14
+ * 只用与、异或、取反，W可以是位切片向量，也可以是普通整数(每一位是一个通道)
+ */
+template<class W>
+SM4_BS_INLINE void sm4_bs_sbox(W *x)
 {
-    uint8_t counter[16];
-    uint8_t encrypted_counter[16];
-    size_t i, j;
+    W u[8], v[8];
+    W d[4], d2[4], d4[4], d8[4], t[4], s[4];
+
+    /* 输入仿射变换并映射到复合域: u[0..3] = a0, u[4..7] = a1 */
+    u[0] = x[3] ^ x[4] ^ x[6] ^ x[7];
+    u[1] = x[0] ^ x[2] ^ x[5] ^ x[6];
+    u[2] = ~(x[1] ^ x[2] ^ x[3] ^ x[4] ^ x[5] ^ x[7]);
+    u[3] = ~(x[0] ^ x[1] ^ x[5] ^ x[6] ^ x[7]);
+    u[4] = x[0] ^ x[1] ^ x[4] ^ x[7];
+    u[5] = ~x[6];
+    u[6] = x[2] ^ x[6] ^ x[7];
+    u[7] = ~(x[0] ^ x[1] ^ x[2] ^ x[3] ^ x[4] ^ x[5] ^ x[6]);
+
+    /* Δ = λ*a1^2 + a1*a0 + a0^2 */
+    sm4_bs_gf16_mul(u + 4, u, d);
+    sm4_bs_gf16_sq(u, s);
+    d[0] ^= s[0] ^ u[6];
+    d[1] ^= s[1] ^ u[5] ^ u[6] ^ u[7];
+    d[2] ^= s[2] ^ u[5];
+    d[3] ^= s[3] ^ u[4] ^ u[6] ^ u[7];
+
+    /* Δ^-1 = Δ^2 * Δ^4 * Δ^8 */
+    sm4_bs_gf16_sq(d, d2);
+    sm4_bs_gf16_sq(d2, d4);
+    sm4_bs_gf16_sq(d4, d8);
+    sm4_bs_gf16_mul(d2, d4, t);
+    sm4_bs_gf16_mul(t, d8, d);
+
+    /* v = (a1*Δ^-1)*y + (a0 + a1)*Δ^-1 */
+    sm4_bs_gf16_mul(u + 4, d, v + 4);
+    t[0] = u[0] ^ u[4];
+    t[1] = u[1] ^ u[5];
+    t[2] = u[2] ^ u[6];
+    t[3] = u[3] ^ u[7];
+    sm4_bs_gf16_mul(t, d, v);
+
+    /* 映射回标准表示并做输出仿射变换 */
+    x[0] = ~(v[0] ^ v[1] ^ v[4] ^ v[7]);
+    x[1] = ~(v[0] ^ v[2] ^ v[6]);
+    x[2] = v[2] ^ v[5] ^ v[6] ^ v[7];
+    x[3] = v[0] ^ v[2] ^ v[4] ^ v[7];
+    x[4] = ~(v[1] ^ v[3] ^ v[4]);
+    x[5] = v[1] ^ v[3] ^ v[4] ^ v[5] ^ v[7];
+    x[6] = ~(v[0] ^ v[1] ^ v[2] ^ v[4] ^ v[6]);
+    x[7] = ~(v[0] ^ v[3] ^ v[4]);
+}
 
-    if (input_len == 0) {
-        return;
-    }
+/*
+ * T变换: 先S盒，再L(x) = x ^ rol(x,24) ^ rol(x ^ rol(x,8) ^ rol(x,16), 2)
+ * 循环移位8的倍数即通道轮换；移2位时低2个位平面取自相邻字节的高2位
+ */
+SM4_BS_INLINE void sm4_bs_t(sm4_bs_word *x)
+{
+    const sm4_bs_word rol8 = {3, 0, 1, 2};
+    const sm4_bs_word rol16 = {2, 3, 0, 1};
+    const sm4_bs_word rol24 = {1, 2, 3, 0};
+    sm4_bs_word t[8];
+    int i;
 
-    memcpy(counter, icb, 16);
+    sm4_bs_sbox(x);
 
-    for (i = 0; i < input_len; i += 16) {
-        sm4_encrypt_block(ctx, counter, encrypted_counter);
+    for (i = 0; i < 8; i++) {
+        t[i] = x[i] ^ __builtin_shuffle(x[i], rol8) ^ __builtin_shuffle(x[i], rol16);
+    }
+    for (i = 0; i < 8; i++) {
+        x[i] ^= __builtin_shuffle(x[i], rol24);
+    }
+    x[0] ^= __builtin_shuffle(t[6], rol8);
+    x[1] ^= __builtin_shuffle(t[7], rol8);
+    for (i = 2; i < 8; i++) {
+        x[i] ^= t[i - 2];
+    }
+}
 
-        for (j = 0; j < 16 && (i + j) < input_len; j++) {
-            output[i + j] = input[i + j] ^ encrypted_counter[j];
+/* 64x64位矩阵转置: 转置后 a[i] 的第j位 = 原 a[j] 的第i位 */
+static void sm4_bs_transpose64(uint64_t *a)
+{
+    uint64_t m = 0x00000000ffffffffULL;
+    uint64_t t;
+    int j, k;
+
+    for (j = 32; j != 0; j >>= 1, m ^= m << j) {
+        for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k] ^= t << j;
+            a[k | j] ^= t;
         }
-
-        gcm_inc32(counter);
     }
 }
 
-/* SM4 GCM模式加密 */
-int sm4_gcm_encrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
-                    const uint8_t *aad, size_t aad_len,
-                    const uint8_t *input, size_t input_len,
-                    uint8_t *output, uint8_t *tag)
+/* 轮密钥展开为位平面掩码(按位取全0/全1，无分支) */
+SM4_BS_INLINE void sm4_bs_round_key(uint32_t rk, sm4_bs_word *k)
 {
-    sm4_context ctx;
-    uint8_t h[16] = {0};
-    uint8_t j0[16];
-    uint8_t *ghash_input = NULL;
-    size_t ghash_buf_size;
-    size_t ghash_len = 0;
-    uint64_t aad_bits, input_bits;
-    uint8_t s[16];
-    int i;
+    int i, lane;
 
-    if (!key || !iv || !output || !tag) {
-        return -1;
+    for (i = 0; i < 8; i++) {
+        for (lane = 0; lane < 4; lane++) {
+            k[i][lane] = (uint64_t)0 - (uint64_t)((rk >> (8 * lane + i)) & 1);
+        }
     }
+}
 
-    /* 动态分配 GHASH 输入缓冲区: aad_padded + cipher_padded + 16(length) */
-    ghash_buf_size = ((aad_len + 15) / 16) * 16 + ((input_len + 15) / 16) * 16 + 16;
-    ghash_input = (uint8_t *)malloc(ghash_buf_size);
-    if (!ghash_input) {
-        return -1;
+/* 64块一组的位切片加解密核心 */
+SM4_BS_INLINE void sm4_bs_crypt64_body(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    uint64_t a[64];
+    sm4_bs_word x[4][8];
+    sm4_bs_word t[8];
+    int b, w, i, r;
+
+    /* 按块载入，每两个状态字组成一个64位行，转置后得到位平面 */
+    for (w = 0; w < 4; w += 2) {
+        for (b = 0; b < SM4_BS_BLOCKS; b++) {
+            a[b] = (uint64_t)load_u32_be(in + b * SM4_BLOCK_SIZE + w * 4) |
+                   ((uint64_t)load_u32_be(in + b * SM4_BLOCK_SIZE + w * 4 + 4) << 32);
+        }
+        sm4_bs_transpose64(a);
+        for (i = 0; i < 8; i++) {
+            for (b = 0; b < 4; b++) {
+                x[w][i][b] = a[8 * b + i];
+                x[w + 1][i][b] = a[32 + 8 * b + i];
+            }
+        }
     }
 
-    /* 设置密钥 */
-    sm4_setkey(&ctx, key);
-
-    /* 计算H = E(K, 0^128) */
-    sm4_encrypt_block(&ctx, h, h);
-
-    /* 计算J0 */
-    if (iv_len == 12) {
-        /* 推荐的IV长度 */
-        memcpy(j0, iv, 12);
-        j0[12] = j0[13] = j0[14] = 0;
-        j0[15] = 1;
-    } else {
-        /* 其他IV长度 */
-        uint8_t len_block[16] = {0};
-        uint64_t iv_bits = (uint64_t)iv_len * 8;
-        int j;
+    for (r = 0; r < SM4_NUM_ROUNDS; r++) {
+        sm4_bs_word *x0 = x[r & 3];
+        const sm4_bs_word *x1 = x[(r + 1) & 3];
+        const sm4_bs_word *x2 = x[(r + 2) & 3];
+        const sm4_bs_word *x3 = x[(r + 3) & 3];
 
-        for (j = 0; j < 8; j++) {
-            len_block[15 - j] = (uint8_t)(iv_bits >> (j * 8));
+        sm4_bs_round_key(rk[r], t);
+        for (i = 0; i < 8; i++) {
+            t[i] ^= x1[i] ^ x2[i] ^ x3[i];
         }
-
-        memset(j0, 0, 16);
-        ghash(h, iv, iv_len, j0);
-
-        for (j = 0; j < 16; j++) {
-            j0[j] ^= len_block[j];
+        sm4_bs_t(t);
+        for (i = 0; i < 8; i++) {
+            x0[i] ^= t[i];
         }
-        gf128_mul(j0, h, j0);
     }
 
-    /* 加密: C = GCTR(K, inc32(J0), P) */
-    uint8_t icb[16];
-    memcpy(icb, j0, 16);
-    gcm_inc32(icb);
-    gctr(&ctx, icb, input, input_len, output);
-
-    /* 构造GHASH输入: AAD || 0* || C || 0* || len(AAD) || len(C) */
-    memset(ghash_input, 0, ghash_buf_size);
-    ghash_len = 0;
-
-    /* 添加AAD */
-    if (aad && aad_len > 0) {
-        memcpy(ghash_input, aad, aad_len);
-        ghash_len = aad_len;
-        /* 填充到16字节边界 */
-        if (ghash_len % 16 != 0) {
-            ghash_len += 16 - (ghash_len % 16);
+    /* 反序变换R: 输出字依次为 X35, X34, X33, X32 */
+    for (w = 0; w < 4; w += 2) {
+        for (i = 0; i < 8; i++) {
+            for (b = 0; b < 4; b++) {
+                a[8 * b + i] = x[3 - w][i][b];
+                a[32 + 8 * b + i] = x[2 - w][i][b];
+            }
+        }
+        sm4_bs_transpose64(a);
+        for (b = 0; b < SM4_BS_BLOCKS; b++) {
+            store_u32_be(out + b * SM4_BLOCK_SIZE + w * 4, (uint32_t)a[b]);
+            store_u32_be(out + b * SM4_BLOCK_SIZE + w * 4 + 4, (uint32_t)(a[b] >> 32));
         }
     }
 
-    /* 添加密文 */
-    memcpy(ghash_input + ghash_len, output, input_len);
-    ghash_len += input_len;
-    /* 填充到16字节边界 */
-    if (ghash_len % 16 != 0) {
-        ghash_len += 16 - (ghash_len % 16);
-    }
+    memset(a, 0, sizeof(a));
+    memset(x, 0, sizeof(x));
+    memset(t, 0, sizeof(t));
+}
 
-    /* 添加长度字段 */
-    aad_bits = (uint64_t)aad_len * 8;
-    input_bits = (uint64_t)input_len * 8;
+static void sm4_bs_crypt64(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    sm4_bs_crypt64_body(rk, in, out);
+}
 
-    for (i = 0; i < 8; i++) {
-        ghash_input[ghash_len + i] = (uint8_t)(aad_bits >> (56 - i * 8));
-        ghash_input[ghash_len + 8 + i] = (uint8_t)(input_bits >> (56 - i * 8));
-    }
-    ghash_len += 16;
+#ifdef SM4_HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static void sm4_bs_avx2_crypt64(const uint32_t *rk, const uint8_t *in, uint8_t *out)
+{
+    sm4_bs_crypt64_body(rk, in, out);
+}
+#endif
 
-    /* 计算S = GHASH(H, ghash_input) */
-    ghash(h, ghash_input, ghash_len, s);
+/* 位切片多块处理: 每64块一组，不足一组时补零块后整组计算 */
+static void sm4_bs_crypt_blocks_rk(const uint32_t *rk, const uint8_t *input, uint8_t *output,
+                                   size_t nblocks)
+{
+    uint8_t buf[SM4_BS_BLOCKS * SM4_BLOCK_SIZE];
+    void (*crypt64)(const uint32_t *, const uint8_t *, uint8_t *) = sm4_bs_crypt64;
+
+#ifdef SM4_HAVE_X86_SIMD
+    if (sm4_cpu_avx2) {
+        crypt64 = sm4_bs_avx2_crypt64;
+    }
+#endif
+
+    for (; nblocks >= SM4_BS_BLOCKS; nblocks -= SM4_BS_BLOCKS) {
+        crypt64(rk, input, output);
+        input += SM4_BS_BLOCKS * SM4_BLOCK_SIZE;
+        output += SM4_BS_BLOCKS * SM4_BLOCK_SIZE;
+    }
+
+    if (nblocks > 0) {
+        memset(buf, 0, sizeof(buf));
+        memcpy(buf, input, nblocks * SM4_BLOCK_SIZE);
+        crypt64(rk, buf, buf);
+        memcpy(output, buf, nblocks * SM4_BLOCK_SIZE);
+        memset(buf, 0, sizeof(buf));
+    }
+}
+
+/*
+ * 单字的常量时间S盒: 第i个位平面取4个字节各自的第i位(位于每个字节的最低位)，
+ * 用普通32位整数运行同一个S盒电路，其余位上的结果丢弃
+ */
+static inline uint32_t sm4_bs_sbox_word(uint32_t x)
+{
+    uint32_t p[8];
+    uint32_t y = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        p[i] = (x >> i) & 0x01010101;
+    }
+    sm4_bs_sbox(p);
+    for (i = 0; i < 8; i++) {
+        y |= (p[i] & 0x01010101) << i;
+    }
+    return y;
+}
+
+/* T变换(常量时间) */
+static inline uint32_t sm4_t_ct(uint32_t x)
+{
+    return sm4_l(sm4_bs_sbox_word(x));
+}
+
+/* T'变换(常量时间，密钥扩展用) */
+static uint32_t sm4_t_prime_ct(uint32_t x)
+{
+    return sm4_l_prime(sm4_bs_sbox_word(x));
+}
+
+/*
+ * 单块常量时间实现: 与T表单块内核结构相同，T变换改用S盒电路，
+ * 位切片模式下作为单块内核，处理不足一组的剩余块和CBC加密等串行模式
+ */
+template<bool Rev>
+static void sm4_crypt_block_bs(const uint32_t *rk, const uint8_t *input, uint8_t *output)
+{
+    uint32_t x0 = load_u32_be(input);
+    uint32_t x1 = load_u32_be(input + 4);
+    uint32_t x2 = load_u32_be(input + 8);
+    uint32_t x3 = load_u32_be(input + 12);
+    int i;
+
+    for (i = 0; i < SM4_NUM_ROUNDS; i += 4) {
+        x0 ^= sm4_t_ct(x1 ^ x2 ^ x3 ^ SM4_RK_AT(rk, i));
+        x1 ^= sm4_t_ct(x2 ^ x3 ^ x0 ^ SM4_RK_AT(rk, i + 1));
+        x2 ^= sm4_t_ct(x3 ^ x0 ^ x1 ^ SM4_RK_AT(rk, i + 2));
+        x3 ^= sm4_t_ct(x0 ^ x1 ^ x2 ^ SM4_RK_AT(rk, i + 3));
+    }
+
+    store_u32_be(output, x3);
+    store_u32_be(output + 4, x2);
+    store_u32_be(output + 8, x1);
+    store_u32_be(output + 12, x0);
+}
+
+/*
+ * 运行时内核分派
+ *
+ * 共享库按通用x86-64指令集编译(不使用-march=native)，各SIMD内核通过
+ * target属性单独开启所需指令。sm4_init探测一次CPU特性，并用GB/T 32907
+ * 标准向量对每个候选内核做自检，通过后才发布到分派表中。
+ */
+typedef struct {
+    const char *name;
+    size_t blocks;          /* 每次调用处理的块数 */
+    size_t min_blocks;      /* 不足一组时，剩余块数达到该值即补零走本内核 */
+    int hw;                 /* 是否依赖硬件S盒指令(AES-NI/GFNI) */
+    int (*supported)(void);
+    sm4_kernel_fn crypt;
+    /* 多密钥并行扩展(blocks个密钥，SoA输出)，NULL表示不支持 */
+    void (*expand)(const uint8_t *const *keys, uint32_t *rk);
+    /* 多密钥加密: 第j块使用SoA轮密钥的第j个通道 */
+    sm4_kernel_fn crypt_mk;
+    /* 单块内核的逆序遍历版本(按加密轮密钥解密)，多块内核为NULL */
+    sm4_kernel_fn crypt_rev;
+} sm4_kernel_desc;
+
+static int sm4_cpu_any(void)
+{
+    return 1;
+}
+
+#ifdef SM4_HAVE_X86_SIMD
+static int sm4_cpu_has_gfni_avx512(void)
+{
+    return sm4_cpu_gfni_avx512;
+}
+
+static int sm4_cpu_has_aesni_avx2(void)
+{
+    return sm4_cpu_aesni && sm4_cpu_avx2;
+}
+
+static int sm4_cpu_has_aesni(void)
+{
+    return sm4_cpu_aesni;
+}
+
+static int sm4_cpu_has_avx2(void)
+{
+    return sm4_cpu_avx2;
+}
+#endif
+
+/* 候选内核，按优先级(并行宽度)从高到低排列 */
+static const sm4_kernel_desc SM4_KERNELS[] = {
+#ifdef SM4_HAVE_X86_SIMD
+    {"gfni-avx512", 16, 16, 1, sm4_cpu_has_gfni_avx512, sm4_gfni_avx512_crypt16,
+     sm4_gfni_avx512_expand16, sm4_gfni_avx512_crypt16_mk, NULL},
+    {"aesni-avx2", 8, 8, 1, sm4_cpu_has_aesni_avx2, sm4_aesni_avx2_crypt8,
+     sm4_aesni_avx2_expand8, sm4_aesni_avx2_crypt8_mk, NULL},
+    {"aesni", 4, 4, 1, sm4_cpu_has_aesni, sm4_aesni_crypt4,
+     sm4_aesni_expand4, sm4_aesni_crypt4_mk, NULL},
+    /* 位切片整组的开销约为3~5个常量时间单块，剩余块达到该数即补零整组计算 */
+    {"bitslice-avx2", SM4_BS_BLOCKS, 4, 0, sm4_cpu_has_avx2, sm4_bs_avx2_crypt64,
+     NULL, NULL, NULL},
+#endif
+    {"bitslice", SM4_BS_BLOCKS, 6, 0, sm4_cpu_any, sm4_bs_crypt64, NULL, NULL, NULL},
+    {"bitslice-block", 1, 1, 0, sm4_cpu_any, sm4_crypt_block_bs<false>, NULL, NULL,
+     sm4_crypt_block_bs<true>},
+    {"ttable-x4", 4, 4, 0, sm4_cpu_any, sm4_crypt4_ttable, NULL, NULL, NULL},
+    {"ttable", 1, 1, 0, sm4_cpu_any, sm4_crypt_block_ttable<false>, NULL, NULL,
+     sm4_crypt_block_ttable<true>},
+    {"scalar", 1, 1, 0, sm4_cpu_any, sm4_crypt_block_sbox<false>, NULL, NULL,
+     sm4_crypt_block_sbox<true>},
+};
+
+#define SM4_NUM_KERNELS (sizeof(SM4_KERNELS) / sizeof(SM4_KERNELS[0]))
+
+/* 当前生效的多块内核链(以NULL结尾)，剩余块交给sm4_single_block */
+static const sm4_kernel_desc *sm4_active[SM4_NUM_KERNELS + 1];
+static const char *sm4_active_name = "scalar";
+
+/* GB/T 32907-2016 附录A 示例1 */
+static const uint8_t SM4_SELFTEST_KEY[16] = {
+    0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+    0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10
+};
+static const uint8_t SM4_SELFTEST_CT[16] = {
+    0x68, 0x1e, 0xdf, 0x34, 0xd2, 0x06, 0x96, 0x5e,
+    0x86, 0xb3, 0xe9, 0x4f, 0x53, 0x6e, 0x42, 0x46
+};
+
+/*
+ * 内核自检: 第0块为标准向量(明文与密钥相同)，其余块在其基础上变化末字节，
+ * 结果须与标准逐步实现一致，且用逆序轮密钥可还原
+ */
+static int sm4_kernel_selftest(const sm4_kernel_desc *k)
+{
+    uint8_t in[SM4_BS_BLOCKS * SM4_BLOCK_SIZE];
+    uint8_t out[SM4_BS_BLOCKS * SM4_BLOCK_SIZE];
+    uint8_t ref[SM4_BS_BLOCKS * SM4_BLOCK_SIZE];
+    uint32_t rk[SM4_NUM_ROUNDS];
+    uint32_t rk_rev[SM4_NUM_ROUNDS];
+    size_t len = k->blocks * SM4_BLOCK_SIZE;
+    size_t i;
+    int ok;
+
+    sm4_key_schedule(SM4_SELFTEST_KEY, rk);
+    for (i = 0; i < SM4_NUM_ROUNDS; i++) {
+        rk_rev[i] = rk[SM4_NUM_ROUNDS - 1 - i];
+    }
+
+    for (i = 0; i < k->blocks; i++) {
+        memcpy(in + i * SM4_BLOCK_SIZE, SM4_SELFTEST_KEY, SM4_BLOCK_SIZE);
+        in[i * SM4_BLOCK_SIZE + SM4_BLOCK_SIZE - 1] ^= (uint8_t)i;
+        sm4_crypt_block_sbox<false>(rk, in + i * SM4_BLOCK_SIZE, ref + i * SM4_BLOCK_SIZE);
+    }
+
+    k->crypt(rk, in, out);
+    ok = memcmp(out, SM4_SELFTEST_CT, SM4_BLOCK_SIZE) == 0 && memcmp(out, ref, len) == 0;
+
+    k->crypt(rk_rev, out, out);
+    ok = ok && memcmp(out, in, len) == 0;
+
+    /* 逆序遍历版本: 用正序轮密钥解密 */
+    if (ok && k->crypt_rev != NULL) {
+        k->crypt(rk, in, out);
+        k->crypt_rev(rk, out, out);
+        ok = memcmp(out, in, len) == 0;
+    }
+
+    /* 多密钥扩展: 以各输入块为密钥，逐通道与标量密钥扩展比对 */
+    if (ok && k->expand != NULL) {
+        const uint8_t *keys[SM4_MULTI_KEY_LANES];
+        uint32_t rk_soa[SM4_NUM_ROUNDS * SM4_MULTI_KEY_LANES];
+        size_t j;
+
+        for (j = 0; j < k->blocks; j++) {
+            keys[j] = in + j * SM4_BLOCK_SIZE;
+        }
+        k->expand(keys, rk_soa);
+        for (j = 0; j < k->blocks && ok; j++) {
+            sm4_key_schedule(keys[j], rk);
+            for (i = 0; i < SM4_NUM_ROUNDS; i++) {
+                if (rk_soa[i * k->blocks + j] != rk[i]) {
+                    ok = 0;
+                }
+            }
+            sm4_crypt_block_sbox<false>(rk, SM4_SELFTEST_CT, ref + j * SM4_BLOCK_SIZE);
+        }
+
+        /* 多密钥加密: 各通道用自己的密钥加密同一块 */
+        if (ok && k->crypt_mk != NULL) {
+            for (j = 0; j < k->blocks; j++) {
+                memcpy(out + j * SM4_BLOCK_SIZE, SM4_SELFTEST_CT, SM4_BLOCK_SIZE);
+            }
+            k->crypt_mk(rk_soa, out, out);
+            ok = memcmp(out, ref, len) == 0;
+        }
+    }
+
+    return ok;
+}
+
+static int sm4_kernel_usable(const sm4_kernel_desc *k)
+{
+    return k->supported() && sm4_kernel_selftest(k);
+}
+
+/* 常量时间密钥扩展自检: 与查表实现结果一致 */
+static int sm4_ct_key_schedule_ok(void)
+{
+    uint32_t rk[SM4_NUM_ROUNDS];
+    uint32_t ref[SM4_NUM_ROUNDS];
+
+    sm4_key_schedule_with<sm4_t_prime_ct>(SM4_SELFTEST_KEY, rk);
+    sm4_key_schedule_with<sm4_t_prime>(SM4_SELFTEST_KEY, ref);
+    return memcmp(rk, ref, sizeof(rk)) == 0;
+}
+
+/*
+ * 单块内核: 位切片模式(ct非0)下使用常量时间单块实现并开启常量时间密钥扩展，
+ * 否则使用T表；自检失败时依次退回T表、逐步实现
+ */
+static void sm4_select_single(int ct)
+{
+    size_t i;
+
+    sm4_single_block = sm4_crypt_block_sbox<false>;
+    sm4_single_block_rev = sm4_crypt_block_sbox<true>;
+    sm4_active_name = "scalar";
+    sm4_ct_mode = 0;
+    if (ct) {
+        for (i = 0; i < SM4_NUM_KERNELS; i++) {
+            if (SM4_KERNELS[i].crypt == sm4_crypt_block_bs<false> &&
+                sm4_kernel_usable(&SM4_KERNELS[i]) && sm4_ct_key_schedule_ok()) {
+                sm4_single_block = SM4_KERNELS[i].crypt;
+                sm4_single_block_rev = SM4_KERNELS[i].crypt_rev;
+                sm4_active_name = SM4_KERNELS[i].name;
+                sm4_ct_mode = 1;
+                return;
+            }
+        }
+    }
+    for (i = 0; i < SM4_NUM_KERNELS; i++) {
+        if (SM4_KERNELS[i].crypt == sm4_crypt_block_ttable<false> &&
+            sm4_kernel_usable(&SM4_KERNELS[i])) {
+            sm4_single_block = SM4_KERNELS[i].crypt;
+            sm4_single_block_rev = SM4_KERNELS[i].crypt_rev;
+            sm4_active_name = SM4_KERNELS[i].name;
+        }
+    }
+}
+
+/*
+ * 自动选择: 所有可用的硬件内核按宽度依次使用，最后不足一组的块按4块交织处理，
+ * 单块与密钥扩展用T表；
+ * 没有硬件S盒指令时进入位切片模式: 多块走位切片内核，剩余块、单块操作和
+ * 密钥扩展都用S盒电路，整个过程没有依赖密钥或数据的查表
+ */
+static void sm4_select_auto(void)
+{
+    size_t i, n = 0;
+    int ct = 0;
+
+    for (i = 0; i < SM4_NUM_KERNELS; i++) {
+        if (SM4_KERNELS[i].hw && sm4_kernel_usable(&SM4_KERNELS[i])) {
+            sm4_active[n++] = &SM4_KERNELS[i];
+        }
+    }
+    if (n == 0) {
+        for (i = 0; i < SM4_NUM_KERNELS; i++) {
+            if (SM4_KERNELS[i].blocks == SM4_BS_BLOCKS && sm4_kernel_usable(&SM4_KERNELS[i])) {
+                sm4_active[n++] = &SM4_KERNELS[i];
+                ct = 1;
+                break;
+            }
+        }
+    }
+    if (!ct) {
+        for (i = 0; i < SM4_NUM_KERNELS; i++) {
+            if (SM4_KERNELS[i].crypt == sm4_crypt4_ttable && sm4_kernel_usable(&SM4_KERNELS[i])) {
+                sm4_active[n++] = &SM4_KERNELS[i];
+            }
+        }
+    }
+    sm4_active[n] = NULL;
+
+    sm4_select_single(ct);
+
+    if (n > 0) {
+        sm4_active_name = sm4_active[0]->name;
+    }
+}
+
+static void sm4_select_ghash(void);
+
+static void sm4_init_once(void)
+{
+    sm4_t_table_init();
+    sm4_cpu_probe();
+    sm4_select_auto();
+    sm4_select_ghash();
+}
+
+/*
+ * 初始化: 生成T表、探测CPU特性并选择内核，重复调用无副作用；
+ * 由pthread_once保证多个线程同时首次调用时只执行一次，且返回时表和分派结果已对调用线程可见
+ */
+void sm4_init(void)
+{
+    pthread_once(&sm4_once, sm4_init_once);
+}
+
+/* 当前使用的内核名称 */
+const char *sm4_kernel_name(void)
+{
+    sm4_init();
+    return sm4_active_name;
+}
+
+/* 强制指定内核，NULL或"auto"恢复自动选择 */
+int sm4_set_kernel(const char *name)
+{
+    size_t i;
+
+    sm4_init();
+
+    if (name == NULL || strcmp(name, "auto") == 0) {
+        sm4_select_auto();
+        return 0;
+    }
+
+    for (i = 0; i < SM4_NUM_KERNELS; i++) {
+        const sm4_kernel_desc *k = &SM4_KERNELS[i];
+
+        if (strcmp(name, k->name) != 0) {
+            continue;
+        }
+        if (!sm4_kernel_usable(k)) {
+            return -1;
+        }
+
+        /* 指定位切片内核时同时进入位切片模式 */
+        if (k->blocks > 1) {
+            sm4_select_single(k->blocks == SM4_BS_BLOCKS);
+            sm4_active[0] = k;
+            sm4_active[1] = NULL;
+        } else {
+            sm4_single_block = k->crypt;
+            sm4_single_block_rev = k->crypt_rev;
+            sm4_ct_mode = k->crypt == sm4_crypt_block_bs<false> && sm4_ct_key_schedule_ok();
+            sm4_active[0] = NULL;
+        }
+        sm4_active_name = k->name;
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * 多块处理: 依次用分派表中的多块内核处理整组，剩余块逐块处理
+ * 各块之间必须相互独立(ECB、CBC解密、CTR)
+ */
+static void sm4_crypt_blocks_rk(const uint32_t *rk, const uint8_t *input, uint8_t *output,
+                                size_t nblocks)
+{
+    const sm4_kernel_desc *const *k;
+
+    for (k = sm4_active; *k != NULL && nblocks > 0; k++) {
+        size_t width = (*k)->blocks;
+
+        for (; nblocks >= width; nblocks -= width) {
+            (*k)->crypt(rk, input, output);
+            input += width * SM4_BLOCK_SIZE;
+            output += width * SM4_BLOCK_SIZE;
+        }
+
+        /* 位切片内核按整组计算，剩余块较多时补零一次处理更快 */
+        if (nblocks > 0 && nblocks >= (*k)->min_blocks) {
+            uint8_t buf[SM4_BS_BLOCKS * SM4_BLOCK_SIZE];
+
+            memset(buf, 0, width * SM4_BLOCK_SIZE);
+            memcpy(buf, input, nblocks * SM4_BLOCK_SIZE);
+            (*k)->crypt(rk, buf, buf);
+            memcpy(output, buf, nblocks * SM4_BLOCK_SIZE);
+            memset(buf, 0, width * SM4_BLOCK_SIZE);
+            return;
+        }
+    }
+
+    for (; nblocks > 0; nblocks--) {
+        sm4_single_block(rk, input, output);
+        input += SM4_BLOCK_SIZE;
+        output += SM4_BLOCK_SIZE;
+    }
+}
+
+/* 多密钥扩展: 按分派表中支持并行扩展的内核分组处理，剩余密钥逐个扩展 */
+void sm4_setkey_multi(sm4_context *ctx, const uint8_t *const *keys, size_t n)
+{
+    uint32_t rk_soa[SM4_NUM_ROUNDS * SM4_MULTI_KEY_LANES];
+    const sm4_kernel_desc *const *k;
+    int used = 0;
+
+    sm4_init();
+
+    for (k = sm4_active; *k != NULL && n > 0; k++) {
+        size_t lanes = (*k)->blocks;
+        size_t i, j;
+
+        if ((*k)->expand == NULL) {
+            continue;
+        }
+        for (; n >= lanes; n -= lanes) {
+            (*k)->expand(keys, rk_soa);
+            for (j = 0; j < lanes; j++) {
+                for (i = 0; i < SM4_NUM_ROUNDS; i++) {
+                    ctx[j].rk[i] = rk_soa[i * lanes + j];
+                }
+            }
+            keys += lanes;
+            ctx += lanes;
+            used = 1;
+        }
+    }
+
+    for (; n > 0; n--) {
+        sm4_key_schedule(*keys++, (ctx++)->rk);
+    }
+
+    if (used) {
+        memset(rk_soa, 0, sizeof(rk_soa));
+    }
+}
+
+/* 生成解密用的逆序轮密钥 */
+static void sm4_reverse_rk(const sm4_context *ctx, uint32_t *rk_rev)
+{
+    int i;
+    for (i = 0; i < SM4_NUM_ROUNDS; i++) {
+        rk_rev[i] = ctx->rk[SM4_NUM_ROUNDS - 1 - i];
+    }
+}
+
+/* 按上下文中的轮密钥顺序处理多个块 */
+void sm4_crypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                      size_t nblocks)
+{
+    sm4_crypt_blocks_rk(ctx->rk, input, output, nblocks);
+}
+
+/* 多块加密 */
+void sm4_encrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                        size_t nblocks)
+{
+    sm4_crypt_blocks_rk(ctx->rk, input, output, nblocks);
+}
+
+/* 多块解密(ctx为加密密钥扩展结果) */
+void sm4_decrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                        size_t nblocks)
+{
+    uint32_t rk_rev[SM4_NUM_ROUNDS];
+
+    sm4_reverse_rk(ctx, rk_rev);
+    sm4_crypt_blocks_rk(rk_rev, input, output, nblocks);
+    memset(rk_rev, 0, sizeof(rk_rev));
+}
+
+/* 位切片多块加密 */
+void sm4_bitslice_encrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                                 size_t nblocks)
+{
+    sm4_bs_crypt_blocks_rk(ctx->rk, input, output, nblocks);
+}
+
+/* 位切片多块解密 */
+void sm4_bitslice_decrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                                 size_t nblocks)
+{
+    uint32_t rk_rev[SM4_NUM_ROUNDS];
+
+    sm4_reverse_rk(ctx, rk_rev);
+    sm4_bs_crypt_blocks_rk(rk_rev, input, output, nblocks);
+    memset(rk_rev, 0, sizeof(rk_rev));
+}
+
+/*
+ * 清理栈: 块内核不再逐块清零中间状态，可能溢出到栈上的轮状态
+ * 由各模式在调用结束时统一覆盖一次
+ */
+#define SM4_BURN_STACK_SIZE 2048
+
+/* 通过volatile函数指针调用memset，避免被编译器当作死存储消除 */
+static void *(*const volatile sm4_memset)(void *, int, size_t) = memset;
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void sm4_burn_stack(void)
+{
+    uint8_t buf[SM4_BURN_STACK_SIZE];
+
+    sm4_memset(buf, 0, sizeof(buf));
+}
+
+/*
+ * 大数据流式路径: 输出只写一次、本次调用内不再读取，用非临时存储(movntdq)
+ * 绕过缓存写出，避免挤出轮密钥、GHASH表等热数据；同时软件预取下一批输入
+ */
+#define SM4_STREAM_THRESHOLD_DEFAULT (1024 * 1024)
+
+static size_t sm4_stream_min = SM4_STREAM_THRESHOLD_DEFAULT;
+
+void sm4_set_stream_threshold(size_t bytes)
+{
+    sm4_stream_min = bytes;
+}
+
+size_t sm4_stream_threshold(void)
+{
+    return sm4_stream_min;
+}
+
+#ifdef SM4_HAVE_X86_SIMD
+/* out = a ^ b (b为NULL时out = a)，先逐字节对齐out到16字节再非临时存储 */
+static void sm4_stream_out(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t n)
+{
+    size_t head = (size_t)(-(uintptr_t)out) & 15;
+    size_t i;
+
+    if (head > n) {
+        head = n;
+    }
+    for (i = 0; i < head; i++) {
+        out[i] = b ? (uint8_t)(a[i] ^ b[i]) : a[i];
+    }
+
+    if (b) {
+        for (; n - i >= 64; i += 64) {
+            __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+                                       _mm_loadu_si128((const __m128i *)(b + i)));
+            __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 16)),
+                                       _mm_loadu_si128((const __m128i *)(b + i + 16)));
+            __m128i x2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 32)),
+                                       _mm_loadu_si128((const __m128i *)(b + i + 32)));
+            __m128i x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i + 48)),
+                                       _mm_loadu_si128((const __m128i *)(b + i + 48)));
+
+            _mm_stream_si128((__m128i *)(out + i), x0);
+            _mm_stream_si128((__m128i *)(out + i + 16), x1);
+            _mm_stream_si128((__m128i *)(out + i + 32), x2);
+            _mm_stream_si128((__m128i *)(out + i + 48), x3);
+        }
+    } else {
+        for (; n - i >= 64; i += 64) {
+            _mm_stream_si128((__m128i *)(out + i), _mm_loadu_si128((const __m128i *)(a + i)));
+            _mm_stream_si128((__m128i *)(out + i + 16), _mm_loadu_si128((const __m128i *)(a + i + 16)));
+            _mm_stream_si128((__m128i *)(out + i + 32), _mm_loadu_si128((const __m128i *)(a + i + 32)));
+            _mm_stream_si128((__m128i *)(out + i + 48), _mm_loadu_si128((const __m128i *)(a + i + 48)));
+        }
+    }
+
+    for (; i < n; i++) {
+        out[i] = b ? (uint8_t)(a[i] ^ b[i]) : a[i];
+    }
+}
+
+struct sm4_store_stream {
+    static const bool streaming = true;
+
+    template <size_t N>
+    static void xor_block(uint8_t *out, const uint8_t *a, const uint8_t *b) { sm4_stream_out(out, a, b, N); }
+    static void xor_out(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t n) { sm4_stream_out(out, a, b, n); }
+    static void copy_out(uint8_t *out, const uint8_t *src, size_t n) { sm4_stream_out(out, src, NULL, n); }
+
+    static void prefetch(const uint8_t *p, size_t n)
+    {
+        size_t i;
+
+        for (i = 0; i < n; i += 64) {
+            _mm_prefetch((const char *)(p + i), _MM_HINT_T0);
+        }
+    }
+
+    /* 非临时存储是弱序的，返回前用sfence保证对后续读写可见 */
+    static void finish() { _mm_sfence(); }
+};
+#else
+typedef sm4::store_cached sm4_store_stream;
+#endif
+
+/* ECB模式加密 */
+int sm4_ecb_encrypt(const uint8_t *key, const uint8_t *input, size_t input_len,
+                    uint8_t *output, size_t *output_len)
+{
+    int ret;
+
+    if (input_len >= sm4_stream_min) {
+        ret = sm4::ecb<sm4::ENCRYPT, sm4_store_stream>::run(key, input, input_len, output, output_len);
+    } else {
+        ret = sm4::ecb<sm4::ENCRYPT>::run(key, input, input_len, output, output_len);
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* ECB模式解密 */
+int sm4_ecb_decrypt(const uint8_t *key, const uint8_t *input, size_t input_len,
+                    uint8_t *output, size_t *output_len)
+{
+    int ret;
+
+    if (input_len >= sm4_stream_min) {
+        ret = sm4::ecb<sm4::DECRYPT, sm4_store_stream>::run(key, input, input_len, output, output_len);
+    } else {
+        ret = sm4::ecb<sm4::DECRYPT>::run(key, input, input_len, output, output_len);
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/*
+ * 多密钥多消息ECB: 每条消息占一个SIMD通道，各通道按SoA布局读取自己的轮密钥，
+ * 第b次迭代处理组内所有消息的第b个分组，较短消息的空闲通道以零块填充
+ * decrypt为0时加密(边取分组边做PKCS7填充)，为1时解密(输出未去填充)
+ */
+static void sm4_ecb_multi_group(const sm4_kernel_desc *k, const uint8_t *const *keys,
+                                const uint8_t *const *inputs, const size_t *input_lens,
+                                uint8_t *const *outputs, int decrypt)
+{
+    uint32_t rk_soa[SM4_NUM_ROUNDS * SM4_MULTI_KEY_LANES];
+    uint8_t buf[SM4_MULTI_KEY_LANES * SM4_BLOCK_SIZE];
+    size_t nblocks[SM4_MULTI_KEY_LANES];
+    size_t lanes = k->blocks;
+    size_t max_blocks = 0;
+    size_t b, i, j;
+
+    k->expand(keys, rk_soa);
+
+    /* 解密: 各通道轮密钥逆序 */
+    if (decrypt) {
+        for (i = 0; i < SM4_NUM_ROUNDS / 2; i++) {
+            for (j = 0; j < lanes; j++) {
+                uint32_t t = rk_soa[i * lanes + j];
+                rk_soa[i * lanes + j] = rk_soa[(SM4_NUM_ROUNDS - 1 - i) * lanes + j];
+                rk_soa[(SM4_NUM_ROUNDS - 1 - i) * lanes + j] = t;
+            }
+        }
+    }
+
+    for (j = 0; j < lanes; j++) {
+        nblocks[j] = input_lens[j] / SM4_BLOCK_SIZE + (decrypt ? 0 : 1);
+        if (nblocks[j] > max_blocks) {
+            max_blocks = nblocks[j];
+        }
+    }
+
+    for (b = 0; b < max_blocks; b++) {
+        for (j = 0; j < lanes; j++) {
+            uint8_t *block = buf + j * SM4_BLOCK_SIZE;
+
+            if (b >= nblocks[j]) {
+                memset(block, 0, SM4_BLOCK_SIZE);
+            } else if (decrypt) {
+                memcpy(block, inputs[j] + b * SM4_BLOCK_SIZE, SM4_BLOCK_SIZE);
+            } else {
+                sm4::pkcs7::block(inputs[j], input_lens[j], b, block);
+            }
+        }
+
+        k->crypt_mk(rk_soa, buf, buf);
+
+        for (j = 0; j < lanes; j++) {
+            if (b < nblocks[j]) {
+                memcpy(outputs[j] + b * SM4_BLOCK_SIZE, buf + j * SM4_BLOCK_SIZE, SM4_BLOCK_SIZE);
+            }
+        }
+    }
+
+    memset(rk_soa, 0, sizeof(rk_soa));
+    memset(buf, 0, sizeof(buf));
+}
+
+/* 多密钥多消息ECB参数检查 */
+static int sm4_ecb_multi_check(const uint8_t *const *keys, const uint8_t *const *inputs,
+                               const size_t *input_lens, uint8_t *const *outputs,
+                               size_t *output_lens, size_t n, int decrypt)
+{
+    size_t i;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (!keys || !inputs || !input_lens || !outputs || !output_lens) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!keys[i] || !inputs[i] || !outputs[i]) {
+            return -1;
+        }
+        if (decrypt) {
+            if (input_lens[i] == 0 || input_lens[i] % SM4_BLOCK_SIZE != 0) {
+                return -1;
+            }
+        } else if (input_lens[i] > (SIZE_MAX - SM4_BLOCK_SIZE)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * 不足一组的剩余消息(没有多密钥内核时即全部消息): 每次取至多SM4_MULTI_KEY_LANES个密钥
+ * 经sm4_setkey_multi扩展，再逐条用各自的上下文处理；整批只在入口函数返回前清理一次栈
+ */
+static int sm4_ecb_multi_rest(const uint8_t *const *keys, const uint8_t *const *inputs,
+                              const size_t *input_lens, uint8_t *const *outputs,
+                              size_t *output_lens, size_t n, int decrypt)
+{
+    sm4_context ctx[SM4_MULTI_KEY_LANES];
+    uint8_t last[SM4_BLOCK_SIZE];
+    size_t i, j, m;
+    int ret = 0;
+
+    for (i = 0; i < n; i += m) {
+        m = n - i < SM4_MULTI_KEY_LANES ? n - i : SM4_MULTI_KEY_LANES;
+        sm4_setkey_multi(ctx, keys + i, m);
+
+        for (j = i; j < i + m; j++) {
+            sm4_context *c = &ctx[j - i];
+
+            if (input_lens[j] >= sm4_stream_min) {
+                /* 大消息仍走单密钥流式路径 */
+                if (decrypt) {
+                    ret |= sm4::ecb<sm4::DECRYPT, sm4_store_stream>::run(keys[j], inputs[j], input_lens[j],
+                                                                        outputs[j], &output_lens[j]);
+                } else {
+                    ret |= sm4::ecb<sm4::ENCRYPT, sm4_store_stream>::run(keys[j], inputs[j], input_lens[j],
+                                                                        outputs[j], &output_lens[j]);
+                }
+            } else if (decrypt) {
+                sm4_decrypt_blocks(c, inputs[j], outputs[j], input_lens[j] / SM4_BLOCK_SIZE);
+                ret |= sm4::pkcs7::unpad(outputs[j], input_lens[j], &output_lens[j]);
+            } else {
+                size_t full = input_lens[j] / SM4_BLOCK_SIZE;
+
+                sm4_crypt_blocks(c, inputs[j], outputs[j], full);
+                sm4::pkcs7::block(inputs[j], input_lens[j], full, last);
+                sm4_crypt_block(c, last, outputs[j] + full * SM4_BLOCK_SIZE);
+                output_lens[j] = (full + 1) * SM4_BLOCK_SIZE;
+            }
+            sm4_context_clean(c);
+        }
+    }
+
+    memset(last, 0, sizeof(last));
+    return ret != 0 ? -1 : 0;
+}
+
+/* 多密钥多消息ECB加密 */
+int sm4_ecb_encrypt_multi(const uint8_t *const *keys, const uint8_t *const *inputs,
+                          const size_t *input_lens, uint8_t *const *outputs,
+                          size_t *output_lens, size_t n)
+{
+    const sm4_kernel_desc *const *k;
+    size_t i = 0, j;
+    int ret;
+
+    if (sm4_ecb_multi_check(keys, inputs, input_lens, outputs, output_lens, n, 0) != 0) {
+        return -1;
+    }
+    sm4_init();
+
+    /* 按分派表中支持多密钥的内核分组，剩余消息逐条处理 */
+    for (k = sm4_active; *k != NULL && i < n; k++) {
+        size_t lanes = (*k)->blocks;
+
+        if ((*k)->crypt_mk == NULL) {
+            continue;
+        }
+        for (; n - i >= lanes; i += lanes) {
+            sm4_ecb_multi_group(*k, keys + i, inputs + i, input_lens + i, outputs + i, 0);
+            for (j = i; j < i + lanes; j++) {
+                output_lens[j] = input_lens[j] + SM4_BLOCK_SIZE - (input_lens[j] % SM4_BLOCK_SIZE);
+            }
+        }
+    }
+
+    ret = sm4_ecb_multi_rest(keys + i, inputs + i, input_lens + i, outputs + i, output_lens + i,
+                             n - i, 0);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 多密钥多消息ECB解密 */
+int sm4_ecb_decrypt_multi(const uint8_t *const *keys, const uint8_t *const *inputs,
+                          const size_t *input_lens, uint8_t *const *outputs,
+                          size_t *output_lens, size_t n)
+{
+    const sm4_kernel_desc *const *k;
+    size_t i = 0, j;
+    int ret = 0;
+
+    if (sm4_ecb_multi_check(keys, inputs, input_lens, outputs, output_lens, n, 1) != 0) {
+        return -1;
+    }
+    sm4_init();
+
+    for (k = sm4_active; *k != NULL && i < n; k++) {
+        size_t lanes = (*k)->blocks;
+
+        if ((*k)->crypt_mk == NULL) {
+            continue;
+        }
+        for (; n - i >= lanes; i += lanes) {
+            sm4_ecb_multi_group(*k, keys + i, inputs + i, input_lens + i, outputs + i, 1);
+            for (j = i; j < i + lanes; j++) {
+                if (sm4::pkcs7::unpad(outputs[j], input_lens[j], &output_lens[j]) != 0) {
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (sm4_ecb_multi_rest(keys + i, inputs + i, input_lens + i, outputs + i, output_lens + i,
+                           n - i, 1) != 0) {
+        ret = -1;
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* CBC模式加密 */
+int sm4_cbc_encrypt(const uint8_t *key, const uint8_t *iv,
+                    const uint8_t *input, size_t input_len,
+                    uint8_t *output, size_t *output_len)
+{
+    int ret = sm4::cbc<sm4::ENCRYPT>::run(key, iv, input, input_len, output, output_len);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* CBC模式解密 */
+int sm4_cbc_decrypt(const uint8_t *key, const uint8_t *iv,
+                    const uint8_t *input, size_t input_len,
+                    uint8_t *output, size_t *output_len)
+{
+    int ret = sm4::cbc<sm4::DECRYPT>::run(key, iv, input, input_len, output, output_len);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 流式CBC初始化 */
+int sm4_cbc_init(sm4_cbc_ctx *ctx, const uint8_t *key, const uint8_t *iv, int decrypt)
+{
+    return sm4::cbc_stream<>::init(ctx, key, iv, decrypt);
+}
+
+/* 流式CBC处理一段数据 */
+int sm4_cbc_update(sm4_cbc_ctx *ctx, const uint8_t *input, size_t input_len,
+                   uint8_t *output, size_t *output_len)
+{
+    int ret = sm4::cbc_stream<>::update(ctx, input, input_len, output, output_len);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 流式CBC结束 */
+int sm4_cbc_final(sm4_cbc_ctx *ctx, uint8_t *output, size_t *output_len)
+{
+    int ret = sm4::cbc_stream<>::final(ctx, output, output_len);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 多消息CBC加密 */
+int sm4_cbc_encrypt_multi(const uint8_t *key, const uint8_t *const *ivs,
+                          const uint8_t *const *inputs, const size_t *input_lens,
+                          uint8_t *const *outputs, size_t *output_lens, size_t n)
+{
+    int ret = sm4::cbc_multi<>::run(key, ivs, inputs, input_lens, outputs, output_lens, n);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* SM4-CTR模式加解密(支持从任意字节偏移开始) */
+int sm4_ctr_crypt(const uint8_t *key, const uint8_t *iv, uint64_t offset,
+                  const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    sm4_context ctx;
+
+    if (!key || !iv || (!input && input_len > 0) || (!output && input_len > 0)) {
+        return -1;
+    }
+
+    sm4_setkey(&ctx, key);
+    if (input_len >= sm4_stream_min) {
+        sm4::ctr<sm4::inc128, sm4::BATCH_BLOCKS, sm4_store_stream>::xor_at(&ctx, iv, offset, input,
+                                                                           input_len, output);
+    } else {
+        sm4::ctr<sm4::inc128>::xor_at(&ctx, iv, offset, input, input_len, output);
+    }
+
+    sm4_context_clean(&ctx);
+    sm4_burn_stack();
+    return 0;
+}
+
+#ifdef SM4_HAVE_X86_SIMD
+/*
+ * XTS tweak倍乘(SSE2): 整个128位tweak在一个寄存器中，两个64位通道各左移1位，
+ * 低通道移出的最高位补到高通道最低位，高通道移出的最高位折回为0x87；
+ * 用算术右移取符号位作为掩码，无分支、不需要逐字节进位
+ */
+__attribute__((target("sse2")))
+static inline __m128i sm4_xts_double(__m128i t)
+{
+    const __m128i poly = _mm_set_epi32(0, 1, 0, 0x87);
+    __m128i carry = _mm_and_si128(_mm_shuffle_epi32(_mm_srai_epi32(t, 31), 0x13), poly);
+
+    return _mm_xor_si128(_mm_add_epi64(t, t), carry);
+}
+
+/*
+ * t·α^4: 两个通道各左移4位，低通道移出的4位补到高通道，高通道移出的4位r
+ * 乘以0x87(= x^7 + x^2 + x + 1)折回低通道，即异或r、r<<1、r<<2、r<<7
+ */
+__attribute__((target("sse2")))
+static inline __m128i sm4_xts_mul_a4(__m128i t)
+{
+    const __m128i lo_lane = _mm_set_epi32(0, 0, -1, -1);
+    __m128i c = _mm_shuffle_epi32(_mm_srli_epi64(t, 60), 0x4e);
+    __m128i r = _mm_and_si128(c, lo_lane);
+
+    t = _mm_xor_si128(_mm_slli_epi64(t, 4), c);
+    t = _mm_xor_si128(t, _mm_slli_epi64(r, 1));
+    t = _mm_xor_si128(t, _mm_slli_epi64(r, 2));
+    return _mm_xor_si128(t, _mm_slli_epi64(r, 7));
+}
+
+/*
+ * 逐块倍乘是一条串行依赖链，每块要等上一块的结果；这里同时维护
+ * t、t·α、t·α^2、t·α^3四条链，每条每次乘α^4，四条链互不依赖
+ */
+__attribute__((target("sse2")))
+static void sm4_xts_whiten_sse2(uint8_t *t, uint8_t *tweaks, const uint8_t *in, uint8_t *out,
+                                size_t n)
+{
+    __m128i x[4];
+    size_t j = 0;
+    int k;
+
+    x[0] = _mm_loadu_si128((const __m128i *)t);
+    for (k = 1; k < 4; k++) {
+        x[k] = sm4_xts_double(x[k - 1]);
+    }
+
+    for (; j + 4 <= n; j += 4) {
+        for (k = 0; k < 4; k++) {
+            const uint8_t *src = in + (j + k) * SM4_BLOCK_SIZE;
+
+            _mm_storeu_si128((__m128i *)(tweaks + (j + k) * SM4_BLOCK_SIZE), x[k]);
+            _mm_storeu_si128((__m128i *)(out + (j + k) * SM4_BLOCK_SIZE),
+                             _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), x[k]));
+            x[k] = sm4_xts_mul_a4(x[k]);
+        }
+    }
+    for (k = 0; j < n; j++, k++) {
+        _mm_storeu_si128((__m128i *)(tweaks + j * SM4_BLOCK_SIZE), x[k]);
+        _mm_storeu_si128((__m128i *)(out + j * SM4_BLOCK_SIZE),
+                         _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + j * SM4_BLOCK_SIZE)),
+                                       x[k]));
+    }
+
+    /* 下一个未使用的tweak */
+    _mm_storeu_si128((__m128i *)t, x[k]);
+}
+
+struct sm4_xts_tweak {
+    static void next(uint8_t *t) { sm4::xts_tweak::next(t); }
+    static void whiten(uint8_t *t, uint8_t *tweaks, const uint8_t *in, uint8_t *out, size_t n)
+    {
+        sm4_xts_whiten_sse2(t, tweaks, in, out, n);
+    }
+};
+#else
+typedef sm4::xts_tweak sm4_xts_tweak;
+#endif
+
+/* XTS上下文初始化: K1按方向扩展，K2始终为加密方向；两半密钥相同时拒绝 */
+int sm4_xts_setkey(sm4_xts_context *ctx, const uint8_t *key, int decrypt)
+{
+    uint8_t diff = 0;
+    int i;
+
+    if (!ctx || !key) {
+        return -1;
+    }
+    for (i = 0; i < SM4_KEY_SIZE; i++) {
+        diff |= key[i] ^ key[SM4_KEY_SIZE + i];
+    }
+    if (diff == 0) {
+        return -1;
+    }
+
+    if (decrypt) {
+        sm4_setkey_dec(&ctx->data, key);
+    } else {
+        sm4_setkey(&ctx->data, key);
+    }
+    sm4_setkey(&ctx->tweak, key + SM4_KEY_SIZE);
+    ctx->decrypt = decrypt ? 1 : 0;
+    return 0;
+}
+
+void sm4_xts_context_clean(sm4_xts_context *ctx)
+{
+    if (ctx) {
+        sm4_context_clean(&ctx->data);
+        sm4_context_clean(&ctx->tweak);
+        ctx->decrypt = 0;
+    }
+}
+
+/* 按上下文方向处理一个数据单元 */
+int sm4_xts_crypt(const sm4_xts_context *ctx, uint64_t sector,
+                  const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    int ret;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    if (input_len >= sm4_stream_min) {
+        if (ctx->decrypt) {
+            ret = sm4::xts<sm4::DECRYPT, sm4_xts_tweak, sm4::BATCH_BLOCKS, sm4_store_stream>::run(
+                &ctx->data, &ctx->tweak, sector, input, input_len, output);
+        } else {
+            ret = sm4::xts<sm4::ENCRYPT, sm4_xts_tweak, sm4::BATCH_BLOCKS, sm4_store_stream>::run(
+                &ctx->data, &ctx->tweak, sector, input, input_len, output);
+        }
+    } else {
+        if (ctx->decrypt) {
+            ret = sm4::xts<sm4::DECRYPT, sm4_xts_tweak>::run(&ctx->data, &ctx->tweak, sector,
+                                                             input, input_len, output);
+        } else {
+            ret = sm4::xts<sm4::ENCRYPT, sm4_xts_tweak>::run(&ctx->data, &ctx->tweak, sector,
+                                                             input, input_len, output);
+        }
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+static int sm4_xts_oneshot(const uint8_t *key, int decrypt, uint64_t sector,
+                           const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    sm4_xts_context ctx;
+    int ret;
+
+    if (sm4_xts_setkey(&ctx, key, decrypt) != 0) {
+        return -1;
+    }
+    ret = sm4_xts_crypt(&ctx, sector, input, input_len, output);
+    sm4_xts_context_clean(&ctx);
+    return ret;
+}
+
+/* SM4-XTS加密一个数据单元 */
+int sm4_xts_encrypt(const uint8_t *key, uint64_t sector,
+                    const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    return sm4_xts_oneshot(key, 0, sector, input, input_len, output);
+}
+
+/* SM4-XTS解密一个数据单元 */
+int sm4_xts_decrypt(const uint8_t *key, uint64_t sector,
+                    const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    return sm4_xts_oneshot(key, 1, sector, input, input_len, output);
+}
+
+/*
+ * GHASH: Shoup 4位查表法
+ * 每个H预计算16项表 M[n] = n·H (n为4位，按GCM位序)，乘法按半字节从末字节
+ * 向前处理: 每步Z右移4位，移出的低4位经rem_4bit归约后折回高位，再异或M[n]。
+ * 表只有256字节，每个分组32次查表，代替逐位算法的128次移位与条件异或。
+ */
+static const uint64_t rem_4bit[16] = {
+    0x0000ULL << 48, 0x1C20ULL << 48, 0x3840ULL << 48, 0x2460ULL << 48,
+    0x7080ULL << 48, 0x6CA0ULL << 48, 0x48C0ULL << 48, 0x54E0ULL << 48,
+    0xE100ULL << 48, 0xFD20ULL << 48, 0xD940ULL << 48, 0xC560ULL << 48,
+    0x9180ULL << 48, 0x8DA0ULL << 48, 0xA9C0ULL << 48, 0xB5E0ULL << 48
+};
+
+static uint64_t load_be64(const uint8_t *p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) |
+           ((uint64_t)p[3] << 32) | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+           ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static void store_be64(uint8_t *p, uint64_t v)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
 
-    /* Tag = MSB(GCTR(K, J0, S)) */
-    gctr(&ctx, j0, s, 16, tag);
+struct sm4_ghash_4bit {
+    struct key {
+        uint64_t hi[16];
+        uint64_t lo[16];
+    };
 
-    /* 清零敏感数据 */
-    sm4_context_clean(&ctx);
-    memset(h, 0, sizeof(h));
-    memset(j0, 0, sizeof(j0));
-    memset(s, 0, sizeof(s));
-    free(ghash_input);
-    return 0;
+    /* M[8] = H, M[4] = H·x, M[2] = H·x^2, M[1] = H·x^3，其余项由线性组合得到 */
+    static void init(key *k, const uint8_t *h)
+    {
+        uint64_t vh = load_be64(h);
+        uint64_t vl = load_be64(h + 8);
+        uint64_t r;
+        int i, j;
+
+        k->hi[0] = k->lo[0] = 0;
+        for (i = 8; i > 0; i >>= 1) {
+            k->hi[i] = vh;
+            k->lo[i] = vl;
+            /* V = V·x: GCM位序下右移1位，移出位为1时异或R */
+            r = 0xe100000000000000ULL & (0 - (vl & 1));
+            vl = (vh << 63) | (vl >> 1);
+            vh = (vh >> 1) ^ r;
+        }
+        for (i = 2; i < 16; i <<= 1) {
+            for (j = 1; j < i; j++) {
+                k->hi[i + j] = k->hi[i] ^ k->hi[j];
+                k->lo[i + j] = k->lo[i] ^ k->lo[j];
+            }
+        }
+    }
+
+    /* x = x * H */
+    static void mul(uint8_t *x, const key *k)
+    {
+        uint64_t zh, zl;
+        unsigned rem, nlo, nhi;
+        int i = 15;
+
+        nlo = x[15] & 0x0f;
+        nhi = x[15] >> 4;
+        zh = k->hi[nlo];
+        zl = k->lo[nlo];
+
+        for (;;) {
+            rem = (unsigned)zl & 0x0f;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ rem_4bit[rem];
+            zh ^= k->hi[nhi];
+            zl ^= k->lo[nhi];
+
+            if (--i < 0) {
+                break;
+            }
+
+            nlo = x[i] & 0x0f;
+            nhi = x[i] >> 4;
+            rem = (unsigned)zl & 0x0f;
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ rem_4bit[rem];
+            zh ^= k->hi[nlo];
+            zl ^= k->lo[nlo];
+        }
+
+        store_be64(x, zh);
+        store_be64(x + 8, zl);
+    }
+
+    /* 对每个分组 x = (x ^ block) * H，末尾不足16字节补零 */
+    static void update(const key *k, uint8_t *x, const uint8_t *data, size_t data_len)
+    {
+        size_t i;
+
+        for (i = 0; i + 16 <= data_len; i += 16) {
+            sm4::xor_n<16>(x, x, data + i);
+            mul(x, k);
+        }
+        if (i < data_len) {
+            sm4::xor_bytes(x, x, data + i, data_len - i);
+            mul(x, k);
+        }
+    }
+};
+
+#ifdef SM4_HAVE_X86_SIMD
+/*
+ * GHASH: PCLMULQDQ无进位乘法
+ * 分组整体字节反序后在反射位序下做128x128位无进位乘法，乘积左移1位再按
+ * x^128 + x^7 + x^2 + x + 1约减(Intel GCM白皮书算法)。
+ * 聚合约减: 每8个分组 Y = (Y ^ X1)·H^8 ^ X2·H^7 ^ ... ^ X8·H，
+ * 8个未约减乘积先异或累加，只做一次移位与约减，乘法之间没有串行依赖。
+ */
+static const uint8_t SM4_BSWAP128[16] __attribute__((aligned(16))) = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+};
+
+/* 累加a·b的未约减乘积(schoolbook): lo、hi为低/高64位相乘，mid为交叉项 */
+__attribute__((target("ssse3,pclmul")))
+static inline void sm4_clmul_acc(__m128i a, __m128i b, __m128i *lo, __m128i *mid, __m128i *hi)
+{
+    *lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(a, b, 0x00));
+    *hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(a, b, 0x11));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x01));
+    *mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(a, b, 0x10));
 }
 
-/* SM4 GCM模式解密 */
-int sm4_gcm_decrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
-                    const uint8_t *aad, size_t aad_len,
-                    const uint8_t *input, size_t input_len,
-                    const uint8_t *tag, uint8_t *output)
+/* 合并交叉项，256位乘积左移1位并约减为128位 */
+__attribute__((target("ssse3,pclmul")))
+static inline __m128i sm4_clmul_reduce(__m128i lo, __m128i mid, __m128i hi)
 {
-    sm4_context ctx;
-    uint8_t h[16] = {0};
-    uint8_t j0[16];
-    uint8_t *ghash_input = NULL;
-    size_t ghash_buf_size;
-    size_t ghash_len = 0;
-    uint64_t aad_bits, input_bits;
-    uint8_t s[16];
-    uint8_t computed_tag[16];
+    __m128i t2, t4, t5, t7, t8, t9;
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    /* 反射位序下的乘积比实际少一位，整体左移1位 */
+    t7 = _mm_srli_epi32(lo, 31);
+    t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(hi, t8);
+    hi = _mm_or_si128(hi, t9);
+
+    /* 第一步: 低128位乘以x^63 + x^62 + x^57后折叠 */
+    t7 = _mm_slli_epi32(lo, 31);
+    t8 = _mm_slli_epi32(lo, 30);
+    t9 = _mm_slli_epi32(lo, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    lo = _mm_xor_si128(lo, t7);
+
+    /* 第二步: 右移1、2、7位并合并到高128位 */
+    t2 = _mm_srli_epi32(lo, 1);
+    t4 = _mm_srli_epi32(lo, 2);
+    t5 = _mm_srli_epi32(lo, 7);
+    t2 = _mm_xor_si128(t2, t4);
+    t2 = _mm_xor_si128(t2, t5);
+    t2 = _mm_xor_si128(t2, t8);
+    lo = _mm_xor_si128(lo, t2);
+    return _mm_xor_si128(hi, lo);
+}
+
+/* 预计算hpow[i] = H^(8-i)，i = 0..7，均为字节反序形式 */
+__attribute__((target("ssse3,pclmul")))
+static void sm4_ghash_pclmul_init(uint8_t (*hpow)[16], const uint8_t *h)
+{
+    const __m128i bswap = SM4_M128(SM4_BSWAP128);
+    __m128i hk = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)h), bswap);
+    __m128i p = hk;
     int i;
 
-    if (!key || !iv || !input || !tag || !output) {
-        return -1;
+    _mm_storeu_si128((__m128i *)hpow[7], hk);
+    for (i = 6; i >= 0; i--) {
+        __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+
+        sm4_clmul_acc(p, hk, &lo, &mid, &hi);
+        p = sm4_clmul_reduce(lo, mid, hi);
+        _mm_storeu_si128((__m128i *)hpow[i], p);
     }
+}
 
-    /* 动态分配 GHASH 输入缓冲区 */
-    ghash_buf_size = ((aad_len + 15) / 16) * 16 + ((input_len + 15) / 16) * 16 + 16;
-    ghash_input = (uint8_t *)malloc(ghash_buf_size);
-    if (!ghash_input) {
-        return -1;
+/* 处理nblocks个完整分组，每组至多8个分组聚合约减 */
+__attribute__((target("ssse3,pclmul")))
+static void sm4_ghash_pclmul_blocks(const uint8_t (*hpow)[16], uint8_t *x,
+                                    const uint8_t *data, size_t nblocks)
+{
+    const __m128i bswap = SM4_M128(SM4_BSWAP128);
+    __m128i y = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)x), bswap);
+
+    while (nblocks > 0) {
+        size_t n = nblocks < 8 ? nblocks : 8;
+        const uint8_t (*hp)[16] = hpow + 8 - n;
+        __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), bswap);
+
+            if (i == 0) {
+                b = _mm_xor_si128(b, y);
+            }
+            sm4_clmul_acc(b, _mm_loadu_si128((const __m128i *)hp[i]), &lo, &mid, &hi);
+        }
+        y = sm4_clmul_reduce(lo, mid, hi);
+        data += n * 16;
+        nblocks -= n;
     }
 
-    /* 设置密钥 */
-    sm4_setkey(&ctx, key);
+    _mm_storeu_si128((__m128i *)x, _mm_shuffle_epi8(y, bswap));
+}
 
-    /* 计算H = E(K, 0^128) */
-    sm4_encrypt_block(&ctx, h, h);
+/* GCC 12的avx512fintrin.h内部使用自初始化的未定义值，会误报-Wuninitialized */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 
-    /* 计算J0 */
-    if (iv_len == 12) {
-        memcpy(j0, iv, 12);
-        j0[12] = j0[13] = j0[14] = 0;
-        j0[15] = 1;
-    } else {
-        uint8_t len_block[16] = {0};
-        uint64_t iv_bits = (uint64_t)iv_len * 8;
-        int j;
+/* 512位寄存器的4个128位通道异或为一个 */
+__attribute__((target("avx512f")))
+static inline __m128i sm4_xor_lanes512(__m512i v)
+{
+    v = _mm512_xor_si512(v, _mm512_shuffle_i64x2(v, v, 0x4e));
+    v = _mm512_xor_si512(v, _mm512_shuffle_i64x2(v, v, 0xb1));
+    return _mm512_castsi512_si128(v);
+}
+
+/* VPCLMULQDQ: 每次8个分组放入两个512位寄存器，与[H^8..H^5]、[H^4..H^1]逐通道相乘 */
+__attribute__((target("avx512f,avx512bw,vpclmulqdq,ssse3,pclmul")))
+static void sm4_ghash_vpclmul_blocks(const uint8_t (*hpow)[16], uint8_t *x,
+                                     const uint8_t *data, size_t nblocks)
+{
+    const __m512i bswap = _mm512_broadcast_i32x4(SM4_M128(SM4_BSWAP128));
+    const __m512i ha = _mm512_loadu_si512((const void *)hpow[0]);
+    const __m512i hb = _mm512_loadu_si512((const void *)hpow[4]);
+    __m128i y = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)x), SM4_M128(SM4_BSWAP128));
+
+    for (; nblocks >= 8; nblocks -= 8, data += 128) {
+        __m512i a = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)data), bswap);
+        __m512i b = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(data + 64)), bswap);
+        __m512i lo, mid, hi;
+
+        a = _mm512_xor_si512(a, _mm512_inserti32x4(_mm512_setzero_si512(), y, 0));
+        lo = _mm512_xor_si512(_mm512_clmulepi64_epi128(a, ha, 0x00),
+                              _mm512_clmulepi64_epi128(b, hb, 0x00));
+        hi = _mm512_xor_si512(_mm512_clmulepi64_epi128(a, ha, 0x11),
+                              _mm512_clmulepi64_epi128(b, hb, 0x11));
+        mid = _mm512_xor_si512(_mm512_clmulepi64_epi128(a, ha, 0x01),
+                               _mm512_clmulepi64_epi128(a, ha, 0x10));
+        mid = _mm512_xor_si512(mid, _mm512_clmulepi64_epi128(b, hb, 0x01));
+        mid = _mm512_xor_si512(mid, _mm512_clmulepi64_epi128(b, hb, 0x10));
+        y = sm4_clmul_reduce(sm4_xor_lanes512(lo), sm4_xor_lanes512(mid), sm4_xor_lanes512(hi));
+    }
+    _mm_storeu_si128((__m128i *)x, _mm_shuffle_epi8(y, SM4_M128(SM4_BSWAP128)));
+
+    /* 不足8块的剩余部分 */
+    if (nblocks > 0) {
+        sm4_ghash_pclmul_blocks(hpow, x, data, nblocks);
+    }
+}
 
-        for (j = 0; j < 8; j++) {
-            len_block[15 - j] = (uint8_t)(iv_bits >> (j * 8));
+#pragma GCC diagnostic pop
+#endif
+
+/* GHASH实现，按优先级从高到低排列 */
+enum {
+    SM4_GHASH_TABLE4,
+    SM4_GHASH_PCLMUL,
+    SM4_GHASH_VPCLMUL_AVX512
+};
+
+typedef struct {
+    const char *name;
+    int impl;
+    int (*supported)(void);
+} sm4_ghash_desc;
+
+#ifdef SM4_HAVE_X86_SIMD
+static int sm4_cpu_has_vpclmul_avx512(void)
+{
+    return sm4_cpu_vpclmul_avx512;
+}
+
+static int sm4_cpu_has_pclmul(void)
+{
+    return sm4_cpu_pclmul;
+}
+#endif
+
+static const sm4_ghash_desc SM4_GHASH_IMPLS[] = {
+#ifdef SM4_HAVE_X86_SIMD
+    {"vpclmul-avx512", SM4_GHASH_VPCLMUL_AVX512, sm4_cpu_has_vpclmul_avx512},
+    {"pclmul", SM4_GHASH_PCLMUL, sm4_cpu_has_pclmul},
+#endif
+    {"table-4bit", SM4_GHASH_TABLE4, sm4_cpu_any},
+};
+
+#define SM4_NUM_GHASH_IMPLS (sizeof(SM4_GHASH_IMPLS) / sizeof(SM4_GHASH_IMPLS[0]))
+
+static const sm4_ghash_desc *sm4_ghash_active = &SM4_GHASH_IMPLS[SM4_NUM_GHASH_IMPLS - 1];
+
+/* GCM使用的GHASH策略: 构造密钥时记录当时选定的实现，之后按其分派 */
+struct sm4_ghash {
+    struct key {
+        int impl;
+        union {
+            sm4_ghash_4bit::key table;
+            uint8_t hpow[8][16];    /* H^8..H^1，字节反序 */
+        } u;
+    };
+
+    static void init_impl(key *k, const uint8_t *h, int impl)
+    {
+        k->impl = impl;
+#ifdef SM4_HAVE_X86_SIMD
+        if (impl != SM4_GHASH_TABLE4) {
+            sm4_ghash_pclmul_init(k->u.hpow, h);
+            return;
         }
+#endif
+        sm4_ghash_4bit::init(&k->u.table, h);
+    }
 
-        memset(j0, 0, 16);
-        ghash(h, iv, iv_len, j0);
+    static void init(key *k, const uint8_t *h)
+    {
+        init_impl(k, h, sm4_ghash_active->impl);
+    }
 
-        for (j = 0; j < 16; j++) {
-            j0[j] ^= len_block[j];
+    static void blocks(const key *k, uint8_t *x, const uint8_t *data, size_t nblocks)
+    {
+        switch (k->impl) {
+#ifdef SM4_HAVE_X86_SIMD
+        case SM4_GHASH_VPCLMUL_AVX512:
+            sm4_ghash_vpclmul_blocks(k->u.hpow, x, data, nblocks);
+            break;
+        case SM4_GHASH_PCLMUL:
+            sm4_ghash_pclmul_blocks(k->u.hpow, x, data, nblocks);
+            break;
+#endif
+        default:
+            sm4_ghash_4bit::update(&k->u.table, x, data, nblocks * 16);
+            break;
         }
-        gf128_mul(j0, h, j0);
     }
 
-    /* 构造GHASH输入用于验证 */
-    memset(ghash_input, 0, ghash_buf_size);
-    ghash_len = 0;
+    /* 对每个分组 x = (x ^ block) * H，末尾不足16字节补零 */
+    static void update(const key *k, uint8_t *x, const uint8_t *data, size_t data_len)
+    {
+        size_t full = data_len / 16 * 16;
 
-    /* 添加AAD */
-    if (aad && aad_len > 0) {
-        memcpy(ghash_input, aad, aad_len);
-        ghash_len = aad_len;
-        if (ghash_len % 16 != 0) {
-            ghash_len += 16 - (ghash_len % 16);
+        if (full > 0) {
+            blocks(k, x, data, full / 16);
+        }
+        if (full < data_len) {
+            uint8_t last[16] = {0};
+
+            memcpy(last, data + full, data_len - full);
+            blocks(k, x, last, 1);
         }
     }
 
-    /* 添加密文 */
-    memcpy(ghash_input + ghash_len, input, input_len);
-    ghash_len += input_len;
-    if (ghash_len % 16 != 0) {
-        ghash_len += 16 - (ghash_len % 16);
+    /* x = x * H */
+    static void mul(uint8_t *x, const key *k)
+    {
+        static const uint8_t zero[16] = {0};
+
+        blocks(k, x, zero, 1);
+    }
+};
+
+/* GHASH自检: 与4位查表结果比对，覆盖聚合组与不足8块的剩余部分 */
+static int sm4_ghash_selftest(const sm4_ghash_desc *g)
+{
+    uint8_t h[16], data[19 * 16 + 5];
+    uint8_t x[16] = {0}, ref[16] = {0};
+    sm4_ghash::key k, kt;
+    size_t i;
+
+    for (i = 0; i < sizeof(h); i++) {
+        h[i] = (uint8_t)(0x5a + 37 * i);
+    }
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 131 + 7);
     }
 
-    /* 添加长度字段 */
-    aad_bits = (uint64_t)aad_len * 8;
-    input_bits = (uint64_t)input_len * 8;
+    sm4_ghash::init_impl(&k, h, g->impl);
+    sm4_ghash::init_impl(&kt, h, SM4_GHASH_TABLE4);
+    sm4_ghash::update(&k, x, data, sizeof(data));
+    sm4_ghash::mul(x, &k);
+    sm4_ghash::update(&kt, ref, data, sizeof(data));
+    sm4_ghash::mul(ref, &kt);
 
-    for (i = 0; i < 8; i++) {
-        ghash_input[ghash_len + i] = (uint8_t)(aad_bits >> (56 - i * 8));
-        ghash_input[ghash_len + 8 + i] = (uint8_t)(input_bits >> (56 - i * 8));
+    return memcmp(x, ref, 16) == 0;
+}
+
+static int sm4_ghash_usable(const sm4_ghash_desc *g)
+{
+    return g->supported() && sm4_ghash_selftest(g);
+}
+
+static void sm4_select_ghash(void)
+{
+    size_t i;
+
+    for (i = 0; i < SM4_NUM_GHASH_IMPLS; i++) {
+        if (sm4_ghash_usable(&SM4_GHASH_IMPLS[i])) {
+            sm4_ghash_active = &SM4_GHASH_IMPLS[i];
+            return;
+        }
     }
-    ghash_len += 16;
+}
+
+/* 当前使用的GHASH实现名称 */
+const char *sm4_ghash_name(void)
+{
+    sm4_init();
+    return sm4_ghash_active->name;
+}
 
-    /* 计算S = GHASH(H, ghash_input) */
-    ghash(h, ghash_input, ghash_len, s);
+/* 强制指定GHASH实现，NULL或"auto"恢复自动选择 */
+int sm4_set_ghash(const char *name)
+{
+    size_t i;
 
-    /* 计算Tag */
-    gctr(&ctx, j0, s, 16, computed_tag);
+    sm4_init();
 
-    /* 常量时间验证Tag，防止时序侧信道攻击 (Feature-3) */
-    {
-        uint8_t diff = 0;
-        for (i = 0; i < 16; i++) {
-            diff |= computed_tag[i] ^ tag[i];
+    if (name == NULL || strcmp(name, "auto") == 0) {
+        sm4_select_ghash();
+        return 0;
+    }
+
+    for (i = 0; i < SM4_NUM_GHASH_IMPLS; i++) {
+        if (strcmp(name, SM4_GHASH_IMPLS[i].name) == 0) {
+            if (!sm4_ghash_usable(&SM4_GHASH_IMPLS[i])) {
+                return -1;
+            }
+            sm4_ghash_active = &SM4_GHASH_IMPLS[i];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/* SM4 GCM模式加密 */
+int sm4_gcm_encrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len,
+                    uint8_t *output, uint8_t *tag)
+{
+    int ret;
+
+    if (input_len >= sm4_stream_min) {
+        ret = sm4::gcm<sm4::ENCRYPT, sm4_ghash, sm4::BATCH_BLOCKS, sm4_store_stream>::run(
+            key, iv, iv_len, aad, aad_len, input, input_len, output, tag);
+    } else {
+        ret = sm4::gcm<sm4::ENCRYPT, sm4_ghash>::run(key, iv, iv_len, aad, aad_len,
+                                                             input, input_len, output, tag);
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* SM4 GCM模式解密 */
+int sm4_gcm_decrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len,
+                    const uint8_t *tag, uint8_t *output)
+{
+    int ret;
+
+    if (input_len >= sm4_stream_min) {
+        ret = sm4::gcm<sm4::DECRYPT, sm4_ghash, sm4::BATCH_BLOCKS, sm4_store_stream>::run(
+            key, iv, iv_len, aad, aad_len, input, input_len, tag, output);
+    } else {
+        ret = sm4::gcm<sm4::DECRYPT, sm4_ghash>::run(key, iv, iv_len, aad, aad_len,
+                                                             input, input_len, tag, output);
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+static_assert(sizeof(sm4_ghash::key) <= sizeof(((sm4_gcm_ctx *)0)->ghash_key),
+              "sm4_gcm_ctx::ghash_key is too small for the GHASH tables");
+
+/* 流式GCM初始化 */
+int sm4_gcm_init(sm4_gcm_ctx *ctx, const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                 int decrypt)
+{
+    int ret = sm4::gcm_stream<sm4_ghash>::init(ctx, key, iv, iv_len, decrypt);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 流式GCM输入附加认证数据 */
+int sm4_gcm_aad(sm4_gcm_ctx *ctx, const uint8_t *aad, size_t aad_len)
+{
+    int ret = sm4::gcm_stream<sm4_ghash>::aad(ctx, aad, aad_len);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 流式GCM处理一段数据 */
+int sm4_gcm_update(sm4_gcm_ctx *ctx, const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    int ret;
+
+    if (input_len >= sm4_stream_min) {
+        ret = sm4::gcm_stream<sm4_ghash, sm4::BATCH_BLOCKS, sm4_store_stream>::update(ctx, input,
+                                                                                   input_len, output);
+    } else {
+        ret = sm4::gcm_stream<sm4_ghash>::update(ctx, input, input_len, output);
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 流式GCM结束并输出Tag */
+int sm4_gcm_final(sm4_gcm_ctx *ctx, uint8_t *tag)
+{
+    int ret = sm4::gcm_stream<sm4_ghash>::final(ctx, tag);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* 流式GCM解密结束并验证Tag */
+int sm4_gcm_final_verify(sm4_gcm_ctx *ctx, const uint8_t *tag)
+{
+    int ret = sm4::gcm_stream<sm4_ghash>::final_verify(ctx, tag);
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/*
+ * 多线程GCM: 密文按分组边界切成nseg段，各线程从计算出的计数器偏移开始
+ * 做拼接的CTR+GHASH，得到每段从零开始的GHASH部分和S_i。GHASH是线性的，
+ * 整体累加值 S = (...((S_aad·H^n1 ^ S_1)·H^n2 ^ S_2)...)，n_i为第i段的分组数；
+ * 除最后一段外各段等长，只需预先计算H^n(段)与H^n(末段)两个幂。
+ */
+#define SM4_GCM_MT_MIN_SEGMENT (1024 * 1024)    /* 每段最少字节数，低于此值线程开销不划算 */
+#define SM4_GCM_MT_MAX_THREADS 64
+
+/* x = x * y，GCM位序的逐位乘法(常量时间)，只用于合并部分和，每次调用几十次 */
+static void sm4_gf128_mul(uint8_t *x, const uint8_t *y)
+{
+    uint64_t vh = load_be64(y), vl = load_be64(y + 8);
+    uint64_t zh = 0, zl = 0;
+    uint64_t mask;
+    int i;
+
+    for (i = 0; i < 128; i++) {
+        mask = 0 - (uint64_t)((x[i >> 3] >> (7 - (i & 7))) & 1);
+        zh ^= vh & mask;
+        zl ^= vl & mask;
+        mask = 0 - (vl & 1);
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ (0xe100000000000000ULL & mask);
+    }
+
+    store_be64(x, zh);
+    store_be64(x + 8, zl);
+}
+
+/* out = h^n，平方-乘法；n只取决于数据长度，无需常量时间 */
+static void sm4_gf128_pow(uint8_t *out, const uint8_t *h, uint64_t n)
+{
+    uint8_t base[16];
+
+    memcpy(base, h, 16);
+    memset(out, 0, 16);
+    out[0] = 0x80;  /* GCM位序下的1 */
+    while (n > 0) {
+        if (n & 1) {
+            sm4_gf128_mul(out, base);
+        }
+        sm4_gf128_mul(base, base);
+        n >>= 1;
+    }
+    memset(base, 0, sizeof(base));
+}
+
+/* 一个线程处理的段 */
+typedef struct {
+    const sm4_context *ctx;
+    const sm4_ghash::key *hk;
+    const uint8_t *input;
+    uint8_t *output;
+    size_t len;
+    uint8_t counter[16];    /* 本段第一个计数器块 */
+    uint8_t s[16];          /* 本段从零开始的GHASH部分和 */
+    int decrypt;
+} sm4_gcm_segment;
+
+static void *sm4_gcm_segment_run(void *arg)
+{
+    sm4_gcm_segment *seg = (sm4_gcm_segment *)arg;
+    typedef sm4::gcm_base<sm4_ghash> cached;
+    typedef sm4::gcm_base<sm4_ghash, sm4::BATCH_BLOCKS, sm4_store_stream> streamed;
+
+    memset(seg->s, 0, 16);
+    if (seg->len >= sm4_stream_min) {
+        if (seg->decrypt) {
+            streamed::crypt_hash<sm4::DECRYPT>(seg->ctx, seg->hk, seg->counter, seg->s,
+                                               seg->input, seg->len, seg->output);
+        } else {
+            streamed::crypt_hash<sm4::ENCRYPT>(seg->ctx, seg->hk, seg->counter, seg->s,
+                                               seg->input, seg->len, seg->output);
         }
-        if (diff != 0) {
-            sm4_context_clean(&ctx);
-            memset(h, 0, sizeof(h));
-            memset(j0, 0, sizeof(j0));
-            memset(s, 0, sizeof(s));
-            memset(computed_tag, 0, sizeof(computed_tag));
-            free(ghash_input);
-            return -1;  /* 认证失败 */
+    } else {
+        if (seg->decrypt) {
+            cached::crypt_hash<sm4::DECRYPT>(seg->ctx, seg->hk, seg->counter, seg->s,
+                                             seg->input, seg->len, seg->output);
+        } else {
+            cached::crypt_hash<sm4::ENCRYPT>(seg->ctx, seg->hk, seg->counter, seg->s,
+                                             seg->input, seg->len, seg->output);
         }
     }
 
-    /* 解密: P = GCTR(K, inc32(J0), C) */
-    uint8_t icb[16];
-    memcpy(icb, j0, 16);
-    gcm_inc32(icb);
-    gctr(&ctx, icb, input, input_len, output);
+    sm4_burn_stack();
+    return NULL;
+}
+
+/* 线程数: nthreads <= 0时取在线CPU数，再按每段最少字节数与上限收紧 */
+static size_t sm4_gcm_mt_segments(size_t input_len, int nthreads)
+{
+    size_t n = nthreads > 0 ? (size_t)nthreads : 0;
+    size_t by_len = input_len / SM4_GCM_MT_MIN_SEGMENT;
+
+    if (n == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        n = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (n > SM4_GCM_MT_MAX_THREADS) {
+        n = SM4_GCM_MT_MAX_THREADS;
+    }
+    return n < by_len ? n : by_len;
+}
+
+/* 并行加密/解密并计算Tag，调用线程处理第0段 */
+static void sm4_gcm_mt_seal(int decrypt, const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                            const uint8_t *aad, size_t aad_len,
+                            const uint8_t *input, size_t input_len,
+                            uint8_t *output, uint8_t *tag_out, size_t nseg)
+{
+    typedef sm4::gcm_base<sm4_ghash> base;
+    sm4_gcm_segment seg[SM4_GCM_MT_MAX_THREADS];
+    pthread_t tid[SM4_GCM_MT_MAX_THREADS];
+    int started[SM4_GCM_MT_MAX_THREADS];
+    sigset_t all, saved;
+    sm4_context ctx;
+    sm4_ghash::key hk;
+    uint8_t h[16], h_seg[16], h_last[16];
+    uint8_t j0[16], counter[16], s[16];
+    size_t nblocks = (input_len + SM4_BLOCK_SIZE - 1) / SM4_BLOCK_SIZE;
+    size_t seg_blocks = nblocks / nseg;
+    size_t i;
+
+    sm4_setkey(&ctx, key);
+    base::init(&ctx, iv, iv_len, &hk, j0);
+
+    memcpy(counter, j0, 16);
+    sm4::inc32::next(counter);
+    for (i = 0; i < nseg; i++) {
+        seg[i].ctx = &ctx;
+        seg[i].hk = &hk;
+        seg[i].input = input + i * seg_blocks * SM4_BLOCK_SIZE;
+        seg[i].output = output + i * seg_blocks * SM4_BLOCK_SIZE;
+        seg[i].len = i + 1 < nseg ? seg_blocks * SM4_BLOCK_SIZE
+                                  : input_len - i * seg_blocks * SM4_BLOCK_SIZE;
+        memcpy(seg[i].counter, counter, 16);
+        sm4::inc32::add(seg[i].counter, (uint64_t)i * seg_blocks);
+        seg[i].decrypt = decrypt;
+    }
+
+    /*
+     * 工作线程继承创建时的信号屏蔽字: 创建期间屏蔽全部信号，
+     * 保证宿主进程(如数据库后端)的信号处理函数只在调用线程上运行；
+     * 线程创建失败的段由调用线程补做
+     */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    for (i = 1; i < nseg; i++) {
+        started[i] = pthread_create(&tid[i], NULL, sm4_gcm_segment_run, &seg[i]) == 0;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    sm4_gcm_segment_run(&seg[0]);
+
+    /* 等待各段期间计算AAD的GHASH与合并用的H的幂 */
+    memset(s, 0, sizeof(s));
+    if (aad && aad_len > 0) {
+        sm4_ghash::update(&hk, s, aad, aad_len);
+    }
+    memset(h, 0, sizeof(h));
+    sm4_crypt_block(&ctx, h, h);
+    sm4_gf128_pow(h_seg, h, seg_blocks);
+    sm4_gf128_pow(h_last, h, nblocks - (nseg - 1) * seg_blocks);
+
+    for (i = 0; i < nseg; i++) {
+        if (i > 0) {
+            if (started[i]) {
+                pthread_join(tid[i], NULL);
+            } else {
+                sm4_gcm_segment_run(&seg[i]);
+            }
+        }
+        sm4_gf128_mul(s, i + 1 < nseg ? h_seg : h_last);
+        sm4::xor_n<16>(s, s, seg[i].s);
+    }
+    base::finish(&ctx, &hk, j0, aad_len, input_len, s, tag_out);
 
     /* 清零敏感数据 */
     sm4_context_clean(&ctx);
+    memset(&hk, 0, sizeof(hk));
+    memset(seg, 0, sizeof(seg));
     memset(h, 0, sizeof(h));
+    memset(h_seg, 0, sizeof(h_seg));
+    memset(h_last, 0, sizeof(h_last));
     memset(j0, 0, sizeof(j0));
+    memset(counter, 0, sizeof(counter));
     memset(s, 0, sizeof(s));
-    memset(computed_tag, 0, sizeof(computed_tag));
-    memset(icb, 0, sizeof(icb));
-    free(ghash_input);
+}
+
+/* SM4 GCM模式多线程加密 */
+int sm4_gcm_encrypt_mt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *input, size_t input_len,
+                       uint8_t *output, uint8_t *tag, int nthreads)
+{
+    size_t nseg = sm4_gcm_mt_segments(input_len, nthreads);
+
+    if (nseg <= 1) {
+        return sm4_gcm_encrypt(key, iv, iv_len, aad, aad_len, input, input_len, output, tag);
+    }
+    if (!key || !iv || !input || !output || !tag) {
+        return -1;
+    }
+
+    sm4_gcm_mt_seal(0, key, iv, iv_len, aad, aad_len, input, input_len, output, tag, nseg);
+    sm4_burn_stack();
     return 0;
 }
 
+/* SM4 GCM模式多线程解密 */
+int sm4_gcm_decrypt_mt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *input, size_t input_len,
+                       const uint8_t *tag, uint8_t *output, int nthreads)
+{
+    size_t nseg = sm4_gcm_mt_segments(input_len, nthreads);
+    uint8_t computed_tag[16];
+    uint8_t diff = 0;
+    int i;
+
+    if (nseg <= 1) {
+        return sm4_gcm_decrypt(key, iv, iv_len, aad, aad_len, input, input_len, tag, output);
+    }
+    if (!key || !iv || !input || !tag || !output) {
+        return -1;
+    }
+
+    sm4_gcm_mt_seal(1, key, iv, iv_len, aad, aad_len, input, input_len, output, computed_tag,
+                    nseg);
+
+    /* 常量时间验证Tag，失败时清零已写出的明文 */
+    for (i = 0; i < 16; i++) {
+        diff |= computed_tag[i] ^ tag[i];
+    }
+    if (diff != 0) {
+        memset(output, 0, input_len);
+    }
+
+    memset(computed_tag, 0, sizeof(computed_tag));
+    sm4_burn_stack();
+    return diff == 0 ? 0 : -1;
+}
+
+/* SM4-SIV确定性加密 */
+int sm4_siv_encrypt(const uint8_t *key, const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    int ret;
+
+    if (input_len >= sm4_stream_min) {
+        ret = sm4::siv<sm4::ENCRYPT, sm4::BATCH_BLOCKS, sm4_store_stream>::run(key, aad, aad_len,
+                                                                              input, input_len, output);
+    } else {
+        ret = sm4::siv<sm4::ENCRYPT>::run(key, aad, aad_len, input, input_len, output);
+    }
+
+    sm4_burn_stack();
+    return ret;
+}
+
+/* SM4-SIV解密并验证(解密后要读回明文计算S2V，不走非临时存储) */
+int sm4_siv_decrypt(const uint8_t *key, const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    int ret = sm4::siv<sm4::DECRYPT>::run(key, aad, aad_len, input, input_len, output);
+
+    sm4_burn_stack();
+    return ret;
+}
+
 #ifdef USE_OPENSSL_KDF
 /*
  * 使用PBKDF2派生密钥和IV（用于KDF功能）
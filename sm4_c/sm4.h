@@ -14,11 +14,63 @@
 #define SM4_NUM_ROUNDS  32
 #define SM4_GCM_IV_SIZE 12  /* 推荐的GCM IV长度 */
 #define SM4_GCM_TAG_SIZE 16 /* GCM认证标签长度 */
+#define SM4_XTS_KEY_SIZE 32 /* XTS密钥长度: 数据密钥K1 || tweak密钥K2 */
+#define SM4_SIV_KEY_SIZE 32 /* SIV密钥长度: CMAC密钥K1 || CTR密钥K2 */
+#define SM4_SIV_TAG_SIZE 16 /* SIV合成IV(兼作认证标签)长度 */
 
 typedef struct {
-    uint32_t rk[SM4_NUM_ROUNDS];  /* 轮密钥 */
+    uint32_t rk[SM4_NUM_ROUNDS];  /* 轮密钥(按使用顺序: sm4_setkey为正序，sm4_setkey_dec为逆序) */
 } sm4_context;
 
+/*
+ * 初始化: 探测CPU特性，自检后选择最快的可用内核
+ * 首次sm4_setkey时会自动调用，也可在加载时(_PG_init)提前调用；多个线程同时首次调用是安全的
+ */
+void sm4_init(void);
+
+/*
+ * 获取当前使用的内核名称
+ * @return: 内核名称，如"gfni-avx512"、"aesni-avx2"、"aesni"、"bitslice-avx2"、
+ *          "bitslice"、"bitslice-block"、"ttable-x4"、"ttable"、"scalar"
+ *          以"bitslice"开头表示位切片(常量时间)模式: 没有AES-NI/GFNI时自动进入，
+ *          多块、剩余块、单块与密钥扩展都不按密钥或数据查表；
+ *          硬件内核模式下不足一组的块、单块操作和密钥扩展仍使用T表
+ */
+const char *sm4_kernel_name(void);
+
+/*
+ * 强制使用指定内核(用于测试与基准对比)，指定位切片内核时同时进入位切片模式
+ * @param name: 内核名称，NULL或"auto"恢复自动选择
+ * @return: 0成功，-1内核不存在、CPU不支持或自检失败
+ */
+int sm4_set_kernel(const char *name);
+
+/*
+ * 获取GCM当前使用的GHASH实现名称
+ * @return: "vpclmul-avx512"、"pclmul"或"table-4bit"
+ */
+const char *sm4_ghash_name(void);
+
+/*
+ * 强制使用指定GHASH实现(用于测试与基准对比)
+ * @param name: 实现名称，NULL或"auto"恢复自动选择
+ * @return: 0成功，-1实现不存在、CPU不支持或自检失败
+ */
+int sm4_set_ghash(const char *name);
+
+/*
+ * 设置大数据流式路径的阈值: 输入不小于该长度时，ECB/GCM预取输入并以非临时存储
+ * 写出结果，避免大块输出挤出缓存中的轮密钥等热数据
+ * @param bytes: 阈值(字节)，默认1MB，SIZE_MAX表示关闭
+ */
+void sm4_set_stream_threshold(size_t bytes);
+
+/*
+ * 获取当前的流式路径阈值
+ * @return: 阈值(字节)
+ */
+size_t sm4_stream_threshold(void);
+
 /*
  * 清零SM4上下文中的轮密钥
  * @param ctx: SM4上下文
@@ -32,6 +84,43 @@ void sm4_context_clean(sm4_context *ctx);
  */
 void sm4_setkey(sm4_context *ctx, const uint8_t *key);
 
+/*
+ * SM4多密钥扩展: 按CPU特性以4/8/16个密钥为一组在SIMD通道中并行扩展，
+ * 适合每行使用不同密钥的批量处理；结果与逐个调用sm4_setkey相同。
+ * sm4_ecb_encrypt_multi/sm4_ecb_decrypt_multi中不足一个多密钥内核组的消息用它扩展密钥
+ * @param ctx: n个SM4上下文组成的数组
+ * @param keys: n个16字节密钥的指针数组
+ * @param n: 密钥个数
+ */
+void sm4_setkey_multi(sm4_context *ctx, const uint8_t *const *keys, size_t n);
+
+/*
+ * SM4解密密钥扩展: 轮密钥按逆序存放，配合sm4_crypt_block/sm4_crypt_blocks解密
+ * 加密、解密上下文可同时持有，互不影响
+ * @param ctx: SM4上下文
+ * @param key: 16字节密钥
+ */
+void sm4_setkey_dec(sm4_context *ctx, const uint8_t *key);
+
+/*
+ * 按上下文中的轮密钥处理单个块(16字节)，方向由密钥扩展决定:
+ * sm4_setkey得到的上下文为加密，sm4_setkey_dec得到的上下文为解密
+ * @param ctx: SM4上下文
+ * @param input: 16字节输入
+ * @param output: 16字节输出
+ */
+void sm4_crypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output);
+
+/*
+ * 按上下文中的轮密钥处理多个相互独立的块，方向由密钥扩展决定
+ * @param ctx: SM4上下文
+ * @param input: 输入，nblocks*16字节
+ * @param output: 输出，nblocks*16字节(可与input相同)
+ * @param nblocks: 块数
+ */
+void sm4_crypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                      size_t nblocks);
+
 /*
  * SM4加密单个块(16字节)
  * @param ctx: SM4上下文
@@ -41,13 +130,56 @@ void sm4_setkey(sm4_context *ctx, const uint8_t *key);
 void sm4_encrypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output);
 
 /*
- * SM4解密单个块(16字节)
- * @param ctx: SM4上下文
+ * SM4解密单个块(16字节)，单块内核直接逆序读取加密轮密钥，不复制上下文；
+ * 同一密钥反复解密时也可用sm4_setkey_dec配合sm4_crypt_block
+ * @param ctx: SM4上下文(sm4_setkey得到的加密轮密钥)
  * @param input: 16字节密文
  * @param output: 16字节明文
  */
 void sm4_decrypt_block(const sm4_context *ctx, const uint8_t *input, uint8_t *output);
 
+/*
+ * SM4多块加密: 多个相互独立的块交织通过各轮，按CPU特性选择并行内核
+ * @param ctx: SM4上下文
+ * @param input: 明文，nblocks*16字节
+ * @param output: 密文，nblocks*16字节(可与input相同)
+ * @param nblocks: 块数
+ */
+void sm4_encrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                        size_t nblocks);
+
+/*
+ * SM4多块解密
+ * @param ctx: SM4上下文(sm4_setkey得到的加密轮密钥)
+ * @param input: 密文，nblocks*16字节
+ * @param output: 明文，nblocks*16字节(可与input相同)
+ * @param nblocks: 块数
+ */
+void sm4_decrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                        size_t nblocks);
+
+/*
+ * SM4位切片多块加密(常量时间，无依赖密钥或数据的查表)
+ * 每64块一组并行计算，适合批量ECB/CTR数据；不足64块时按整组计算。
+ * 轮密钥由sm4_setkey生成，只有在位切片模式下密钥扩展才不查表
+ * @param ctx: SM4上下文(sm4_setkey得到的轮密钥)
+ * @param input: 明文，nblocks*16字节
+ * @param output: 密文，nblocks*16字节(可与input相同)
+ * @param nblocks: 块数
+ */
+void sm4_bitslice_encrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                                 size_t nblocks);
+
+/*
+ * SM4位切片多块解密(常量时间)
+ * @param ctx: SM4上下文(sm4_setkey得到的轮密钥)
+ * @param input: 密文，nblocks*16字节
+ * @param output: 明文，nblocks*16字节(可与input相同)
+ * @param nblocks: 块数
+ */
+void sm4_bitslice_decrypt_blocks(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                                 size_t nblocks);
+
 /*
  * SM4 ECB模式加密
  * @param key: 16字节密钥
@@ -72,6 +204,35 @@ int sm4_ecb_encrypt(const uint8_t *key, const uint8_t *input, size_t input_len,
 int sm4_ecb_decrypt(const uint8_t *key, const uint8_t *input, size_t input_len,
                     uint8_t *output, size_t *output_len);
 
+/*
+ * SM4多密钥多消息ECB加密: n条消息各用自己的密钥，每条消息占一个SIMD通道并行处理，
+ * 适合每行密钥不同的短字段(如手机号、身份证号)批量加密；结果与逐条sm4_ecb_encrypt相同
+ * @param keys: n个16字节密钥的指针数组
+ * @param inputs: n条输入数据的指针数组
+ * @param input_lens: n条输入数据的长度
+ * @param outputs: n个输出缓冲区的指针数组(各自需预分配PKCS7填充后的大小)
+ * @param output_lens: n条输出的长度
+ * @param n: 消息条数
+ * @return: 0成功，-1失败
+ */
+int sm4_ecb_encrypt_multi(const uint8_t *const *keys, const uint8_t *const *inputs,
+                          const size_t *input_lens, uint8_t *const *outputs,
+                          size_t *output_lens, size_t n);
+
+/*
+ * SM4多密钥多消息ECB解密
+ * @param keys: n个16字节密钥的指针数组
+ * @param inputs: n条密文的指针数组
+ * @param input_lens: n条密文的长度(必须是16的倍数)
+ * @param outputs: n个输出缓冲区的指针数组
+ * @param output_lens: n条输出(去填充后)的长度
+ * @param n: 消息条数
+ * @return: 0成功，-1失败(任一条去填充失败即返回-1，其余消息仍正常输出)
+ */
+int sm4_ecb_decrypt_multi(const uint8_t *const *keys, const uint8_t *const *inputs,
+                          const size_t *input_lens, uint8_t *const *outputs,
+                          size_t *output_lens, size_t n);
+
 /*
  * SM4 CBC模式加密
  * @param key: 16字节密钥
@@ -100,6 +261,141 @@ int sm4_cbc_decrypt(const uint8_t *key, const uint8_t *iv,
                     const uint8_t *input, size_t input_len,
                     uint8_t *output, size_t *output_len);
 
+/* 流式CBC上下文 */
+typedef struct {
+    sm4_context ks;                 /* 轮密钥(按方向扩展) */
+    uint8_t iv[SM4_BLOCK_SIZE];     /* 链接值: 前一个密文块 */
+    uint8_t buf[SM4_BLOCK_SIZE];    /* 跨调用保留的未处理数据 */
+    size_t buf_len;                 /* buf中的字节数 */
+    int decrypt;                    /* 0加密，1解密 */
+} sm4_cbc_ctx;
+
+/*
+ * 流式CBC初始化: 之后可多次调用sm4_cbc_update分段处理，最后调用sm4_cbc_final，
+ * 任意分段方式的结果与一次性sm4_cbc_encrypt/sm4_cbc_decrypt相同，内存占用固定
+ * @param ctx: 流式CBC上下文
+ * @param key: 16字节密钥
+ * @param iv: 16字节初始向量
+ * @param decrypt: 0加密，1解密
+ * @return: 0成功，-1失败
+ */
+int sm4_cbc_init(sm4_cbc_ctx *ctx, const uint8_t *key, const uint8_t *iv, int decrypt);
+
+/*
+ * 流式CBC处理一段数据，不足一个分组的部分保留到下次调用
+ * (解密时最后1~16字节保留到sm4_cbc_final)
+ * @param ctx: 流式CBC上下文
+ * @param input: 输入数据
+ * @param input_len: 输入长度(任意)
+ * @param output: 输出缓冲区(至少input_len+16字节，不能与input重叠)
+ * @param output_len: 本次输出长度(16的倍数，可能为0)
+ * @return: 0成功，-1失败
+ */
+int sm4_cbc_update(sm4_cbc_ctx *ctx, const uint8_t *input, size_t input_len,
+                   uint8_t *output, size_t *output_len);
+
+/*
+ * 流式CBC结束: 加密时输出带PKCS7填充的最后一个分组，解密时输出去除填充后的剩余明文；
+ * 无论成功与否都会清零上下文
+ * @param ctx: 流式CBC上下文
+ * @param output: 输出缓冲区(至少16字节)
+ * @param output_len: 输出长度(加密为16，解密为0~15)
+ * @return: 0成功，-1失败(解密时密文长度不是16的倍数或填充错误)
+ */
+int sm4_cbc_final(sm4_cbc_ctx *ctx, uint8_t *output, size_t *output_len);
+
+/*
+ * SM4多消息CBC加密: 同一密钥下n条相互独立的消息按分组步调一致地推进，
+ * 各条消息的当前分组一起经并行内核加密，适合批量加密大量行；结果与逐条sm4_cbc_encrypt相同
+ * @param key: 16字节密钥
+ * @param ivs: n个16字节初始向量的指针数组(可指向同一IV)
+ * @param inputs: n条输入数据的指针数组
+ * @param input_lens: n条输入数据的长度
+ * @param outputs: n个输出缓冲区的指针数组(各自需预分配PKCS7填充后的大小)
+ * @param output_lens: n条输出的长度
+ * @param n: 消息条数
+ * @return: 0成功，-1失败
+ */
+int sm4_cbc_encrypt_multi(const uint8_t *key, const uint8_t *const *ivs,
+                          const uint8_t *const *inputs, const size_t *input_lens,
+                          uint8_t *const *outputs, size_t *output_lens, size_t n);
+
+/*
+ * SM4 CTR模式加解密(加密与解密为同一运算)
+ * 计数器块初值为iv，按128位大端整数逐块加1；可从密钥流的任意字节偏移开始处理，
+ * 用于只解密大段密文中的一部分，代价与处理的长度成正比
+ * @param key: 16字节密钥
+ * @param iv: 16字节初始计数器块(nonce)，同一密钥下不可重复使用
+ * @param offset: input在整个密文(明文)流中的字节偏移
+ * @param input: 输入数据
+ * @param input_len: 输入长度(任意)
+ * @param output: 输出缓冲区(长度为input_len，可与input相同)
+ * @return: 0成功，-1失败
+ */
+int sm4_ctr_crypt(const uint8_t *key, const uint8_t *iv, uint64_t offset,
+                  const uint8_t *input, size_t input_len, uint8_t *output);
+
+/* XTS上下文 */
+typedef struct {
+    sm4_context data;               /* 数据密钥K1的轮密钥(按方向扩展) */
+    sm4_context tweak;              /* tweak密钥K2的轮密钥(加密方向) */
+    int decrypt;                    /* 0加密，1解密 */
+} sm4_xts_context;
+
+/*
+ * SM4-XTS密钥扩展: 用于整页(如8KB堆页)、备份文件块等按块号寻址的存储加密，
+ * 同一密钥下可对大量页反复使用，避免每页重新扩展密钥
+ * @param ctx: XTS上下文
+ * @param key: 32字节密钥(K1 || K2)，两半不能相同
+ * @param decrypt: 0加密，1解密
+ * @return: 0成功，-1失败(参数为空或K1与K2相同)
+ */
+int sm4_xts_setkey(sm4_xts_context *ctx, const uint8_t *key, int decrypt);
+
+/*
+ * 清零XTS上下文中的轮密钥
+ * @param ctx: XTS上下文
+ */
+void sm4_xts_context_clean(sm4_xts_context *ctx);
+
+/*
+ * SM4-XTS处理一个数据单元(IEEE 1619)，方向由sm4_xts_setkey决定:
+ * 长度保持不变，不足16字节的末尾用密文窃取；同一页号下相同位置的相同明文得到相同密文，
+ * 因此只适合按位置寻址、不需要认证的存储加密
+ * @param ctx: XTS上下文
+ * @param sector: 页号/块号，作为tweak(按小端编码为128位)
+ * @param input: 一个数据单元(如一页)
+ * @param input_len: 长度(至少16字节，可不是16的倍数)
+ * @param output: 输出缓冲区(input_len字节，可与input相同)
+ * @return: 0成功，-1失败
+ */
+int sm4_xts_crypt(const sm4_xts_context *ctx, uint64_t sector,
+                  const uint8_t *input, size_t input_len, uint8_t *output);
+
+/*
+ * SM4-XTS加密一个数据单元(每次调用扩展密钥；逐页处理请使用sm4_xts_setkey/sm4_xts_crypt)
+ * @param key: 32字节密钥(K1 || K2)，两半不能相同
+ * @param sector: 页号/块号
+ * @param input: 明文
+ * @param input_len: 长度(至少16字节)
+ * @param output: 密文(input_len字节，可与input相同)
+ * @return: 0成功，-1失败
+ */
+int sm4_xts_encrypt(const uint8_t *key, uint64_t sector,
+                    const uint8_t *input, size_t input_len, uint8_t *output);
+
+/*
+ * SM4-XTS解密一个数据单元
+ * @param key: 32字节密钥(K1 || K2)，两半不能相同
+ * @param sector: 页号/块号
+ * @param input: 密文
+ * @param input_len: 长度(至少16字节)
+ * @param output: 明文(input_len字节，可与input相同)
+ * @return: 0成功，-1失败
+ */
+int sm4_xts_decrypt(const uint8_t *key, uint64_t sector,
+                    const uint8_t *input, size_t input_len, uint8_t *output);
+
 /*
  * SM4 GCM模式加密
  * @param key: 16字节密钥
@@ -128,7 +424,8 @@ int sm4_gcm_encrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
  * @param input: 输入数据
  * @param input_len: 输入长度
  * @param tag: 认证标签(16字节)
- * @param output: 输出缓冲区
+ * @param output: 输出缓冲区(可与input相同)。先验证Tag再解密，认证失败时不写output，
+ *                原地解密时密文保持不变
  * @return: 0成功，-1失败(认证失败或其他错误)
  */
 int sm4_gcm_decrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
@@ -136,6 +433,143 @@ int sm4_gcm_decrypt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
                     const uint8_t *input, size_t input_len,
                     const uint8_t *tag, uint8_t *output);
 
+/*
+ * SM4 GCM模式多线程加密: 输入按分组边界切分为若干段，各段在工作线程上从计算出的
+ * 计数器偏移开始并行完成CTR与GHASH，各段的GHASH部分和用预计算的H的幂合并；
+ * 结果与sm4_gcm_encrypt相同。每段至少1MB，输入不足2MB或只有一个线程时直接走单线程路径。
+ * 工作线程在屏蔽全部信号的状态下创建，不会执行宿主进程的信号处理函数；
+ * 工作线程读取内核分派表，不得与sm4_set_kernel/sm4_set_ghash并发调用
+ * @param key: 16字节密钥
+ * @param iv: 初始向量(推荐12字节)
+ * @param iv_len: IV长度
+ * @param aad: 附加认证数据(可选)
+ * @param aad_len: AAD长度
+ * @param input: 输入数据
+ * @param input_len: 输入长度
+ * @param output: 输出缓冲区(长度应为input_len，可与input相同)
+ * @param tag: 认证标签输出(16字节)
+ * @param nthreads: 线程数(含调用线程，上限64)，0表示按在线CPU数
+ * @return: 0成功，-1失败
+ */
+int sm4_gcm_encrypt_mt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *input, size_t input_len,
+                       uint8_t *output, uint8_t *tag, int nthreads);
+
+/*
+ * SM4 GCM模式多线程解密，分段方式同sm4_gcm_encrypt_mt；各段解密与GHASH单遍完成，
+ * 明文在Tag验证前写出，认证失败时清零(走单线程路径时同sm4_gcm_decrypt，不写output)
+ * @param key: 16字节密钥
+ * @param iv: 初始向量
+ * @param iv_len: IV长度
+ * @param aad: 附加认证数据(可选)
+ * @param aad_len: AAD长度
+ * @param input: 输入数据
+ * @param input_len: 输入长度
+ * @param tag: 认证标签(16字节)
+ * @param output: 输出缓冲区(可与input相同)，认证失败时被清零
+ * @param nthreads: 线程数(含调用线程，上限64)，0表示按在线CPU数
+ * @return: 0成功，-1失败(认证失败或其他错误)
+ */
+int sm4_gcm_decrypt_mt(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                       const uint8_t *aad, size_t aad_len,
+                       const uint8_t *input, size_t input_len,
+                       const uint8_t *tag, uint8_t *output, int nthreads);
+
+/* 流式GCM上下文 */
+typedef struct {
+    sm4_context ks;                     /* 轮密钥(加密方向) */
+    uint64_t ghash_key[33];             /* 由H预计算的GHASH表，格式由所选GHASH实现决定 */
+    uint8_t j0[SM4_BLOCK_SIZE];         /* 初始计数器块J0，用于计算Tag */
+    uint8_t counter[SM4_BLOCK_SIZE];    /* 下一个未使用的计数器块 */
+    uint8_t s[SM4_BLOCK_SIZE];          /* GHASH累加值 */
+    uint8_t ctr_ks[SM4_BLOCK_SIZE];     /* 当前不完整分组的密钥流 */
+    uint8_t buf[SM4_BLOCK_SIZE];        /* 当前不完整分组(AAD或密文) */
+    size_t buf_len;                     /* buf中的字节数 */
+    uint64_t aad_len;                   /* 已输入的AAD总长度 */
+    uint64_t data_len;                  /* 已处理的明文/密文总长度 */
+    int phase;                          /* 0: 输入AAD，1: 处理数据 */
+    int decrypt;                        /* 0加密，1解密 */
+} sm4_gcm_ctx;
+
+/*
+ * 流式GCM初始化: 之后按顺序调用sm4_gcm_aad(可多次或不调用)、sm4_gcm_update(可多次)，
+ * 最后调用sm4_gcm_final或sm4_gcm_final_verify；任意分段方式的结果与一次性
+ * sm4_gcm_encrypt/sm4_gcm_decrypt相同，内存占用固定
+ * @param ctx: 流式GCM上下文
+ * @param key: 16字节密钥
+ * @param iv: 初始向量(推荐12字节)
+ * @param iv_len: IV长度
+ * @param decrypt: 0加密，1解密
+ * @return: 0成功，-1失败
+ */
+int sm4_gcm_init(sm4_gcm_ctx *ctx, const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                 int decrypt);
+
+/*
+ * 流式GCM输入一段附加认证数据，须在第一次sm4_gcm_update之前调用
+ * @param ctx: 流式GCM上下文
+ * @param aad: 附加认证数据
+ * @param aad_len: 长度(任意)
+ * @return: 0成功，-1失败(已开始处理数据)
+ */
+int sm4_gcm_aad(sm4_gcm_ctx *ctx, const uint8_t *aad, size_t aad_len);
+
+/*
+ * 流式GCM加密/解密一段数据，输出与输入等长，不完整分组跨调用保留
+ * 注意: 解密时明文在Tag验证前就已输出，sm4_gcm_final_verify通过之前不得使用
+ * @param ctx: 流式GCM上下文
+ * @param input: 输入数据
+ * @param input_len: 输入长度(任意)
+ * @param output: 输出缓冲区(input_len字节，可与input相同)
+ * @return: 0成功，-1失败
+ */
+int sm4_gcm_update(sm4_gcm_ctx *ctx, const uint8_t *input, size_t input_len, uint8_t *output);
+
+/*
+ * 流式GCM结束并输出认证标签；无论成功与否都会清零上下文
+ * @param ctx: 流式GCM上下文
+ * @param tag: 认证标签输出(16字节)
+ * @return: 0成功，-1失败
+ */
+int sm4_gcm_final(sm4_gcm_ctx *ctx, uint8_t *tag);
+
+/*
+ * 流式GCM解密结束: 以常量时间比较认证标签；无论成功与否都会清零上下文
+ * @param ctx: 流式GCM上下文
+ * @param tag: 期望的认证标签(16字节)
+ * @return: 0认证通过，-1认证失败或其他错误
+ */
+int sm4_gcm_final_verify(sm4_gcm_ctx *ctx, const uint8_t *tag);
+
+/*
+ * SM4-SIV确定性认证加密(RFC 5297，S2V基于CMAC-SM4，再做CTR):
+ * 相同的(密钥, AAD, 明文)总是得到相同的密文，可在密文列上建普通btree/hash索引做等值查询；
+ * 代价是会暴露哪些行的明文相同，只应用于需要等值检索的列
+ * @param key: 32字节密钥(K1 || K2)
+ * @param aad: 附加认证数据，NULL表示无(与长度为0的AAD结果不同)
+ * @param aad_len: AAD长度
+ * @param input: 明文
+ * @param input_len: 明文长度(任意，可为0)
+ * @param output: 输出缓冲区(input_len + 16字节): V(16字节) || 密文
+ * @return: 0成功，-1失败
+ */
+int sm4_siv_encrypt(const uint8_t *key, const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len, uint8_t *output);
+
+/*
+ * SM4-SIV解密并验证
+ * @param key: 32字节密钥(K1 || K2)
+ * @param aad: 附加认证数据，须与加密时一致(NULL与长度为0不同)
+ * @param aad_len: AAD长度
+ * @param input: V(16字节) || 密文
+ * @param input_len: 输入长度(至少16字节)
+ * @param output: 明文缓冲区(input_len - 16字节，可为input + 16)，认证失败时被清零
+ * @return: 0成功，-1失败(认证失败或其他错误)
+ */
+int sm4_siv_decrypt(const uint8_t *key, const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len, uint8_t *output);
+
 /*
  * SM4 CBC模式加密（带密钥派生）
  * @param password: 原始密码/密钥
@@ -0,0 +1,1467 @@
+/*
+ * SM4 C++ Mode Templates
+ * 国密SM4工作模式模板(仅头文件，需要C++11)
+ *
+ * 按工作模式、方向和批量宽度在编译期特化: 方向通过模板特化选择密钥扩展与
+ * 处理顺序，批量循环的块数为编译期常量，由编译器展开和常量折叠，
+ * 只有最后不足一批的部分走运行时长度。sm4.h中的C接口均为这些模板的实例化。
+ */
+
+#ifndef SM4_HPP
+#define SM4_HPP
+
+#include "sm4.h"
+#include <string.h>
+#include <stdlib.h>
+
+namespace sm4 {
+
+/* 方向 */
+enum direction { ENCRYPT, DECRYPT };
+
+/* 默认批量宽度(块数)，与最宽的并行内核(位切片64块)对齐 */
+static const size_t BATCH_BLOCKS = 64;
+
+/* 短消息(PKCS7填充后不超过2个分组)的最大输入长度，此类输入在栈上填充 */
+static const size_t SHORT_MAX_LEN = 2 * SM4_BLOCK_SIZE - 1;
+
+/* 按方向选择密钥扩展: 解密使用逆序轮密钥，之后与加密共用同一内核 */
+template <direction D> struct schedule;
+
+template <> struct schedule<ENCRYPT> {
+    static void setkey(sm4_context *ctx, const uint8_t *key) { sm4_setkey(ctx, key); }
+};
+
+template <> struct schedule<DECRYPT> {
+    static void setkey(sm4_context *ctx, const uint8_t *key) { sm4_setkey_dec(ctx, key); }
+};
+
+/* 定长异或，N为编译期常量，可完全展开/向量化 */
+template <size_t N>
+inline void xor_n(uint8_t *out, const uint8_t *a, const uint8_t *b)
+{
+    for (size_t i = 0; i < N; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+/* 变长异或(仅用于最后不足一批的部分) */
+inline void xor_bytes(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = a[i] ^ b[i];
+    }
+}
+
+/*
+ * 输出写入策略(Store):
+ *   streaming: 是否为大数据流式路径
+ *   xor_block<N>(out, a, b) / xor_out(out, a, b, n): out = a ^ b
+ *   copy_out(out, src, n): 写出已处理的数据
+ *   prefetch(p, n): 预取即将读取的输入
+ *   finish(): 所有写出完成后调用
+ */
+struct store_cached {
+    static const bool streaming = false;
+
+    template <size_t N>
+    static void xor_block(uint8_t *out, const uint8_t *a, const uint8_t *b) { xor_n<N>(out, a, b); }
+    static void xor_out(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t n) { xor_bytes(out, a, b, n); }
+    static void copy_out(uint8_t *out, const uint8_t *src, size_t n) { memcpy(out, src, n); }
+    static void prefetch(const uint8_t *, size_t) {}
+    static void finish() {}
+};
+
+/* 多块处理: 缓存写入时直接输出；流式写入时经栈上批量缓冲区，边预取输入边写出 */
+template <class Store, size_t Batch = BATCH_BLOCKS> struct blocks {
+    static void crypt(const sm4_context *ctx, const uint8_t *input, uint8_t *output, size_t nblocks)
+    {
+        uint8_t buf[Batch * SM4_BLOCK_SIZE];
+        size_t i = 0;
+
+        if (!Store::streaming) {
+            sm4_crypt_blocks(ctx, input, output, nblocks);
+            return;
+        }
+
+        for (; nblocks - i >= Batch; i += Batch) {
+            Store::prefetch(input + (i + Batch) * SM4_BLOCK_SIZE, sizeof(buf));
+            sm4_crypt_blocks(ctx, input + i * SM4_BLOCK_SIZE, buf, Batch);
+            Store::copy_out(output + i * SM4_BLOCK_SIZE, buf, sizeof(buf));
+        }
+        if (i < nblocks) {
+            sm4_crypt_blocks(ctx, input + i * SM4_BLOCK_SIZE, buf, nblocks - i);
+            Store::copy_out(output + i * SM4_BLOCK_SIZE, buf, (nblocks - i) * SM4_BLOCK_SIZE);
+        }
+        Store::finish();
+        memset(buf, 0, sizeof(buf));
+    }
+};
+
+/* PKCS7填充 */
+struct pkcs7 {
+    /* 填充后的长度 */
+    static size_t padded_len(size_t len)
+    {
+        return len + SM4_BLOCK_SIZE - (len % SM4_BLOCK_SIZE);
+    }
+
+    /* 整段填充，返回填充后的长度 */
+    static size_t pad(const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        size_t total_len = padded_len(input_len);
+
+        memcpy(output, input, input_len);
+        memset(output + input_len, (int)(total_len - input_len), total_len - input_len);
+        return total_len;
+    }
+
+    /* 取填充后消息的第b个分组(b不超过输入的完整块数) */
+    static void block(const uint8_t *input, size_t input_len, size_t b, uint8_t *out)
+    {
+        size_t off = b * SM4_BLOCK_SIZE;
+        size_t rem = input_len - off;
+
+        if (rem >= SM4_BLOCK_SIZE) {
+            memcpy(out, input + off, SM4_BLOCK_SIZE);
+        } else {
+            memcpy(out, input + off, rem);
+            memset(out + rem, (int)(SM4_BLOCK_SIZE - rem), SM4_BLOCK_SIZE - rem);
+        }
+    }
+
+    /* 去除填充 */
+    static int unpad(const uint8_t *data, size_t data_len, size_t *out_len)
+    {
+        uint8_t pad_len;
+        size_t i;
+
+        if (data_len == 0 || data_len % SM4_BLOCK_SIZE != 0) {
+            return -1;
+        }
+
+        pad_len = data[data_len - 1];
+        if (pad_len == 0 || pad_len > SM4_BLOCK_SIZE) {
+            return -1;
+        }
+
+        for (i = data_len - pad_len; i < data_len; i++) {
+            if (data[i] != pad_len) {
+                return -1;
+            }
+        }
+
+        *out_len = data_len - pad_len;
+        return 0;
+    }
+};
+
+/*
+ * ECB模式
+ */
+template <direction D, class Store = store_cached> struct ecb;
+
+template <class Store> struct ecb<ENCRYPT, Store> {
+    static int run(const uint8_t *key, const uint8_t *input, size_t input_len,
+                   uint8_t *output, size_t *output_len)
+    {
+        sm4_context ctx;
+        size_t padded_len, full;
+        uint8_t last[SM4_BLOCK_SIZE];
+
+        if (!key || !input || !output || !output_len) {
+            return -1;
+        }
+
+        /* 输入长度溢出检查 (Feature-15) */
+        if (input_len > (SIZE_MAX - SM4_BLOCK_SIZE)) {
+            return -1;
+        }
+
+        padded_len = pkcs7::padded_len(input_len);
+        schedule<ENCRYPT>::setkey(&ctx, key);
+
+        /* 短消息: 在栈上填充后直接写入output，不分配堆内存 */
+        if (input_len <= SHORT_MAX_LEN) {
+            uint8_t buf[SHORT_MAX_LEN + 1];
+
+            pkcs7::pad(input, input_len, buf);
+            sm4_crypt_blocks(&ctx, buf, output, padded_len / SM4_BLOCK_SIZE);
+
+            sm4_context_clean(&ctx);
+            memset(buf, 0, sizeof(buf));
+            *output_len = padded_len;
+            return 0;
+        }
+
+        /* 完整块直接从input加密，仅最后一个填充块在栈上构造，不复制整段明文 */
+        full = input_len / SM4_BLOCK_SIZE;
+        blocks<Store>::crypt(&ctx, input, output, full);
+        pkcs7::block(input, input_len, full, last);
+        sm4_crypt_block(&ctx, last, output + full * SM4_BLOCK_SIZE);
+
+        /* 清零敏感数据 */
+        sm4_context_clean(&ctx);
+        memset(last, 0, sizeof(last));
+        *output_len = padded_len;
+        return 0;
+    }
+};
+
+template <class Store> struct ecb<DECRYPT, Store> {
+    static int run(const uint8_t *key, const uint8_t *input, size_t input_len,
+                   uint8_t *output, size_t *output_len)
+    {
+        sm4_context ctx;
+
+        if (!key || !input || !output || !output_len) {
+            return -1;
+        }
+
+        if (input_len == 0 || input_len % SM4_BLOCK_SIZE != 0) {
+            return -1;
+        }
+
+        schedule<DECRYPT>::setkey(&ctx, key);
+
+        /* 分块解密(各块独立，可多块并行) */
+        blocks<Store>::crypt(&ctx, input, output, input_len / SM4_BLOCK_SIZE);
+
+        sm4_context_clean(&ctx);
+
+        /* 去除填充 */
+        return pkcs7::unpad(output, input_len, output_len);
+    }
+};
+
+/*
+ * CBC模式
+ */
+template <direction D, size_t Batch = BATCH_BLOCKS> struct cbc;
+
+/* 加密: 链式依赖，逐块处理 */
+template <size_t Batch> struct cbc<ENCRYPT, Batch> {
+    /*
+     * 加密nblocks块: 与前一密文块(首块为prev)异或后加密，前一密文块直接引用output
+     * block为16字节临时区，返回最后一个密文块的位置(nblocks为0时返回prev)
+     */
+    static const uint8_t *chain(const sm4_context *ctx, const uint8_t *prev,
+                                const uint8_t *input, uint8_t *output, size_t nblocks,
+                                uint8_t *block)
+    {
+        size_t i;
+
+        for (i = 0; i < nblocks; i++) {
+            xor_n<SM4_BLOCK_SIZE>(block, input + i * SM4_BLOCK_SIZE, prev);
+            sm4_crypt_block(ctx, block, output + i * SM4_BLOCK_SIZE);
+            prev = output + i * SM4_BLOCK_SIZE;
+        }
+        return prev;
+    }
+
+    static int run(const uint8_t *key, const uint8_t *iv,
+                   const uint8_t *input, size_t input_len,
+                   uint8_t *output, size_t *output_len)
+    {
+        sm4_context ctx;
+        size_t full_len;
+        uint8_t block[SM4_BLOCK_SIZE];
+        const uint8_t *prev;
+
+        if (!key || !iv || !input || !output || !output_len) {
+            return -1;
+        }
+
+        /* 输入长度溢出检查 */
+        if (input_len > (SIZE_MAX - SM4_BLOCK_SIZE)) {
+            return -1;
+        }
+
+        full_len = input_len - input_len % SM4_BLOCK_SIZE;
+        schedule<ENCRYPT>::setkey(&ctx, key);
+
+        /* 完整块直接从input读取 */
+        prev = chain(&ctx, iv, input, output, full_len / SM4_BLOCK_SIZE, block);
+
+        /* 最后一个填充块在栈上构造 */
+        pkcs7::block(input, input_len, full_len / SM4_BLOCK_SIZE, block);
+        xor_n<SM4_BLOCK_SIZE>(block, block, prev);
+        sm4_crypt_block(&ctx, block, output + full_len);
+
+        /* 清零敏感数据 */
+        sm4_context_clean(&ctx);
+        memset(block, 0, sizeof(block));
+        *output_len = full_len + SM4_BLOCK_SIZE;
+        return 0;
+    }
+};
+
+/*
+ * 解密: 各密文块的解密互不依赖，每批Batch块经最宽的并行内核直接解密到output，
+ * 再与错开一个分组的密文流整批异或(首块与IV异或)，不经临时缓冲区和prev拷贝
+ */
+template <size_t Batch> struct cbc<DECRYPT, Batch> {
+    /* 解密N块(N为编译期常量)，prev为NULL时表示前一密文块紧邻input之前 */
+    template <size_t N>
+    static void chunk(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                      const uint8_t *prev)
+    {
+        sm4_crypt_blocks(ctx, input, output, N);
+        if (prev) {
+            xor_n<SM4_BLOCK_SIZE>(output, output, prev);
+            xor_n<(N - 1) * SM4_BLOCK_SIZE>(output + SM4_BLOCK_SIZE, output + SM4_BLOCK_SIZE, input);
+        } else {
+            xor_n<N * SM4_BLOCK_SIZE>(output, output, input - SM4_BLOCK_SIZE);
+        }
+    }
+
+    static void tail(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                     size_t nblocks, const uint8_t *prev)
+    {
+        sm4_crypt_blocks(ctx, input, output, nblocks);
+        if (prev) {
+            xor_n<SM4_BLOCK_SIZE>(output, output, prev);
+            xor_bytes(output + SM4_BLOCK_SIZE, output + SM4_BLOCK_SIZE, input,
+                      (nblocks - 1) * SM4_BLOCK_SIZE);
+        } else {
+            xor_bytes(output, output, input - SM4_BLOCK_SIZE, nblocks * SM4_BLOCK_SIZE);
+        }
+    }
+
+    /*
+     * 原地解密(output与input重叠): 先解密到buf，保存本批最后一个密文块，
+     * 再从后往前异或，保证所需的前一密文块尚未被覆盖
+     */
+    static void chunk_inplace(const sm4_context *ctx, const uint8_t *input, uint8_t *output,
+                              size_t nblocks, uint8_t *prev, uint8_t *buf)
+    {
+        uint8_t next[SM4_BLOCK_SIZE];
+        size_t k;
+
+        sm4_crypt_blocks(ctx, input, buf, nblocks);
+        memcpy(next, input + (nblocks - 1) * SM4_BLOCK_SIZE, SM4_BLOCK_SIZE);
+        for (k = nblocks - 1; k > 0; k--) {
+            xor_n<SM4_BLOCK_SIZE>(output + k * SM4_BLOCK_SIZE, buf + k * SM4_BLOCK_SIZE,
+                                  input + (k - 1) * SM4_BLOCK_SIZE);
+        }
+        xor_n<SM4_BLOCK_SIZE>(output, buf, prev);
+        memcpy(prev, next, SM4_BLOCK_SIZE);
+    }
+
+    /* 解密nblocks块，prev为前一密文块(首次为IV)，返回时更新为本次最后一个密文块 */
+    static void chain(const sm4_context *ctx, uint8_t *prev,
+                      const uint8_t *input, uint8_t *output, size_t nblocks)
+    {
+        size_t input_len = nblocks * SM4_BLOCK_SIZE;
+        size_t i = 0;
+
+        if (nblocks == 0) {
+            return;
+        }
+
+        if (output + input_len <= input || input + input_len <= output) {
+            for (; nblocks - i >= Batch; i += Batch) {
+                chunk<Batch>(ctx, input + i * SM4_BLOCK_SIZE, output + i * SM4_BLOCK_SIZE,
+                             i == 0 ? prev : NULL);
+            }
+            if (i < nblocks) {
+                tail(ctx, input + i * SM4_BLOCK_SIZE, output + i * SM4_BLOCK_SIZE, nblocks - i,
+                     i == 0 ? prev : NULL);
+            }
+            memcpy(prev, input + input_len - SM4_BLOCK_SIZE, SM4_BLOCK_SIZE);
+        } else {
+            uint8_t buf[Batch * SM4_BLOCK_SIZE];
+
+            for (; i < nblocks; i += Batch) {
+                chunk_inplace(ctx, input + i * SM4_BLOCK_SIZE, output + i * SM4_BLOCK_SIZE,
+                              nblocks - i < Batch ? nblocks - i : Batch, prev, buf);
+            }
+            memset(buf, 0, sizeof(buf));
+        }
+    }
+
+    static int run(const uint8_t *key, const uint8_t *iv,
+                   const uint8_t *input, size_t input_len,
+                   uint8_t *output, size_t *output_len)
+    {
+        sm4_context ctx;
+        uint8_t prev[SM4_BLOCK_SIZE];
+
+        if (!key || !iv || !input || !output || !output_len) {
+            return -1;
+        }
+
+        if (input_len == 0 || input_len % SM4_BLOCK_SIZE != 0) {
+            return -1;
+        }
+
+        schedule<DECRYPT>::setkey(&ctx, key);
+        memcpy(prev, iv, SM4_BLOCK_SIZE);
+        chain(&ctx, prev, input, output, input_len / SM4_BLOCK_SIZE);
+
+        /* 清零敏感数据 */
+        sm4_context_clean(&ctx);
+        memset(prev, 0, sizeof(prev));
+
+        /* 去除填充 */
+        return pkcs7::unpad(output, input_len, output_len);
+    }
+};
+
+/*
+ * 流式CBC: 跨多次update保存链接值与不足一个分组的数据，PKCS7填充在final中处理；
+ * 解密时始终保留最后1~16字节到final，以便去除填充
+ */
+template <size_t Batch = BATCH_BLOCKS> struct cbc_stream {
+    static int init(sm4_cbc_ctx *c, const uint8_t *key, const uint8_t *iv, int decrypt)
+    {
+        if (!c || !key || !iv) {
+            return -1;
+        }
+
+        if (decrypt) {
+            schedule<DECRYPT>::setkey(&c->ks, key);
+        } else {
+            schedule<ENCRYPT>::setkey(&c->ks, key);
+        }
+        memcpy(c->iv, iv, SM4_BLOCK_SIZE);
+        c->buf_len = 0;
+        c->decrypt = decrypt ? 1 : 0;
+        return 0;
+    }
+
+    static int update(sm4_cbc_ctx *c, const uint8_t *input, size_t input_len,
+                      uint8_t *output, size_t *output_len)
+    {
+        uint8_t block[SM4_BLOCK_SIZE];
+        size_t done = 0, n;
+
+        if (!c || (!input && input_len > 0) || !output || !output_len) {
+            return -1;
+        }
+
+        /* 不足以输出一个分组(解密时需多于一个分组)，全部缓存 */
+        if (c->buf_len + input_len < SM4_BLOCK_SIZE + (size_t)c->decrypt) {
+            memcpy(c->buf + c->buf_len, input, input_len);
+            c->buf_len += input_len;
+            *output_len = 0;
+            return 0;
+        }
+
+        /* 先补满并处理上次剩余的分组 */
+        if (c->buf_len > 0) {
+            size_t need = SM4_BLOCK_SIZE - c->buf_len;
+
+            memcpy(c->buf + c->buf_len, input, need);
+            input += need;
+            input_len -= need;
+            if (c->decrypt) {
+                cbc<DECRYPT, Batch>::chain(&c->ks, c->iv, c->buf, output, 1);
+            } else {
+                cbc<ENCRYPT, Batch>::chain(&c->ks, c->iv, c->buf, output, 1, block);
+                memcpy(c->iv, output, SM4_BLOCK_SIZE);
+            }
+            output += SM4_BLOCK_SIZE;
+            done = SM4_BLOCK_SIZE;
+        }
+
+        /* 完整块直接从input处理，解密时留下最后1~16字节 */
+        if (c->decrypt) {
+            n = input_len > 0 ? (input_len - 1) / SM4_BLOCK_SIZE : 0;
+            cbc<DECRYPT, Batch>::chain(&c->ks, c->iv, input, output, n);
+        } else {
+            n = input_len / SM4_BLOCK_SIZE;
+            if (n > 0) {
+                cbc<ENCRYPT, Batch>::chain(&c->ks, c->iv, input, output, n, block);
+                memcpy(c->iv, output + (n - 1) * SM4_BLOCK_SIZE, SM4_BLOCK_SIZE);
+            }
+        }
+
+        c->buf_len = input_len - n * SM4_BLOCK_SIZE;
+        memcpy(c->buf, input + n * SM4_BLOCK_SIZE, c->buf_len);
+        *output_len = done + n * SM4_BLOCK_SIZE;
+        memset(block, 0, sizeof(block));
+        return 0;
+    }
+
+    static int final(sm4_cbc_ctx *c, uint8_t *output, size_t *output_len)
+    {
+        uint8_t block[SM4_BLOCK_SIZE];
+        int ret = 0;
+
+        if (!c || !output || !output_len) {
+            return -1;
+        }
+
+        if (c->decrypt) {
+            /* 解密: 最后一个分组必须完整，解密后去除填充 */
+            if (c->buf_len != SM4_BLOCK_SIZE) {
+                ret = -1;
+            } else {
+                size_t n;
+
+                cbc<DECRYPT, Batch>::chain(&c->ks, c->iv, c->buf, block, 1);
+                ret = pkcs7::unpad(block, SM4_BLOCK_SIZE, &n);
+                if (ret == 0) {
+                    memcpy(output, block, n);
+                    *output_len = n;
+                }
+            }
+        } else {
+            /* 加密: 剩余数据补齐PKCS7填充后作为最后一个分组 */
+            uint8_t last[SM4_BLOCK_SIZE];
+
+            pkcs7::block(c->buf, c->buf_len, 0, last);
+            cbc<ENCRYPT, Batch>::chain(&c->ks, c->iv, last, output, 1, block);
+            *output_len = SM4_BLOCK_SIZE;
+            memset(last, 0, sizeof(last));
+        }
+
+        /* 清零敏感数据(含轮密钥) */
+        memset(c, 0, sizeof(*c));
+        memset(block, 0, sizeof(block));
+        return ret;
+    }
+};
+
+/*
+ * 多消息CBC加密: 同一密钥下相互独立的多条消息(各自的IV，可相同)按分组步调一致地推进，
+ * 每一步收集各条消息的当前分组一起经并行内核加密，单条消息内的链式依赖不变
+ */
+template <size_t Lanes = BATCH_BLOCKS> struct cbc_multi {
+    /* 处理不超过Lanes条消息，已结束的消息不再占用通道 */
+    static void group(const sm4_context *ctx, const uint8_t *const *ivs,
+                      const uint8_t *const *inputs, const size_t *input_lens,
+                      uint8_t *const *outputs, size_t n)
+    {
+        uint8_t buf[Lanes * SM4_BLOCK_SIZE];
+        size_t nblocks[Lanes];
+        size_t lane[Lanes];
+        size_t max_blocks = 0;
+        size_t b, j, m;
+
+        for (j = 0; j < n; j++) {
+            nblocks[j] = input_lens[j] / SM4_BLOCK_SIZE + 1;
+            if (nblocks[j] > max_blocks) {
+                max_blocks = nblocks[j];
+            }
+        }
+
+        for (b = 0; b < max_blocks; b++) {
+            for (j = 0, m = 0; j < n; j++) {
+                uint8_t *block = buf + m * SM4_BLOCK_SIZE;
+
+                if (b >= nblocks[j]) {
+                    continue;
+                }
+                pkcs7::block(inputs[j], input_lens[j], b, block);
+                xor_n<SM4_BLOCK_SIZE>(block, block, b == 0 ? ivs[j] : outputs[j] + (b - 1) * SM4_BLOCK_SIZE);
+                lane[m++] = j;
+            }
+
+            sm4_crypt_blocks(ctx, buf, buf, m);
+
+            for (j = 0; j < m; j++) {
+                memcpy(outputs[lane[j]] + b * SM4_BLOCK_SIZE, buf + j * SM4_BLOCK_SIZE, SM4_BLOCK_SIZE);
+            }
+        }
+
+        memset(buf, 0, sizeof(buf));
+    }
+
+    static int run(const uint8_t *key, const uint8_t *const *ivs,
+                   const uint8_t *const *inputs, const size_t *input_lens,
+                   uint8_t *const *outputs, size_t *output_lens, size_t n)
+    {
+        sm4_context ctx;
+        size_t i, m;
+
+        if (n == 0) {
+            return 0;
+        }
+        if (!key || !ivs || !inputs || !input_lens || !outputs || !output_lens) {
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            if (!ivs[i] || !inputs[i] || !outputs[i] || input_lens[i] > (SIZE_MAX - SM4_BLOCK_SIZE)) {
+                return -1;
+            }
+        }
+
+        schedule<ENCRYPT>::setkey(&ctx, key);
+
+        for (i = 0; i < n; i += m) {
+            m = n - i < Lanes ? n - i : Lanes;
+            group(&ctx, ivs + i, inputs + i, input_lens + i, outputs + i, m);
+        }
+        for (i = 0; i < n; i++) {
+            output_lens[i] = pkcs7::padded_len(input_lens[i]);
+        }
+
+        sm4_context_clean(&ctx);
+        return 0;
+    }
+};
+
+/*
+ * CTR模式(密钥流异或)，计数器递增方式由Inc决定
+ */
+
+/* GCM计数器: 末32位按大端序递增 */
+struct inc32 {
+    static void next(uint8_t *counter)
+    {
+        uint32_t val = ((uint32_t)counter[12] << 24) | ((uint32_t)counter[13] << 16) |
+                       ((uint32_t)counter[14] << 8) | (uint32_t)counter[15];
+
+        val++;
+        counter[12] = (uint8_t)(val >> 24);
+        counter[13] = (uint8_t)(val >> 16);
+        counter[14] = (uint8_t)(val >> 8);
+        counter[15] = (uint8_t)val;
+    }
+
+    static void add(uint8_t *counter, uint64_t n)
+    {
+        uint32_t val = ((uint32_t)counter[12] << 24) | ((uint32_t)counter[13] << 16) |
+                       ((uint32_t)counter[14] << 8) | (uint32_t)counter[15];
+
+        val += (uint32_t)n;
+        counter[12] = (uint8_t)(val >> 24);
+        counter[13] = (uint8_t)(val >> 16);
+        counter[14] = (uint8_t)(val >> 8);
+        counter[15] = (uint8_t)val;
+    }
+};
+
+/* SM4-CTR计数器: 整个16字节按128位大端整数递增 */
+struct inc128 {
+    static void next(uint8_t *counter)
+    {
+        int i;
+
+        for (i = 15; i >= 0; i--) {
+            if (++counter[i] != 0) {
+                break;
+            }
+        }
+    }
+
+    static void add(uint8_t *counter, uint64_t n)
+    {
+        unsigned carry = 0;
+        int i;
+
+        for (i = 15; i >= 0; i--) {
+            unsigned sum = counter[i] + (unsigned)(n & 0xff) + carry;
+
+            counter[i] = (uint8_t)sum;
+            carry = sum >> 8;
+            n >>= 8;
+            if (n == 0 && carry == 0) {
+                break;
+            }
+        }
+    }
+};
+
+template <class Inc, size_t Batch = BATCH_BLOCKS, class Store = store_cached> struct ctr {
+    /* 生成n个计数器块并一次性加密 */
+    static void keystream(const sm4_context *ctx, uint8_t *counter, uint8_t *blocks, size_t n)
+    {
+        for (size_t j = 0; j < n; j++) {
+            memcpy(blocks + j * SM4_BLOCK_SIZE, counter, SM4_BLOCK_SIZE);
+            Inc::next(counter);
+        }
+        sm4_crypt_blocks(ctx, blocks, blocks, n);
+    }
+
+    /* 密钥流与输入异或，counter返回时指向下一个未使用的计数器块 */
+    static void xor_stream(const sm4_context *ctx, uint8_t *counter,
+                           const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        uint8_t ks[Batch * SM4_BLOCK_SIZE];
+        size_t i = 0;
+
+        for (; input_len - i >= sizeof(ks); i += sizeof(ks)) {
+            Store::prefetch(input + i + sizeof(ks), sizeof(ks));
+            keystream(ctx, counter, ks, Batch);
+            Store::template xor_block<sizeof(ks)>(output + i, input + i, ks);
+        }
+        if (i < input_len) {
+            keystream(ctx, counter, ks, (input_len - i + SM4_BLOCK_SIZE - 1) / SM4_BLOCK_SIZE);
+            Store::xor_out(output + i, input + i, ks, input_len - i);
+        }
+        Store::finish();
+
+        memset(ks, 0, sizeof(ks));
+    }
+
+    /* 随机访问: 从密钥流第offset字节处开始异或，直接计算起始计数器块 */
+    static void xor_at(const sm4_context *ctx, const uint8_t *icb, uint64_t offset,
+                       const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        uint8_t counter[SM4_BLOCK_SIZE];
+        size_t skip = (size_t)(offset % SM4_BLOCK_SIZE);
+
+        memcpy(counter, icb, SM4_BLOCK_SIZE);
+        Inc::add(counter, offset / SM4_BLOCK_SIZE);
+
+        /* 起始位置不在分组边界: 先用一个密钥流分组处理到边界 */
+        if (skip != 0 && input_len > 0) {
+            uint8_t ks[SM4_BLOCK_SIZE];
+            size_t n = SM4_BLOCK_SIZE - skip < input_len ? SM4_BLOCK_SIZE - skip : input_len;
+
+            keystream(ctx, counter, ks, 1);
+            xor_bytes(output, input, ks + skip, n);
+            input += n;
+            output += n;
+            input_len -= n;
+            memset(ks, 0, sizeof(ks));
+        }
+
+        xor_stream(ctx, counter, input, input_len, output);
+        memset(counter, 0, sizeof(counter));
+    }
+};
+
+/*
+ * GCM模式，GHASH实现由Ghash提供:
+ *   Ghash::key: 由H预计算的乘法表，每个密钥只构造一次
+ *   Ghash::init(k, h): 由H构造k
+ *   Ghash::update(k, x, data, len): 逐分组 x = (x ^ block) * H，末尾不足16字节补零
+ *   Ghash::mul(x, k): x = x * H
+ */
+template <class Ghash, size_t Batch = BATCH_BLOCKS, class Store = store_cached> struct gcm_base {
+    typedef ctr<inc32, Batch> gctr;
+    typedef typename Ghash::key hkey;
+
+    /* 计算H = E(K, 0^128)并构造GHASH表，再计算J0 */
+    static void init(const sm4_context *ctx, const uint8_t *iv, size_t iv_len,
+                     hkey *hk, uint8_t *j0)
+    {
+        uint8_t h[16];
+
+        memset(h, 0, 16);
+        sm4_crypt_block(ctx, h, h);
+        Ghash::init(hk, h);
+        memset(h, 0, sizeof(h));
+
+        if (iv_len == 12) {
+            /* 推荐的IV长度 */
+            memcpy(j0, iv, 12);
+            j0[12] = j0[13] = j0[14] = 0;
+            j0[15] = 1;
+        } else {
+            /* 其他IV长度: J0 = GHASH(IV || 0* || len(IV)) */
+            uint64_t iv_bits = (uint64_t)iv_len * 8;
+            int j;
+
+            memset(j0, 0, 16);
+            Ghash::update(hk, j0, iv, iv_len);
+            for (j = 0; j < 8; j++) {
+                j0[15 - j] ^= (uint8_t)(iv_bits >> (j * 8));
+            }
+            Ghash::mul(j0, hk);
+        }
+    }
+
+    /*
+     * 拼接CTR与GHASH: 每批Batch个分组生成密钥流后，在同一循环中完成异或与GHASH，
+     * 数据只读一遍且批量数据保持在L1中；GHASH的输入始终是密文
+     * (解密时先读输入，加密时读本批结果)，因此允许input与output相同。
+     * counter返回时指向下一个未使用的计数器块；除最后一次调用外input_len须为16的倍数。
+     */
+    template <direction D>
+    static void crypt_hash(const sm4_context *ctx, const hkey *hk, uint8_t *counter, uint8_t *s,
+                           const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        uint8_t ks[Batch * SM4_BLOCK_SIZE];
+        size_t i;
+
+        for (i = 0; i < input_len; i += sizeof(ks)) {
+            size_t n = input_len - i < sizeof(ks) ? input_len - i : sizeof(ks);
+
+            Store::prefetch(input + i + sizeof(ks), sizeof(ks));
+            gctr::keystream(ctx, counter, ks, (n + SM4_BLOCK_SIZE - 1) / SM4_BLOCK_SIZE);
+            if (D == DECRYPT) {
+                Ghash::update(hk, s, input + i, n);
+            }
+            if (n == sizeof(ks)) {
+                xor_n<sizeof(ks)>(ks, ks, input + i);
+            } else {
+                xor_bytes(ks, ks, input + i, n);
+            }
+            if (D == ENCRYPT) {
+                Ghash::update(hk, s, ks, n);
+            }
+            Store::copy_out(output + i, ks, n);
+        }
+        Store::finish();
+
+        memset(ks, 0, sizeof(ks));
+    }
+
+    /* 折入长度分组 len(AAD) || len(C)，Tag = E(K, J0) ^ S */
+    static void finish(const sm4_context *ctx, const hkey *hk, const uint8_t *j0,
+                       uint64_t aad_len, uint64_t cipher_len, uint8_t *s, uint8_t *tag_out)
+    {
+        uint8_t len_block[16];
+        uint8_t counter[16];
+        int i;
+
+        for (i = 0; i < 8; i++) {
+            len_block[i] = (uint8_t)((aad_len * 8) >> (56 - i * 8));
+            len_block[8 + i] = (uint8_t)((cipher_len * 8) >> (56 - i * 8));
+        }
+        Ghash::update(hk, s, len_block, sizeof(len_block));
+
+        memcpy(counter, j0, 16);
+        gctr::xor_stream(ctx, counter, s, 16, tag_out);
+        memset(counter, 0, sizeof(counter));
+    }
+
+    /* 单次调用: AAD的GHASH、拼接的CTR+GHASH、长度分组与Tag */
+    template <direction D>
+    static int seal(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len,
+                    uint8_t *output, uint8_t *tag_out)
+    {
+        sm4_context ctx;
+        hkey hk;
+        uint8_t j0[16];
+        uint8_t counter[16];
+        uint8_t s[16];
+
+        /* GCM解密同样使用加密方向的分组运算 */
+        schedule<ENCRYPT>::setkey(&ctx, key);
+        init(&ctx, iv, iv_len, &hk, j0);
+
+        memset(s, 0, sizeof(s));
+        if (aad && aad_len > 0) {
+            Ghash::update(&hk, s, aad, aad_len);
+        }
+
+        memcpy(counter, j0, 16);
+        inc32::next(counter);
+        crypt_hash<D>(&ctx, &hk, counter, s, input, input_len, output);
+        finish(&ctx, &hk, j0, aad_len, input_len, s, tag_out);
+
+        /* 清零敏感数据 */
+        sm4_context_clean(&ctx);
+        memset(&hk, 0, sizeof(hk));
+        memset(j0, 0, sizeof(j0));
+        memset(counter, 0, sizeof(counter));
+        memset(s, 0, sizeof(s));
+        return 0;
+    }
+
+    /*
+     * 单次调用解密: 先对密文做一遍GHASH并常量时间验证Tag，通过后再做CTR解密；
+     * 认证失败时output不被写入，原地解密也不会破坏调用者的密文
+     */
+    static int open(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                    const uint8_t *aad, size_t aad_len,
+                    const uint8_t *input, size_t input_len,
+                    const uint8_t *tag, uint8_t *output)
+    {
+        sm4_context ctx;
+        hkey hk;
+        uint8_t j0[16];
+        uint8_t counter[16];
+        uint8_t s[16];
+        uint8_t computed_tag[16];
+        uint8_t diff = 0;
+        int i;
+
+        schedule<ENCRYPT>::setkey(&ctx, key);
+        init(&ctx, iv, iv_len, &hk, j0);
+
+        memset(s, 0, sizeof(s));
+        if (aad && aad_len > 0) {
+            Ghash::update(&hk, s, aad, aad_len);
+        }
+        Ghash::update(&hk, s, input, input_len);
+        finish(&ctx, &hk, j0, aad_len, input_len, s, computed_tag);
+
+        /* 常量时间验证Tag，防止时序侧信道攻击 (Feature-3) */
+        for (i = 0; i < 16; i++) {
+            diff |= computed_tag[i] ^ tag[i];
+        }
+        if (diff == 0) {
+            memcpy(counter, j0, 16);
+            inc32::next(counter);
+            ctr<inc32, Batch, Store>::xor_stream(&ctx, counter, input, input_len, output);
+        }
+
+        /* 清零敏感数据 */
+        sm4_context_clean(&ctx);
+        memset(&hk, 0, sizeof(hk));
+        memset(j0, 0, sizeof(j0));
+        memset(counter, 0, sizeof(counter));
+        memset(s, 0, sizeof(s));
+        memset(computed_tag, 0, sizeof(computed_tag));
+        return diff == 0 ? 0 : -1;  /* 认证失败返回-1 */
+    }
+};
+
+template <direction D, class Ghash, size_t Batch = BATCH_BLOCKS, class Store = store_cached> struct gcm;
+
+/* 加密: CTR与GHASH拼接，单遍完成 */
+template <class Ghash, size_t Batch, class Store>
+struct gcm<ENCRYPT, Ghash, Batch, Store> : gcm_base<Ghash, Batch, Store> {
+    typedef gcm_base<Ghash, Batch, Store> base;
+
+    static int run(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                   const uint8_t *aad, size_t aad_len,
+                   const uint8_t *input, size_t input_len,
+                   uint8_t *output, uint8_t *tag)
+    {
+        if (!key || !iv || !output || !tag) {
+            return -1;
+        }
+
+        return base::template seal<ENCRYPT>(key, iv, iv_len, aad, aad_len, input, input_len,
+                                            output, tag);
+    }
+};
+
+/* 解密: 先验证Tag再解密，认证失败时不写output */
+template <class Ghash, size_t Batch, class Store>
+struct gcm<DECRYPT, Ghash, Batch, Store> : gcm_base<Ghash, Batch, Store> {
+    typedef gcm_base<Ghash, Batch, Store> base;
+
+    static int run(const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                   const uint8_t *aad, size_t aad_len,
+                   const uint8_t *input, size_t input_len,
+                   const uint8_t *tag, uint8_t *output)
+    {
+        if (!key || !iv || !input || !tag || !output) {
+            return -1;
+        }
+
+        return base::open(key, iv, iv_len, aad, aad_len, input, input_len, tag, output);
+    }
+};
+
+/*
+ * 流式GCM: 上下文中保存GHASH表、累加值与计数器，
+ * 不完整的分组(AAD或密文)及其密钥流跨调用保留
+ */
+template <class Ghash, size_t Batch = BATCH_BLOCKS, class Store = store_cached> struct gcm_stream {
+    typedef gcm_base<Ghash, Batch, Store> base;
+    typedef typename Ghash::key hkey;
+
+    static hkey *hkey_of(sm4_gcm_ctx *c) { return (hkey *)c->ghash_key; }
+
+    static int init(sm4_gcm_ctx *c, const uint8_t *key, const uint8_t *iv, size_t iv_len,
+                    int decrypt)
+    {
+        if (!c || !key || !iv) {
+            return -1;
+        }
+
+        schedule<ENCRYPT>::setkey(&c->ks, key);
+        base::init(&c->ks, iv, iv_len, hkey_of(c), c->j0);
+        memcpy(c->counter, c->j0, SM4_BLOCK_SIZE);
+        inc32::next(c->counter);
+        memset(c->s, 0, SM4_BLOCK_SIZE);
+        c->buf_len = 0;
+        c->aad_len = 0;
+        c->data_len = 0;
+        c->phase = 0;
+        c->decrypt = decrypt ? 1 : 0;
+        return 0;
+    }
+
+    static int aad(sm4_gcm_ctx *c, const uint8_t *aad, size_t aad_len)
+    {
+        size_t n;
+
+        if (!c || (!aad && aad_len > 0) || c->phase != 0) {
+            return -1;
+        }
+        c->aad_len += aad_len;
+
+        /* 先补满上次剩余的不完整分组 */
+        if (c->buf_len > 0) {
+            n = SM4_BLOCK_SIZE - c->buf_len < aad_len ? SM4_BLOCK_SIZE - c->buf_len : aad_len;
+            memcpy(c->buf + c->buf_len, aad, n);
+            c->buf_len += n;
+            aad += n;
+            aad_len -= n;
+            if (c->buf_len < SM4_BLOCK_SIZE) {
+                return 0;
+            }
+            Ghash::update(hkey_of(c), c->s, c->buf, SM4_BLOCK_SIZE);
+            c->buf_len = 0;
+        }
+
+        n = aad_len / SM4_BLOCK_SIZE * SM4_BLOCK_SIZE;
+        Ghash::update(hkey_of(c), c->s, aad, n);
+        c->buf_len = aad_len - n;
+        memcpy(c->buf, aad + n, c->buf_len);
+        return 0;
+    }
+
+    /* AAD结束: 不完整的AAD分组补零后计入GHASH */
+    static void end_aad(sm4_gcm_ctx *c)
+    {
+        if (c->phase == 0) {
+            Ghash::update(hkey_of(c), c->s, c->buf, c->buf_len);
+            c->buf_len = 0;
+            c->phase = 1;
+        }
+    }
+
+    /* 用ctr_ks中剩余的密钥流处理n字节，密文记入buf */
+    static void partial(sm4_gcm_ctx *c, const uint8_t *input, size_t n, uint8_t *output)
+    {
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+            uint8_t in = input[i];
+            uint8_t out = in ^ c->ctr_ks[c->buf_len + i];
+
+            output[i] = out;
+            c->buf[c->buf_len + i] = c->decrypt ? in : out;
+        }
+        c->buf_len += n;
+    }
+
+    static int update(sm4_gcm_ctx *c, const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        size_t n;
+
+        if (!c || ((!input || !output) && input_len > 0)) {
+            return -1;
+        }
+        end_aad(c);
+        c->data_len += input_len;
+
+        /* 先补满上次剩余的不完整分组 */
+        if (c->buf_len > 0) {
+            n = SM4_BLOCK_SIZE - c->buf_len < input_len ? SM4_BLOCK_SIZE - c->buf_len : input_len;
+            partial(c, input, n, output);
+            input += n;
+            output += n;
+            input_len -= n;
+            if (c->buf_len < SM4_BLOCK_SIZE) {
+                return 0;
+            }
+            Ghash::update(hkey_of(c), c->s, c->buf, SM4_BLOCK_SIZE);
+            c->buf_len = 0;
+        }
+
+        /* 完整分组直接走拼接的CTR+GHASH */
+        n = input_len / SM4_BLOCK_SIZE * SM4_BLOCK_SIZE;
+        if (n > 0) {
+            if (c->decrypt) {
+                base::template crypt_hash<DECRYPT>(&c->ks, hkey_of(c), c->counter, c->s, input, n, output);
+            } else {
+                base::template crypt_hash<ENCRYPT>(&c->ks, hkey_of(c), c->counter, c->s, input, n, output);
+            }
+        }
+
+        /* 剩余不足一个分组: 生成其密钥流，未用完的部分留给下次调用 */
+        if (n < input_len) {
+            base::gctr::keystream(&c->ks, c->counter, c->ctr_ks, 1);
+            partial(c, input + n, input_len - n, output + n);
+        }
+        return 0;
+    }
+
+    static int final(sm4_gcm_ctx *c, uint8_t *tag)
+    {
+        if (!c) {
+            return -1;
+        }
+        if (!tag) {
+            memset(c, 0, sizeof(*c));
+            return -1;
+        }
+
+        end_aad(c);
+        Ghash::update(hkey_of(c), c->s, c->buf, c->buf_len);
+        base::finish(&c->ks, hkey_of(c), c->j0, c->aad_len, c->data_len, c->s, tag);
+
+        /* 清零敏感数据(含轮密钥与GHASH表) */
+        memset(c, 0, sizeof(*c));
+        return 0;
+    }
+
+    static int final_verify(sm4_gcm_ctx *c, const uint8_t *tag)
+    {
+        uint8_t computed_tag[16];
+        uint8_t diff = 0;
+        int i;
+
+        if (!tag) {
+            if (c) {
+                memset(c, 0, sizeof(*c));
+            }
+            return -1;
+        }
+        if (final(c, computed_tag) != 0) {
+            return -1;
+        }
+
+        /* 常量时间验证Tag */
+        for (i = 0; i < 16; i++) {
+            diff |= computed_tag[i] ^ tag[i];
+        }
+        memset(computed_tag, 0, sizeof(computed_tag));
+        return diff == 0 ? 0 : -1;
+    }
+};
+
+/*
+ * XTS模式(IEEE 1619): 数据单元(页)号经tweak密钥加密得到T0，第j块使用
+ * T(j) = T0·α^j (GF(2^128)，小端位序，约减多项式x^128 + x^7 + x^2 + x + 1)，
+ * C = E(K1, P ^ T) ^ T；末尾不足一块时用密文窃取，输出与输入等长。
+ * tweak的生成方式由Tweak提供:
+ *   Tweak::next(t): t = t·α
+ *   Tweak::whiten(t, tweaks, in, out, n): 第j块的tweak t·α^j写入tweaks，同时
+ *     out = in ^ tweak；返回时t = t·α^n。tweak生成与输入异或在同一遍中完成
+ */
+
+/* 可移植的tweak倍乘: 两个64位字左移1位，移出的最高位折回为0x87 */
+struct xts_tweak {
+    static uint64_t load_le64(const uint8_t *p)
+    {
+        uint64_t v = 0;
+
+        for (int i = 7; i >= 0; i--) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    static void store_le64(uint8_t *p, uint64_t v)
+    {
+        for (int i = 0; i < 8; i++) {
+            p[i] = (uint8_t)(v >> (i * 8));
+        }
+    }
+
+    static void next(uint8_t *t)
+    {
+        uint64_t lo = load_le64(t);
+        uint64_t hi = load_le64(t + 8);
+        uint64_t carry = 0 - (hi >> 63);
+
+        store_le64(t + 8, (hi << 1) | (lo >> 63));
+        store_le64(t, (lo << 1) ^ (carry & 0x87));
+    }
+
+    static void whiten(uint8_t *t, uint8_t *tweaks, const uint8_t *in, uint8_t *out, size_t n)
+    {
+        for (size_t j = 0; j < n; j++) {
+            memcpy(tweaks + j * SM4_BLOCK_SIZE, t, SM4_BLOCK_SIZE);
+            xor_n<SM4_BLOCK_SIZE>(out + j * SM4_BLOCK_SIZE, in + j * SM4_BLOCK_SIZE, t);
+            next(t);
+        }
+    }
+};
+
+template <direction D, class Tweak = xts_tweak, size_t Batch = BATCH_BLOCKS,
+          class Store = store_cached> struct xts {
+    /* 单块: out = E(P ^ T) ^ T，方向由ctx的轮密钥决定 */
+    static void one(const sm4_context *ctx, const uint8_t *t, const uint8_t *in, uint8_t *out)
+    {
+        uint8_t b[SM4_BLOCK_SIZE];
+
+        xor_n<SM4_BLOCK_SIZE>(b, in, t);
+        sm4_crypt_block(ctx, b, b);
+        xor_n<SM4_BLOCK_SIZE>(out, b, t);
+        memset(b, 0, sizeof(b));
+    }
+
+    /* 完整分组: 每批生成Batch个tweak并与输入异或，经并行内核一次处理，再异或写出 */
+    static void blocks(const sm4_context *ctx, uint8_t *t, const uint8_t *input, uint8_t *output,
+                       size_t nblocks)
+    {
+        uint8_t tw[Batch * SM4_BLOCK_SIZE];
+        uint8_t buf[Batch * SM4_BLOCK_SIZE];
+        size_t i = 0;
+
+        for (; nblocks - i >= Batch; i += Batch) {
+            const uint8_t *in = input + i * SM4_BLOCK_SIZE;
+
+            Store::prefetch(in + sizeof(buf), sizeof(buf));
+            Tweak::whiten(t, tw, in, buf, Batch);
+            sm4_crypt_blocks(ctx, buf, buf, Batch);
+            Store::template xor_block<sizeof(buf)>(output + i * SM4_BLOCK_SIZE, buf, tw);
+        }
+        if (i < nblocks) {
+            size_t n = (nblocks - i) * SM4_BLOCK_SIZE;
+
+            Tweak::whiten(t, tw, input + i * SM4_BLOCK_SIZE, buf, nblocks - i);
+            sm4_crypt_blocks(ctx, buf, buf, nblocks - i);
+            Store::xor_out(output + i * SM4_BLOCK_SIZE, buf, tw, n);
+        }
+        Store::finish();
+
+        memset(tw, 0, sizeof(tw));
+        memset(buf, 0, sizeof(buf));
+    }
+
+    /*
+     * 密文窃取: in/out指向倒数第二个完整分组，r为最后不完整分组的长度。
+     * 加密时倒数第二块用T(m-1)，其密文的前r字节成为最后一块；解密时tweak顺序相反
+     */
+    static void steal(const sm4_context *ctx, const uint8_t *t, const uint8_t *in, uint8_t *out,
+                      size_t r)
+    {
+        uint8_t t_next[SM4_BLOCK_SIZE];
+        uint8_t cc[SM4_BLOCK_SIZE];
+        uint8_t pp[SM4_BLOCK_SIZE];
+
+        memcpy(t_next, t, SM4_BLOCK_SIZE);
+        Tweak::next(t_next);
+
+        one(ctx, D == ENCRYPT ? t : t_next, in, cc);
+        memcpy(pp, in + SM4_BLOCK_SIZE, r);
+        memcpy(pp + r, cc + r, SM4_BLOCK_SIZE - r);
+        memcpy(out + SM4_BLOCK_SIZE, cc, r);
+        one(ctx, D == ENCRYPT ? t_next : t, pp, out);
+
+        memset(t_next, 0, sizeof(t_next));
+        memset(cc, 0, sizeof(cc));
+        memset(pp, 0, sizeof(pp));
+    }
+
+    /*
+     * 加密/解密一个数据单元: data为按方向扩展的K1，tweak为加密方向的K2，
+     * sector按小端编码为128位数据单元号；input_len至少16字节
+     */
+    static int run(const sm4_context *data, const sm4_context *tweak, uint64_t sector,
+                   const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        uint8_t t[SM4_BLOCK_SIZE];
+        size_t r = input_len % SM4_BLOCK_SIZE;
+        size_t full = input_len / SM4_BLOCK_SIZE - (r != 0 ? 1 : 0);
+
+        if (!data || !tweak || !input || !output || input_len < SM4_BLOCK_SIZE) {
+            return -1;
+        }
+
+        memset(t, 0, sizeof(t));
+        xts_tweak::store_le64(t, sector);
+        sm4_crypt_block(tweak, t, t);
+
+        blocks(data, t, input, output, full);
+        if (r != 0) {
+            steal(data, t, input + full * SM4_BLOCK_SIZE, output + full * SM4_BLOCK_SIZE, r);
+        }
+
+        memset(t, 0, sizeof(t));
+        return 0;
+    }
+};
+
+/*
+ * CMAC(NIST SP 800-38B)，SM4为分组密码: 子密钥K1 = L·x、K2 = L·x^2 (L = E(K, 0^128))，
+ * 最后一块为完整分组时异或K1，否则按10*填充后异或K2
+ */
+struct cmac {
+    /* GF(2^128)倍乘，大端位序: 整体左移1位，移出最高位时末字节异或0x87 */
+    static void dbl(uint8_t *b)
+    {
+        uint8_t carry = (uint8_t)(0 - (b[0] >> 7));
+
+        for (int i = 0; i < SM4_BLOCK_SIZE - 1; i++) {
+            b[i] = (uint8_t)((b[i] << 1) | (b[i + 1] >> 7));
+        }
+        b[SM4_BLOCK_SIZE - 1] = (uint8_t)((b[SM4_BLOCK_SIZE - 1] << 1) ^ (carry & 0x87));
+    }
+
+    static void subkeys(const sm4_context *ctx, uint8_t *k1, uint8_t *k2)
+    {
+        memset(k1, 0, SM4_BLOCK_SIZE);
+        sm4_crypt_block(ctx, k1, k1);
+        dbl(k1);
+        memcpy(k2, k1, SM4_BLOCK_SIZE);
+        dbl(k2);
+    }
+
+    /* CBC-MAC吸收nblocks个非最后的完整分组: x = E(x ^ block) */
+    static void blocks(const sm4_context *ctx, uint8_t *x, const uint8_t *data, size_t nblocks)
+    {
+        for (size_t i = 0; i < nblocks; i++) {
+            xor_n<SM4_BLOCK_SIZE>(x, x, data + i * SM4_BLOCK_SIZE);
+            sm4_crypt_block(ctx, x, x);
+        }
+    }
+
+    /* 吸收剩余数据(len可为0)，其中最后0~16字节作为最后一块，x为最终MAC */
+    static void tail(const sm4_context *ctx, const uint8_t *k1, const uint8_t *k2, uint8_t *x,
+                     const uint8_t *data, size_t len)
+    {
+        size_t n = len > 0 ? (len - 1) / SM4_BLOCK_SIZE : 0;
+        size_t r = len - n * SM4_BLOCK_SIZE;
+
+        blocks(ctx, x, data, n);
+        data += n * SM4_BLOCK_SIZE;
+        if (r == SM4_BLOCK_SIZE) {
+            xor_n<SM4_BLOCK_SIZE>(x, x, data);
+            xor_n<SM4_BLOCK_SIZE>(x, x, k1);
+        } else {
+            xor_bytes(x, x, data, r);
+            x[r] ^= 0x80;
+            xor_n<SM4_BLOCK_SIZE>(x, x, k2);
+        }
+        sm4_crypt_block(ctx, x, x);
+    }
+
+    static void mac(const sm4_context *ctx, const uint8_t *k1, const uint8_t *k2,
+                    const uint8_t *data, size_t len, uint8_t *out)
+    {
+        memset(out, 0, SM4_BLOCK_SIZE);
+        tail(ctx, k1, k2, out, data, len);
+    }
+};
+
+/*
+ * SIV模式(RFC 5297): 确定性认证加密，相同的(密钥, AAD, 明文)总得到相同的密文。
+ * 密钥为K1 || K2: V = S2V(K1, AAD, P)同时作为认证标签与CTR的初始计数器
+ * (清除第63、31位)，C = CTR(K2, V, P)；输出V || C。
+ * aad为NULL时S2V不含关联数据分量，非NULL(即使长度为0)时作为一个分量。
+ */
+template <size_t Batch = BATCH_BLOCKS, class Store = store_cached> struct siv_base {
+    typedef ctr<inc128, Batch, Store> sctr;
+
+    /* S2V: D = CMAC(0)，每个AAD分量D = dbl(D) ^ CMAC(AAD)，最后与明文合并后再做一次CMAC */
+    static void s2v(const sm4_context *mac, const uint8_t *aad, size_t aad_len,
+                    const uint8_t *p, size_t p_len, uint8_t *v)
+    {
+        static const uint8_t zero[SM4_BLOCK_SIZE] = {0};
+        uint8_t k1[SM4_BLOCK_SIZE], k2[SM4_BLOCK_SIZE];
+        uint8_t d[SM4_BLOCK_SIZE], t[SM4_BLOCK_SIZE];
+        uint8_t last[2 * SM4_BLOCK_SIZE];
+
+        cmac::subkeys(mac, k1, k2);
+        cmac::mac(mac, k1, k2, zero, SM4_BLOCK_SIZE, d);
+        if (aad) {
+            cmac::dbl(d);
+            cmac::mac(mac, k1, k2, aad, aad_len, t);
+            xor_n<SM4_BLOCK_SIZE>(d, d, t);
+        }
+
+        memset(v, 0, SM4_BLOCK_SIZE);
+        if (p_len >= SM4_BLOCK_SIZE) {
+            /* T = P xorend D: 只在栈上复制最后16~31字节，其余分组直接从P吸收 */
+            size_t head = (p_len - SM4_BLOCK_SIZE) / SM4_BLOCK_SIZE * SM4_BLOCK_SIZE;
+            size_t rem = p_len - head;
+
+            cmac::blocks(mac, v, p, head / SM4_BLOCK_SIZE);
+            memcpy(last, p + head, rem);
+            xor_n<SM4_BLOCK_SIZE>(last + rem - SM4_BLOCK_SIZE, last + rem - SM4_BLOCK_SIZE, d);
+            cmac::tail(mac, k1, k2, v, last, rem);
+        } else {
+            /* T = dbl(D) ^ pad(P) */
+            cmac::dbl(d);
+            memset(t, 0, sizeof(t));
+            memcpy(t, p, p_len);
+            t[p_len] = 0x80;
+            xor_n<SM4_BLOCK_SIZE>(t, t, d);
+            cmac::tail(mac, k1, k2, v, t, SM4_BLOCK_SIZE);
+        }
+
+        memset(k1, 0, sizeof(k1));
+        memset(k2, 0, sizeof(k2));
+        memset(d, 0, sizeof(d));
+        memset(t, 0, sizeof(t));
+        memset(last, 0, sizeof(last));
+    }
+
+    /* Q = V，清除第63、31位(兼容只支持32/64位计数器加法的实现) */
+    static void crypt(const sm4_context *enc, const uint8_t *v,
+                      const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        uint8_t q[SM4_BLOCK_SIZE];
+
+        memcpy(q, v, SM4_BLOCK_SIZE);
+        q[8] &= 0x7f;
+        q[12] &= 0x7f;
+        sctr::xor_stream(enc, q, input, input_len, output);
+        memset(q, 0, sizeof(q));
+    }
+};
+
+template <direction D, size_t Batch = BATCH_BLOCKS, class Store = store_cached> struct siv;
+
+/* 加密: output = V(16字节) || C，C与明文等长 */
+template <size_t Batch, class Store>
+struct siv<ENCRYPT, Batch, Store> : siv_base<Batch, Store> {
+    typedef siv_base<Batch, Store> base;
+
+    static int run(const uint8_t *key, const uint8_t *aad, size_t aad_len,
+                   const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        sm4_context mac, enc;
+        uint8_t v[SM4_BLOCK_SIZE];
+
+        if (!key || !output || (!input && input_len > 0)) {
+            return -1;
+        }
+
+        schedule<ENCRYPT>::setkey(&mac, key);
+        schedule<ENCRYPT>::setkey(&enc, key + SM4_KEY_SIZE);
+        base::s2v(&mac, aad, aad_len, input, input_len, v);
+        base::crypt(&enc, v, input, input_len, output + SM4_BLOCK_SIZE);
+        memcpy(output, v, SM4_BLOCK_SIZE);
+
+        sm4_context_clean(&mac);
+        sm4_context_clean(&enc);
+        memset(v, 0, sizeof(v));
+        return 0;
+    }
+};
+
+/* 解密: 先用V解密，再由明文重新计算V并以常量时间比较，失败时清零已写出的明文 */
+template <size_t Batch, class Store>
+struct siv<DECRYPT, Batch, Store> : siv_base<Batch, Store> {
+    typedef siv_base<Batch, Store> base;
+
+    static int run(const uint8_t *key, const uint8_t *aad, size_t aad_len,
+                   const uint8_t *input, size_t input_len, uint8_t *output)
+    {
+        sm4_context mac, enc;
+        uint8_t v[SM4_BLOCK_SIZE], computed[SM4_BLOCK_SIZE];
+        size_t plain_len;
+        uint8_t diff = 0;
+        int i;
+
+        if (!key || !input || input_len < SM4_BLOCK_SIZE ||
+            (!output && input_len > SM4_BLOCK_SIZE)) {
+            return -1;
+        }
+        plain_len = input_len - SM4_BLOCK_SIZE;
+
+        /* 先保存V，允许output与input + 16重叠(原地解密) */
+        memcpy(v, input, SM4_BLOCK_SIZE);
+        schedule<ENCRYPT>::setkey(&mac, key);
+        schedule<ENCRYPT>::setkey(&enc, key + SM4_KEY_SIZE);
+        base::crypt(&enc, v, input + SM4_BLOCK_SIZE, plain_len, output);
+        base::s2v(&mac, aad, aad_len, output, plain_len, computed);
+
+        for (i = 0; i < SM4_BLOCK_SIZE; i++) {
+            diff |= computed[i] ^ v[i];
+        }
+        if (diff != 0 && plain_len > 0) {
+            memset(output, 0, plain_len);
+        }
+
+        sm4_context_clean(&mac);
+        sm4_context_clean(&enc);
+        memset(v, 0, sizeof(v));
+        memset(computed, 0, sizeof(computed));
+        return diff == 0 ? 0 : -1;
+    }
+};
+
+} /* namespace sm4 */
+
+#endif /* SM4_HPP */
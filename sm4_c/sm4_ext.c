@@ -7,6 +7,8 @@
 #include "fmgr.h"
 #include "utils/builtins.h"
 #include "mb/pg_wchar.h"
+#include "utils/array.h"
+#include "catalog/pg_type.h"
 #include "sm4.h"
 #include <string.h>
 #include <stdlib.h>
@@ -19,6 +21,9 @@ PG_FUNCTION_INFO_V1(sm4_encrypt);
 PG_FUNCTION_INFO_V1(sm4_decrypt);
 PG_FUNCTION_INFO_V1(sm4_encrypt_cbc);
 PG_FUNCTION_INFO_V1(sm4_decrypt_cbc);
+PG_FUNCTION_INFO_V1(sm4_encrypt_cbc_batch);
+PG_FUNCTION_INFO_V1(sm4_encrypt_multi);
+PG_FUNCTION_INFO_V1(sm4_decrypt_multi);
 PG_FUNCTION_INFO_V1(sm4_encrypt_hex);
 PG_FUNCTION_INFO_V1(sm4_decrypt_hex);
 PG_FUNCTION_INFO_V1(sm4_encrypt_gcm);
@@ -29,6 +34,28 @@ PG_FUNCTION_INFO_V1(sm4_encrypt_gcm_auto_iv);
 PG_FUNCTION_INFO_V1(sm4_decrypt_gcm_auto_iv);
 PG_FUNCTION_INFO_V1(sm4_encrypt_gcm_auto_iv_base64);
 PG_FUNCTION_INFO_V1(sm4_decrypt_gcm_auto_iv_base64);
+PG_FUNCTION_INFO_V1(sm4_encrypt_gcm_large);
+PG_FUNCTION_INFO_V1(sm4_decrypt_gcm_large);
+PG_FUNCTION_INFO_V1(sm4_encrypt_ctr);
+PG_FUNCTION_INFO_V1(sm4_decrypt_ctr);
+PG_FUNCTION_INFO_V1(sm4_decrypt_ctr_range);
+PG_FUNCTION_INFO_V1(sm4_encrypt_siv);
+PG_FUNCTION_INFO_V1(sm4_decrypt_siv);
+PG_FUNCTION_INFO_V1(sm4_kernel);
+
+/* sm4_c_encrypt_gcm_large/sm4_c_decrypt_gcm_large允许的最大线程数 */
+#define SM4_GCM_MAX_THREADS 64
+
+extern "C" void _PG_init(void);
+
+/*
+ * 扩展加载时初始化: 探测CPU特性并选择SM4内核，
+ * 避免在第一次查询中付出自检开销
+ */
+void _PG_init(void)
+{
+    sm4_init();
+}
 
 /* 工具函数: 单个十六进制字符转数值，返回-1表示非法字符 */
 static int hex_char_to_val(char c)
@@ -104,6 +131,75 @@ static int get_key_bytes(text *key_text, uint8_t *key_bytes)
     return 0;
 }
 
+/* 验证并获取16字节CBC初始向量 */
+static int get_iv_bytes(text *iv_text, uint8_t *iv_bytes)
+{
+    char *iv_str = text_to_cstring(iv_text);
+    size_t iv_len = strlen(iv_str);
+    int ret = 0;
+
+    if (iv_len == 16) {
+        memcpy(iv_bytes, iv_str, 16);
+    } else if (iv_len == 32) {
+        size_t bytes_len;
+        if (hex_to_bytes(iv_str, 32, iv_bytes, &bytes_len) != 0) {
+            ret = -1;
+        }
+    } else {
+        ret = -1;
+    }
+
+    memset(iv_str, 0, iv_len);
+    pfree(iv_str);
+    return ret;
+}
+
+/* 验证并获取GCM初始向量: 12/16字节字符串或24/32位十六进制 */
+static int get_gcm_iv_bytes(text *iv_text, uint8_t *iv_bytes, size_t *iv_bytes_len)
+{
+    char *iv_str = text_to_cstring(iv_text);
+    size_t iv_len = strlen(iv_str);
+    int ret = 0;
+
+    if (iv_len == 12 || iv_len == 16) {
+        memcpy(iv_bytes, iv_str, iv_len);
+        *iv_bytes_len = iv_len;
+    } else if (iv_len == 24 || iv_len == 32) {
+        if (hex_to_bytes(iv_str, iv_len, iv_bytes, iv_bytes_len) != 0) {
+            ret = -1;
+        }
+    } else {
+        ret = -1;
+    }
+
+    memset(iv_str, 0, iv_len);
+    pfree(iv_str);
+    return ret;
+}
+
+/* 验证并获取32字节SIV密钥(32字节字符串或64位十六进制) */
+static int get_siv_key_bytes(text *key_text, uint8_t *key_bytes)
+{
+    char *key_str = text_to_cstring(key_text);
+    size_t key_len = strlen(key_str);
+    int ret = 0;
+
+    if (key_len == SM4_SIV_KEY_SIZE) {
+        memcpy(key_bytes, key_str, SM4_SIV_KEY_SIZE);
+    } else if (key_len == SM4_SIV_KEY_SIZE * 2) {
+        size_t bytes_len;
+        if (hex_to_bytes(key_str, key_len, key_bytes, &bytes_len) != 0) {
+            ret = -1;
+        }
+    } else {
+        ret = -1;
+    }
+
+    memset(key_str, 0, key_len);
+    pfree(key_str);
+    return ret;
+}
+
 /*
  * sm4_encrypt(plaintext text, key text) -> bytea
  * ECB模式加密，返回二进制数据
@@ -406,6 +502,405 @@ sm4_decrypt_cbc(PG_FUNCTION_ARGS)
     PG_RETURN_TEXT_P(result);
 }
 
+/*
+ * sm4_encrypt_cbc_batch(plaintexts text[], key text, iv text) -> bytea[]
+ * CBC模式批量加密: 各元素为独立消息，按分组步调一致地经并行内核加密，
+ * 结果与逐个调用sm4_encrypt_cbc相同(NULL或空字符串元素返回NULL)
+ */
+extern "C" Datum
+sm4_encrypt_cbc_batch(PG_FUNCTION_ARGS)
+{
+    ArrayType *plain_arr = PG_GETARG_ARRAYTYPE_P(0);
+    text *key = PG_GETARG_TEXT_PP(1);
+    text *iv_text = PG_GETARG_TEXT_PP(2);
+    uint8_t key_bytes[SM4_KEY_SIZE];
+    uint8_t iv_bytes[SM4_BLOCK_SIZE];
+    Datum *elems;
+    bool *nulls;
+    int nelems;
+    const uint8_t **ivs;
+    const uint8_t **inputs;
+    uint8_t **outputs;
+    size_t *input_lens;
+    size_t *output_lens;
+    int *rows;
+    Datum *result_elems;
+    bool *result_nulls;
+    int dims[1];
+    int lbs[1];
+    int i, n = 0;
+    int ret;
+
+    if (ARR_NDIM(plain_arr) > 1) {
+        ereport(ERROR,
+                (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+                 errmsg("SM4 CBC batch input must be a one-dimensional array")));
+    }
+
+    /* 获取密钥 */
+    if (get_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 获取IV */
+    if (get_iv_bytes(iv_text, iv_bytes) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 IV must be 16 bytes or 32 hex characters")));
+    }
+
+    deconstruct_array(plain_arr, TEXTOID, -1, false, 'i', &elems, &nulls, &nelems);
+    if (nelems == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(iv_bytes, 0, sizeof(iv_bytes));
+        PG_RETURN_ARRAYTYPE_P(construct_empty_array(BYTEAOID));
+    }
+
+    ivs = (const uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    inputs = (const uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    outputs = (uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    input_lens = (size_t *)palloc(nelems * sizeof(size_t));
+    output_lens = (size_t *)palloc(nelems * sizeof(size_t));
+    rows = (int *)palloc(nelems * sizeof(int));
+    result_elems = (Datum *)palloc(nelems * sizeof(Datum));
+    result_nulls = (bool *)palloc(nelems * sizeof(bool));
+
+    /* 非空元素直接加密到结果bytea的数据区 */
+    for (i = 0; i < nelems; i++) {
+        text *plain;
+        size_t plain_len;
+        bytea *cipher;
+
+        result_elems[i] = (Datum)0;
+        result_nulls[i] = true;
+        if (nulls[i]) {
+            continue;
+        }
+
+        plain = DatumGetTextPP(elems[i]);
+        plain_len = VARSIZE_ANY_EXHDR(plain);
+        if (plain_len == 0) {
+            continue;
+        }
+
+        cipher = (bytea *)palloc(VARHDRSZ + plain_len + SM4_BLOCK_SIZE);
+        ivs[n] = iv_bytes;
+        inputs[n] = (const uint8_t *)VARDATA_ANY(plain);
+        input_lens[n] = plain_len;
+        outputs[n] = (uint8_t *)VARDATA(cipher);
+        rows[n] = i;
+        result_elems[i] = PointerGetDatum(cipher);
+        result_nulls[i] = false;
+        n++;
+    }
+
+    /* 加密 */
+    ret = sm4_cbc_encrypt_multi(key_bytes, ivs, inputs, input_lens, outputs, output_lens, (size_t)n);
+    memset(key_bytes, 0, sizeof(key_bytes));
+    memset(iv_bytes, 0, sizeof(iv_bytes));
+    if (ret != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 CBC batch encryption failed")));
+    }
+
+    for (i = 0; i < n; i++) {
+        SET_VARSIZE(DatumGetPointer(result_elems[rows[i]]), VARHDRSZ + output_lens[i]);
+    }
+
+    /* 构造bytea[]结果，保持输入数组的下标 */
+    dims[0] = nelems;
+    lbs[0] = ARR_LBOUND(plain_arr)[0];
+
+    pfree(ivs);
+    pfree(inputs);
+    pfree(outputs);
+    pfree(input_lens);
+    pfree(output_lens);
+    pfree(rows);
+
+    PG_RETURN_ARRAYTYPE_P(construct_md_array(result_elems, result_nulls, 1, dims, lbs,
+                                             BYTEAOID, -1, false, 'i'));
+}
+
+/*
+ * 解析每行密钥数组: 与数据数组等长，密钥写入key_buf(每个SM4_KEY_SIZE字节)
+ * 数据或密钥为NULL的行不参与运算，key_nulls中标记为true
+ */
+static void get_multi_key_bytes(ArrayType *data_arr, ArrayType *key_arr, int nelems,
+                                uint8_t *key_buf, bool *key_nulls)
+{
+    Datum *key_elems;
+    bool *nulls;
+    int nkeys;
+    int i;
+
+    if (ARR_NDIM(key_arr) > 1) {
+        ereport(ERROR,
+                (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+                 errmsg("SM4 multi-key keys must be a one-dimensional array")));
+    }
+
+    deconstruct_array(key_arr, TEXTOID, -1, false, 'i', &key_elems, &nulls, &nkeys);
+    if (nkeys != nelems ||
+        (nelems > 0 && ARR_LBOUND(key_arr)[0] != ARR_LBOUND(data_arr)[0])) {
+        ereport(ERROR,
+                (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+                 errmsg("SM4 multi-key keys must have the same bounds as the data array")));
+    }
+
+    for (i = 0; i < nelems; i++) {
+        key_nulls[i] = nulls[i];
+        if (nulls[i]) {
+            continue;
+        }
+        if (get_key_bytes(DatumGetTextPP(key_elems[i]), key_buf + (size_t)i * SM4_KEY_SIZE) != 0) {
+            memset(key_buf, 0, (size_t)nelems * SM4_KEY_SIZE);
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                     errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+        }
+    }
+
+    pfree(key_elems);
+    pfree(nulls);
+}
+
+/*
+ * sm4_encrypt_multi(plaintexts text[], keys text[]) -> bytea[]
+ * ECB模式每行密钥批量加密: 第i条消息用第i个密钥，经多密钥内核同时加密，
+ * 结果与逐个调用sm4_encrypt相同(明文或密钥为NULL、明文为空字符串的元素返回NULL)
+ */
+extern "C" Datum
+sm4_encrypt_multi(PG_FUNCTION_ARGS)
+{
+    ArrayType *plain_arr = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType *key_arr = PG_GETARG_ARRAYTYPE_P(1);
+    Datum *elems;
+    bool *nulls;
+    int nelems;
+    uint8_t *key_buf;
+    bool *key_nulls;
+    const uint8_t **keys;
+    const uint8_t **inputs;
+    uint8_t **outputs;
+    size_t *input_lens;
+    size_t *output_lens;
+    int *rows;
+    Datum *result_elems;
+    bool *result_nulls;
+    int dims[1];
+    int lbs[1];
+    int i, n = 0;
+    int ret;
+
+    if (ARR_NDIM(plain_arr) > 1) {
+        ereport(ERROR,
+                (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+                 errmsg("SM4 multi-key input must be a one-dimensional array")));
+    }
+
+    deconstruct_array(plain_arr, TEXTOID, -1, false, 'i', &elems, &nulls, &nelems);
+
+    /* 获取密钥 */
+    key_buf = (uint8_t *)palloc((size_t)(nelems > 0 ? nelems : 1) * SM4_KEY_SIZE);
+    key_nulls = (bool *)palloc((nelems > 0 ? nelems : 1) * sizeof(bool));
+    get_multi_key_bytes(plain_arr, key_arr, nelems, key_buf, key_nulls);
+
+    if (nelems == 0) {
+        pfree(key_buf);
+        pfree(key_nulls);
+        PG_RETURN_ARRAYTYPE_P(construct_empty_array(BYTEAOID));
+    }
+
+    keys = (const uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    inputs = (const uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    outputs = (uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    input_lens = (size_t *)palloc(nelems * sizeof(size_t));
+    output_lens = (size_t *)palloc(nelems * sizeof(size_t));
+    rows = (int *)palloc(nelems * sizeof(int));
+    result_elems = (Datum *)palloc(nelems * sizeof(Datum));
+    result_nulls = (bool *)palloc(nelems * sizeof(bool));
+
+    /* 非空元素直接加密到结果bytea的数据区 */
+    for (i = 0; i < nelems; i++) {
+        text *plain;
+        size_t plain_len;
+        bytea *cipher;
+
+        result_elems[i] = (Datum)0;
+        result_nulls[i] = true;
+        if (nulls[i] || key_nulls[i]) {
+            continue;
+        }
+
+        plain = DatumGetTextPP(elems[i]);
+        plain_len = VARSIZE_ANY_EXHDR(plain);
+        if (plain_len == 0) {
+            continue;
+        }
+
+        cipher = (bytea *)palloc(VARHDRSZ + plain_len + SM4_BLOCK_SIZE);
+        keys[n] = key_buf + (size_t)i * SM4_KEY_SIZE;
+        inputs[n] = (const uint8_t *)VARDATA_ANY(plain);
+        input_lens[n] = plain_len;
+        outputs[n] = (uint8_t *)VARDATA(cipher);
+        rows[n] = i;
+        result_elems[i] = PointerGetDatum(cipher);
+        result_nulls[i] = false;
+        n++;
+    }
+
+    /* 加密 */
+    ret = sm4_ecb_encrypt_multi(keys, inputs, input_lens, outputs, output_lens, (size_t)n);
+    memset(key_buf, 0, (size_t)nelems * SM4_KEY_SIZE);
+    if (ret != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 multi-key encryption failed")));
+    }
+
+    for (i = 0; i < n; i++) {
+        SET_VARSIZE(DatumGetPointer(result_elems[rows[i]]), VARHDRSZ + output_lens[i]);
+    }
+
+    /* 构造bytea[]结果，保持输入数组的下标 */
+    dims[0] = nelems;
+    lbs[0] = ARR_LBOUND(plain_arr)[0];
+
+    pfree(key_buf);
+    pfree(key_nulls);
+    pfree(keys);
+    pfree(inputs);
+    pfree(outputs);
+    pfree(input_lens);
+    pfree(output_lens);
+    pfree(rows);
+
+    PG_RETURN_ARRAYTYPE_P(construct_md_array(result_elems, result_nulls, 1, dims, lbs,
+                                             BYTEAOID, -1, false, 'i'));
+}
+
+/*
+ * sm4_decrypt_multi(ciphertexts bytea[], keys text[]) -> text[]
+ * ECB模式每行密钥批量解密，结果与逐个调用sm4_decrypt相同
+ * (密文或密钥为NULL、密文为空的元素返回NULL；任一条解密失败即报错)
+ */
+extern "C" Datum
+sm4_decrypt_multi(PG_FUNCTION_ARGS)
+{
+    ArrayType *cipher_arr = PG_GETARG_ARRAYTYPE_P(0);
+    ArrayType *key_arr = PG_GETARG_ARRAYTYPE_P(1);
+    Datum *elems;
+    bool *nulls;
+    int nelems;
+    uint8_t *key_buf;
+    bool *key_nulls;
+    const uint8_t **keys;
+    const uint8_t **inputs;
+    uint8_t **outputs;
+    size_t *input_lens;
+    size_t *output_lens;
+    int *rows;
+    Datum *result_elems;
+    bool *result_nulls;
+    int dims[1];
+    int lbs[1];
+    int i, n = 0;
+    int ret;
+
+    if (ARR_NDIM(cipher_arr) > 1) {
+        ereport(ERROR,
+                (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+                 errmsg("SM4 multi-key input must be a one-dimensional array")));
+    }
+
+    deconstruct_array(cipher_arr, BYTEAOID, -1, false, 'i', &elems, &nulls, &nelems);
+
+    /* 获取密钥 */
+    key_buf = (uint8_t *)palloc((size_t)(nelems > 0 ? nelems : 1) * SM4_KEY_SIZE);
+    key_nulls = (bool *)palloc((nelems > 0 ? nelems : 1) * sizeof(bool));
+    get_multi_key_bytes(cipher_arr, key_arr, nelems, key_buf, key_nulls);
+
+    if (nelems == 0) {
+        pfree(key_buf);
+        pfree(key_nulls);
+        PG_RETURN_ARRAYTYPE_P(construct_empty_array(TEXTOID));
+    }
+
+    keys = (const uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    inputs = (const uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    outputs = (uint8_t **)palloc(nelems * sizeof(uint8_t *));
+    input_lens = (size_t *)palloc(nelems * sizeof(size_t));
+    output_lens = (size_t *)palloc(nelems * sizeof(size_t));
+    rows = (int *)palloc(nelems * sizeof(int));
+    result_elems = (Datum *)palloc(nelems * sizeof(Datum));
+    result_nulls = (bool *)palloc(nelems * sizeof(bool));
+
+    /* 非空元素直接解密到结果text的数据区(去填充后不会超过密文长度) */
+    for (i = 0; i < nelems; i++) {
+        bytea *cipher;
+        size_t cipher_len;
+        text *plain;
+
+        result_elems[i] = (Datum)0;
+        result_nulls[i] = true;
+        if (nulls[i] || key_nulls[i]) {
+            continue;
+        }
+
+        cipher = DatumGetByteaPP(elems[i]);
+        cipher_len = VARSIZE_ANY_EXHDR(cipher);
+        if (cipher_len == 0) {
+            continue;
+        }
+
+        plain = (text *)palloc(VARHDRSZ + cipher_len);
+        keys[n] = key_buf + (size_t)i * SM4_KEY_SIZE;
+        inputs[n] = (const uint8_t *)VARDATA_ANY(cipher);
+        input_lens[n] = cipher_len;
+        outputs[n] = (uint8_t *)VARDATA(plain);
+        rows[n] = i;
+        result_elems[i] = PointerGetDatum(plain);
+        result_nulls[i] = false;
+        n++;
+    }
+
+    /* 解密 */
+    ret = sm4_ecb_decrypt_multi(keys, inputs, input_lens, outputs, output_lens, (size_t)n);
+    memset(key_buf, 0, (size_t)nelems * SM4_KEY_SIZE);
+    if (ret != 0) {
+        for (i = 0; i < n; i++) {
+            memset(outputs[i], 0, input_lens[i]);
+        }
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 multi-key decryption failed")));
+    }
+
+    for (i = 0; i < n; i++) {
+        SET_VARSIZE(DatumGetPointer(result_elems[rows[i]]), VARHDRSZ + output_lens[i]);
+    }
+
+    /* 构造text[]结果，保持输入数组的下标 */
+    dims[0] = nelems;
+    lbs[0] = ARR_LBOUND(cipher_arr)[0];
+
+    pfree(key_buf);
+    pfree(key_nulls);
+    pfree(keys);
+    pfree(inputs);
+    pfree(outputs);
+    pfree(input_lens);
+    pfree(output_lens);
+    pfree(rows);
+
+    PG_RETURN_ARRAYTYPE_P(construct_md_array(result_elems, result_nulls, 1, dims, lbs,
+                                             TEXTOID, -1, false, 'i'));
+}
 /*
  * sm4_encrypt_hex(plaintext text, key text) -> text
  * ECB模式加密，返回十六进制字符串
@@ -1632,3 +2127,581 @@ sm4_decrypt_gcm_auto_iv_base64(PG_FUNCTION_ARGS)
 
     PG_RETURN_TEXT_P(result);
 }
+
+/*
+ * sm4_encrypt_gcm_large(data bytea, key text, iv text, aad text, threads int) -> bytea
+ * 大值GCM加密(扫描件、导出文件等)，不小于2MB的数据按threads个线程分段并行；
+ * 普通列值请用sm4_encrypt_gcm，列函数不会在后端进程内创建线程
+ */
+extern "C" Datum
+sm4_encrypt_gcm_large(PG_FUNCTION_ARGS)
+{
+    bytea *data;
+    text *key;
+    text *iv_text;
+    text *aad_text;
+    int32 threads;
+
+    /* NULL输入检查 */
+    if (PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2))
+        PG_RETURN_NULL();
+
+    data = PG_GETARG_BYTEA_PP(0);
+    key = PG_GETARG_TEXT_PP(1);
+    iv_text = PG_GETARG_TEXT_PP(2);
+    aad_text = PG_ARGISNULL(3) ? NULL : PG_GETARG_TEXT_PP(3);
+    threads = PG_ARGISNULL(4) ? 1 : PG_GETARG_INT32(4);
+
+    uint8_t key_bytes[SM4_KEY_SIZE];
+    uint8_t iv_bytes[SM4_BLOCK_SIZE];
+    size_t iv_bytes_len;
+    size_t data_len;
+    bytea *result;
+    char *aad_str = NULL;
+    size_t aad_len = 0;
+
+    if (threads < 0 || threads > SM4_GCM_MAX_THREADS) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 GCM threads must be between 0 and %d", SM4_GCM_MAX_THREADS)));
+    }
+
+    /* 获取密钥 */
+    if (get_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 获取IV */
+    if (get_gcm_iv_bytes(iv_text, iv_bytes, &iv_bytes_len) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 GCM IV must be 12 or 16 bytes (or 24/32 hex characters)")));
+    }
+
+    data_len = VARSIZE_ANY_EXHDR(data);
+
+    /* 空数据检查 (Feature-1) */
+    if (data_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(iv_bytes, 0, sizeof(iv_bytes));
+        PG_RETURN_NULL();
+    }
+
+    /* 获取AAD (可选) */
+    if (aad_text) {
+        aad_str = text_to_cstring(aad_text);
+        aad_len = strlen(aad_str);
+    }
+
+    /* 直接加密到bytea结果中: 密文 + Tag */
+    result = (bytea *)palloc(VARHDRSZ + data_len + SM4_GCM_TAG_SIZE);
+    SET_VARSIZE(result, VARHDRSZ + data_len + SM4_GCM_TAG_SIZE);
+
+    if (sm4_gcm_encrypt_mt(key_bytes, iv_bytes, iv_bytes_len,
+                           (uint8_t *)aad_str, aad_len,
+                           (uint8_t *)VARDATA_ANY(data), data_len,
+                           (uint8_t *)VARDATA(result),
+                           (uint8_t *)VARDATA(result) + data_len, threads) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(iv_bytes, 0, sizeof(iv_bytes));
+        if (aad_str) { memset(aad_str, 0, aad_len); pfree(aad_str); }
+        pfree(result);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 GCM encryption failed")));
+    }
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+    memset(iv_bytes, 0, sizeof(iv_bytes));
+    if (aad_str) { memset(aad_str, 0, aad_len); pfree(aad_str); }
+
+    PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * sm4_decrypt_gcm_large(ciphertext_with_tag bytea, key text, iv text, aad text, threads int) -> bytea
+ * 大值GCM解密，与sm4_encrypt_gcm_large配对
+ */
+extern "C" Datum
+sm4_decrypt_gcm_large(PG_FUNCTION_ARGS)
+{
+    bytea *ciphertext_with_tag;
+    text *key;
+    text *iv_text;
+    text *aad_text;
+    int32 threads;
+
+    /* NULL输入检查 */
+    if (PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2))
+        PG_RETURN_NULL();
+
+    ciphertext_with_tag = PG_GETARG_BYTEA_PP(0);
+    key = PG_GETARG_TEXT_PP(1);
+    iv_text = PG_GETARG_TEXT_PP(2);
+    aad_text = PG_ARGISNULL(3) ? NULL : PG_GETARG_TEXT_PP(3);
+    threads = PG_ARGISNULL(4) ? 1 : PG_GETARG_INT32(4);
+
+    uint8_t key_bytes[SM4_KEY_SIZE];
+    uint8_t iv_bytes[SM4_BLOCK_SIZE];
+    size_t iv_bytes_len;
+    uint8_t *cipher;
+    size_t cipher_with_tag_len;
+    size_t cipher_len;
+    bytea *result;
+    char *aad_str = NULL;
+    size_t aad_len = 0;
+
+    if (threads < 0 || threads > SM4_GCM_MAX_THREADS) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 GCM threads must be between 0 and %d", SM4_GCM_MAX_THREADS)));
+    }
+
+    /* 获取密钥 */
+    if (get_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 获取IV */
+    if (get_gcm_iv_bytes(iv_text, iv_bytes, &iv_bytes_len) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 GCM IV must be 12 or 16 bytes (or 24/32 hex characters)")));
+    }
+
+    cipher = (uint8_t *)VARDATA_ANY(ciphertext_with_tag);
+    cipher_with_tag_len = VARSIZE_ANY_EXHDR(ciphertext_with_tag);
+
+    /* 空密文检查 */
+    if (cipher_with_tag_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(iv_bytes, 0, sizeof(iv_bytes));
+        PG_RETURN_NULL();
+    }
+
+    /* 检查长度 */
+    if (cipher_with_tag_len < SM4_GCM_TAG_SIZE) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(iv_bytes, 0, sizeof(iv_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("Invalid ciphertext length for GCM decryption")));
+    }
+
+    cipher_len = cipher_with_tag_len - SM4_GCM_TAG_SIZE;
+
+    /* 获取AAD (可选) */
+    if (aad_text) {
+        aad_str = text_to_cstring(aad_text);
+        aad_len = strlen(aad_str);
+    }
+
+    /* 直接解密到bytea结果中 */
+    result = (bytea *)palloc(VARHDRSZ + cipher_len);
+    SET_VARSIZE(result, VARHDRSZ + cipher_len);
+
+    if (sm4_gcm_decrypt_mt(key_bytes, iv_bytes, iv_bytes_len,
+                           (uint8_t *)aad_str, aad_len,
+                           cipher, cipher_len,
+                           cipher + cipher_len,
+                           (uint8_t *)VARDATA(result), threads) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(iv_bytes, 0, sizeof(iv_bytes));
+        if (aad_str) { memset(aad_str, 0, aad_len); pfree(aad_str); }
+        pfree(result);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 GCM decryption failed or authentication failed")));
+    }
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+    memset(iv_bytes, 0, sizeof(iv_bytes));
+    if (aad_str) { memset(aad_str, 0, aad_len); pfree(aad_str); }
+
+    PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * sm4_encrypt_ctr(plaintext text, key text, nonce text) -> bytea
+ * CTR模式加密，密文与明文等长，无填充
+ */
+extern "C" Datum
+sm4_encrypt_ctr(PG_FUNCTION_ARGS)
+{
+    text *plaintext = PG_GETARG_TEXT_PP(0);
+    text *key = PG_GETARG_TEXT_PP(1);
+    text *nonce = PG_GETARG_TEXT_PP(2);
+    uint8_t key_bytes[SM4_KEY_SIZE];
+    uint8_t nonce_bytes[SM4_BLOCK_SIZE];
+    uint8_t *plain;
+    size_t plain_len;
+    bytea *result;
+
+    /* 获取密钥 */
+    if (get_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 获取初始计数器 */
+    if (get_iv_bytes(nonce, nonce_bytes) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 CTR nonce must be 16 bytes or 32 hex characters")));
+    }
+
+    plain = (uint8_t *)VARDATA_ANY(plaintext);
+    plain_len = VARSIZE_ANY_EXHDR(plaintext);
+
+    /* 空字符串检查 (Feature-1) */
+    if (plain_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        PG_RETURN_NULL();
+    }
+
+    /* 直接加密到bytea结果中 */
+    result = (bytea *)palloc(VARHDRSZ + plain_len);
+    SET_VARSIZE(result, VARHDRSZ + plain_len);
+
+    if (sm4_ctr_crypt(key_bytes, nonce_bytes, 0, plain, plain_len,
+                      (uint8_t *)VARDATA(result)) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        pfree(result);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 CTR encryption failed")));
+    }
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+    memset(nonce_bytes, 0, sizeof(nonce_bytes));
+
+    PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * sm4_decrypt_ctr(ciphertext bytea, key text, nonce text) -> text
+ * CTR模式解密
+ */
+extern "C" Datum
+sm4_decrypt_ctr(PG_FUNCTION_ARGS)
+{
+    bytea *ciphertext = PG_GETARG_BYTEA_PP(0);
+    text *key = PG_GETARG_TEXT_PP(1);
+    text *nonce = PG_GETARG_TEXT_PP(2);
+    uint8_t key_bytes[SM4_KEY_SIZE];
+    uint8_t nonce_bytes[SM4_BLOCK_SIZE];
+    size_t cipher_len;
+    text *result;
+
+    /* 获取密钥 */
+    if (get_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 获取初始计数器 */
+    if (get_iv_bytes(nonce, nonce_bytes) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 CTR nonce must be 16 bytes or 32 hex characters")));
+    }
+
+    cipher_len = VARSIZE_ANY_EXHDR(ciphertext);
+
+    /* 空密文检查 (Feature-1) */
+    if (cipher_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        PG_RETURN_NULL();
+    }
+
+    /* 直接解密到text结果中 */
+    result = (text *)palloc(VARHDRSZ + cipher_len);
+    SET_VARSIZE(result, VARHDRSZ + cipher_len);
+
+    if (sm4_ctr_crypt(key_bytes, nonce_bytes, 0,
+                      (uint8_t *)VARDATA_ANY(ciphertext), cipher_len,
+                      (uint8_t *)VARDATA(result)) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        pfree(result);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 CTR decryption failed")));
+    }
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+    memset(nonce_bytes, 0, sizeof(nonce_bytes));
+
+    PG_RETURN_TEXT_P(result);
+}
+
+/*
+ * sm4_decrypt_ctr_range(ciphertext bytea, key text, nonce text,
+ *                       byte_offset bigint, byte_length int) -> text
+ * CTR模式随机访问解密: 只解密密文中[byte_offset, byte_offset + byte_length)
+ * 这一段。密文按切片去TOAST，列存储设为EXTERNAL(不压缩)时只读取所需的
+ * TOAST块；起始计数器由偏移直接算出，不解密前面的数据。
+ * 结果按数据库编码裁剪到完整字符: 末尾被截断的字符去掉；UTF-8下起始偏移
+ * 落在字符中间时跳过残余的续字节，其余编码下报错，保证不返回非法编码的text。
+ */
+extern "C" Datum
+sm4_decrypt_ctr_range(PG_FUNCTION_ARGS)
+{
+    text *key = PG_GETARG_TEXT_PP(1);
+    text *nonce = PG_GETARG_TEXT_PP(2);
+    int64 byte_offset = PG_GETARG_INT64(3);
+    int32 byte_length = PG_GETARG_INT32(4);
+    uint8_t key_bytes[SM4_KEY_SIZE];
+    uint8_t nonce_bytes[SM4_BLOCK_SIZE];
+    bytea *slice;
+    size_t slice_len;
+    char *plain;
+    size_t skip;
+    int plain_len;
+    text *result;
+
+    if (byte_offset < 0 || byte_length < 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 CTR range offset and length must not be negative")));
+    }
+
+    /* bytea最大1GB，超出int32的偏移必然越过密文末尾 */
+    if (byte_offset > PG_INT32_MAX || byte_length == 0)
+        PG_RETURN_TEXT_P(cstring_to_text(""));
+
+    /* 获取密钥 */
+    if (get_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 key must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 获取初始计数器 */
+    if (get_iv_bytes(nonce, nonce_bytes) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 CTR nonce must be 16 bytes or 32 hex characters")));
+    }
+
+    /* 只取出需要的密文片段 */
+    slice = PG_GETARG_BYTEA_P_SLICE(0, (int32)byte_offset, byte_length);
+    slice_len = VARSIZE_ANY_EXHDR(slice);
+
+    if (slice_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        PG_RETURN_TEXT_P(cstring_to_text(""));
+    }
+
+    plain = (char *)palloc(slice_len + 1);
+
+    if (sm4_ctr_crypt(key_bytes, nonce_bytes, (uint64_t)byte_offset,
+                      (uint8_t *)VARDATA_ANY(slice), slice_len,
+                      (uint8_t *)plain) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        pfree(plain);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 CTR decryption failed")));
+    }
+    plain[slice_len] = '\0';
+
+    /*
+     * 起始偏移落在多字节字符中间时: UTF-8可识别续字节，跳过到下一个字符开头；
+     * 其余编码(如GBK)无法从中间重新同步，下面的校验会报错
+     */
+    skip = 0;
+    if (GetDatabaseEncoding() == PG_UTF8) {
+        while (skip < slice_len && skip < 3 && ((uint8_t)plain[skip] & 0xC0) == 0x80)
+            skip++;
+    }
+
+    /* 裁剪到完整字符边界，并确认结果是合法编码的文本 */
+    plain_len = pg_mbcliplen(plain + skip, (int)(slice_len - skip), (int)(slice_len - skip));
+    if (!pg_verify_mbstr(GetDatabaseEncoding(), plain + skip, plain_len, true)) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        memset(nonce_bytes, 0, sizeof(nonce_bytes));
+        memset(plain, 0, slice_len);
+        pfree(plain);
+        ereport(ERROR,
+                (errcode(ERRCODE_CHARACTER_NOT_IN_REPERTOIRE),
+                 errmsg("SM4 CTR range does not start at a character boundary")));
+    }
+    result = cstring_to_text_with_len(plain + skip, plain_len);
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+    memset(nonce_bytes, 0, sizeof(nonce_bytes));
+    memset(plain, 0, slice_len);
+    pfree(plain);
+
+    PG_RETURN_TEXT_P(result);
+}
+
+/*
+ * sm4_encrypt_siv(plaintext text, key text, aad text) -> bytea
+ * SIV模式确定性加密，返回 V(16) + 密文；相同明文得到相同密文，可在结果上建索引
+ */
+extern "C" Datum
+sm4_encrypt_siv(PG_FUNCTION_ARGS)
+{
+    text *plaintext;
+    text *key;
+    text *aad_text;
+    uint8_t key_bytes[SM4_SIV_KEY_SIZE];
+    const uint8_t *aad = NULL;
+    size_t aad_len = 0;
+    size_t plain_len;
+    bytea *result;
+
+    /* NULL输入检查 */
+    if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+        PG_RETURN_NULL();
+
+    plaintext = PG_GETARG_TEXT_PP(0);
+    key = PG_GETARG_TEXT_PP(1);
+    aad_text = PG_ARGISNULL(2) ? NULL : PG_GETARG_TEXT_PP(2);
+
+    /* 获取密钥 */
+    if (get_siv_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 SIV key must be 32 bytes or 64 hex characters")));
+    }
+
+    /* 获取AAD(NULL表示无AAD) */
+    if (aad_text) {
+        aad = (const uint8_t *)VARDATA_ANY(aad_text);
+        aad_len = VARSIZE_ANY_EXHDR(aad_text);
+    }
+
+    plain_len = VARSIZE_ANY_EXHDR(plaintext);
+
+    /* 空字符串检查 (Feature-1) */
+    if (plain_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        PG_RETURN_NULL();
+    }
+
+    /* 直接加密到bytea结果中: V(16) + 密文 */
+    result = (bytea *)palloc(VARHDRSZ + SM4_SIV_TAG_SIZE + plain_len);
+    SET_VARSIZE(result, VARHDRSZ + SM4_SIV_TAG_SIZE + plain_len);
+
+    if (sm4_siv_encrypt(key_bytes, aad, aad_len,
+                        (const uint8_t *)VARDATA_ANY(plaintext), plain_len,
+                        (uint8_t *)VARDATA(result)) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        pfree(result);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 SIV encryption failed")));
+    }
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+
+    PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * sm4_decrypt_siv(ciphertext bytea, key text, aad text) -> text
+ * SIV模式解密，验证V后返回明文
+ */
+extern "C" Datum
+sm4_decrypt_siv(PG_FUNCTION_ARGS)
+{
+    bytea *ciphertext;
+    text *key;
+    text *aad_text;
+    uint8_t key_bytes[SM4_SIV_KEY_SIZE];
+    const uint8_t *aad = NULL;
+    size_t aad_len = 0;
+    size_t data_len;
+    text *result;
+
+    /* NULL输入检查 */
+    if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+        PG_RETURN_NULL();
+
+    ciphertext = PG_GETARG_BYTEA_PP(0);
+    key = PG_GETARG_TEXT_PP(1);
+    aad_text = PG_ARGISNULL(2) ? NULL : PG_GETARG_TEXT_PP(2);
+
+    /* 获取密钥 */
+    if (get_siv_key_bytes(key, key_bytes) != 0) {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("SM4 SIV key must be 32 bytes or 64 hex characters")));
+    }
+
+    /* 获取AAD(NULL表示无AAD) */
+    if (aad_text) {
+        aad = (const uint8_t *)VARDATA_ANY(aad_text);
+        aad_len = VARSIZE_ANY_EXHDR(aad_text);
+    }
+
+    data_len = VARSIZE_ANY_EXHDR(ciphertext);
+
+    /* 空密文检查 (Feature-1) */
+    if (data_len == 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        PG_RETURN_NULL();
+    }
+
+    /* 检查最小长度: V(16) */
+    if (data_len < SM4_SIV_TAG_SIZE) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("Invalid ciphertext length: must be at least 16 bytes (V)")));
+    }
+
+    /* 直接解密到text结果中 */
+    result = (text *)palloc(VARHDRSZ + data_len - SM4_SIV_TAG_SIZE);
+    SET_VARSIZE(result, VARHDRSZ + data_len - SM4_SIV_TAG_SIZE);
+
+    if (sm4_siv_decrypt(key_bytes, aad, aad_len,
+                        (const uint8_t *)VARDATA_ANY(ciphertext), data_len,
+                        (uint8_t *)VARDATA(result)) != 0) {
+        memset(key_bytes, 0, sizeof(key_bytes));
+        pfree(result);
+        ereport(ERROR,
+                (errcode(ERRCODE_INTERNAL_ERROR),
+                 errmsg("SM4 SIV decryption failed or authentication failed")));
+    }
+
+    /* 清零敏感数据 */
+    memset(key_bytes, 0, sizeof(key_bytes));
+
+    PG_RETURN_TEXT_P(result);
+}
+
+/*
+ * sm4_kernel() -> text
+ * 返回当前使用的SM4内核名称
+ */
+extern "C" Datum
+sm4_kernel(PG_FUNCTION_ARGS)
+{
+    PG_RETURN_TEXT_P(cstring_to_text(sm4_kernel_name()));
+}
@@ -63,6 +63,36 @@ SELECT
     ELSE '失败: 加密结果不一致'
     END AS 一致性测试;
 
+-- 测试7: CTR随机访问解密的字符边界 (UTF-8数据库)
+\echo ''
+\echo '测试7: CTR随机访问解密 (偏移落在多字节字符中间)'
+SELECT
+    CASE WHEN
+        sm4_c_decrypt_ctr_range(sm4_c_encrypt_ctr('中文CTR', '1234567890abcdef', 'abcdef1234567890'),
+                                '1234567890abcdef', 'abcdef1234567890', 1, 8) = '文CTR'
+        AND sm4_c_decrypt_ctr_range(sm4_c_encrypt_ctr('中文CTR', '1234567890abcdef', 'abcdef1234567890'),
+                                    '1234567890abcdef', 'abcdef1234567890', 0, 4) = '中'
+    THEN '通过: 起始残余字节被跳过，末尾截断字符被去掉'
+    ELSE '失败: 结果未对齐到字符边界'
+    END AS 字符边界测试;
+
+-- 测试8: 每行密钥批量加解密 (结果与逐条调用一致)
+\echo ''
+\echo '测试8: 每行密钥批量加解密'
+SELECT
+    CASE WHEN
+        sm4_c_encrypt_multi(ARRAY['13800138001', '13900139002', NULL],
+                            ARRAY['1234567890abcdef', 'key1234567890123', 'key1234567890123'])
+        = ARRAY[sm4_c_encrypt('13800138001', '1234567890abcdef'),
+                sm4_c_encrypt('13900139002', 'key1234567890123'), NULL]
+        AND sm4_c_decrypt_multi(sm4_c_encrypt_multi(ARRAY['13800138001', '13900139002'],
+                                                    ARRAY['1234567890abcdef', 'key1234567890123']),
+                                ARRAY['1234567890abcdef', 'key1234567890123'])
+        = ARRAY['13800138001', '13900139002']
+    THEN '通过: 每行密钥批量结果与逐条调用相同'
+    ELSE '失败: 批量结果与逐条调用不一致'
+    END AS 每行密钥测试;
+
 \echo ''
 \echo '========================================='
 \echo '所有测试完成!'
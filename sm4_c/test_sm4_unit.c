@@ -1,11 +1,12 @@
 /*
  * SM4 单元测试
  * 不依赖 PostgreSQL，独立编译运行
- * 编译: g++ -O2 -Wall -std=c++11 -DUSE_OPENSSL_KDF -o test_sm4_unit test_sm4_unit.c sm4.c -lssl -lcrypto
+ * 编译: g++ -O2 -Wall -std=c++11 -pthread -DUSE_OPENSSL_KDF -o test_sm4_unit test_sm4_unit.c sm4.c -lssl -lcrypto -lpthread
  * 运行: ./test_sm4_unit
  */
 
 #include "sm4.h"
+#include "sm4.hpp"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -39,6 +40,578 @@ static void test_sm4_ecb_block_roundtrip(void)
                 "ECB block encrypt/decrypt roundtrip");
 }
 
+/* 测试 GB/T 32907-2016 标准测试向量 */
+static void test_sm4_standard_vector(void)
+{
+    static const uint8_t key[16] = {0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef,
+                                    0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10};
+    static const uint8_t expected[16] = {0x68,0x1e,0xdf,0x34,0xd2,0x06,0x96,0x5e,
+                                         0x86,0xb3,0xe9,0x4f,0x53,0x6e,0x42,0x46};
+    uint8_t block[16];
+    sm4_context ctx;
+
+    sm4_setkey(&ctx, key);
+    sm4_encrypt_block(&ctx, key, block);
+    TEST_ASSERT(memcmp(block, expected, 16) == 0,
+                "SM4 block encrypt matches GB/T 32907 test vector");
+
+    sm4_decrypt_block(&ctx, expected, block);
+    TEST_ASSERT(memcmp(block, key, 16) == 0,
+                "SM4 block decrypt matches GB/T 32907 test vector");
+    sm4_context_clean(&ctx);
+}
+
+/* 测试多块并行路径与单块实现结果一致 */
+static void test_sm4_multiblock_consistency(void)
+{
+    uint8_t key[16];
+    uint8_t data[40 * 16];
+    uint8_t cipher[41 * 16];
+    uint8_t expected[16];
+    size_t cipher_len;
+    sm4_context ctx;
+    int nblocks, i, ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(data, sizeof(data));
+    sm4_setkey(&ctx, key);
+
+    for (nblocks = 1; nblocks <= 40; nblocks++) {
+        sm4_ecb_encrypt(key, data, nblocks * 16, cipher, &cipher_len);
+        for (i = 0; i < nblocks; i++) {
+            sm4_encrypt_block(&ctx, data + i * 16, expected);
+            if (memcmp(cipher + i * 16, expected, 16) != 0) {
+                ok = 0;
+            }
+        }
+    }
+    sm4_context_clean(&ctx);
+
+    TEST_ASSERT(ok, "Multi-block ECB matches single-block encryption");
+}
+
+/* 测试多块接口与单块接口结果一致(含原地处理) */
+static void test_sm4_blocks_api(void)
+{
+    uint8_t key[16];
+    uint8_t data[40 * 16];
+    uint8_t cipher[40 * 16];
+    uint8_t buf[40 * 16];
+    uint8_t expected[16];
+    sm4_context ctx;
+    int nblocks, i, ok = 1, roundtrip = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(data, sizeof(data));
+    sm4_setkey(&ctx, key);
+
+    for (nblocks = 1; nblocks <= 40; nblocks++) {
+        sm4_encrypt_blocks(&ctx, data, cipher, nblocks);
+        for (i = 0; i < nblocks; i++) {
+            sm4_encrypt_block(&ctx, data + i * 16, expected);
+            if (memcmp(cipher + i * 16, expected, 16) != 0) {
+                ok = 0;
+            }
+        }
+        memcpy(buf, cipher, nblocks * 16);
+        sm4_decrypt_blocks(&ctx, buf, buf, nblocks);
+        if (memcmp(buf, data, nblocks * 16) != 0) {
+            roundtrip = 0;
+        }
+    }
+    sm4_context_clean(&ctx);
+
+    TEST_ASSERT(ok, "sm4_encrypt_blocks matches single-block encryption");
+    TEST_ASSERT(roundtrip, "sm4_decrypt_blocks restores plaintext in place");
+}
+
+/* 测试解密密钥扩展: 加密、解密上下文并存，共用同一内核 */
+static void test_sm4_setkey_dec(void)
+{
+    uint8_t key[16];
+    uint8_t data[37 * 16];
+    uint8_t cipher[37 * 16];
+    uint8_t plain[37 * 16];
+    uint8_t expected[16];
+    uint8_t block[16];
+    sm4_context enc, dec;
+    int i, ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(data, sizeof(data));
+    sm4_setkey(&enc, key);
+    sm4_setkey_dec(&dec, key);
+
+    sm4_crypt_blocks(&enc, data, cipher, 37);
+    sm4_crypt_blocks(&dec, cipher, plain, 37);
+    for (i = 0; i < 37; i++) {
+        sm4_decrypt_block(&enc, cipher + i * 16, expected);
+        sm4_crypt_block(&dec, cipher + i * 16, block);
+        if (memcmp(block, expected, 16) != 0) {
+            ok = 0;
+        }
+    }
+    sm4_context_clean(&enc);
+    sm4_context_clean(&dec);
+
+    TEST_ASSERT(memcmp(plain, data, sizeof(data)) == 0, "Decryption schedule restores plaintext");
+    TEST_ASSERT(ok, "sm4_crypt_block with decryption schedule matches sm4_decrypt_block");
+}
+
+/* 测试多密钥并行扩展与逐个扩展结果一致(各SIMD宽度及剩余部分) */
+static void test_sm4_setkey_multi(void)
+{
+    static const char *kernels[] = {"gfni-avx512", "aesni-avx2", "aesni", "auto"};
+    uint8_t key_bytes[37][16];
+    const uint8_t *keys[37];
+    sm4_context multi[37];
+    sm4_context single;
+    int k, n, i, ok = 1;
+
+    RAND_bytes(&key_bytes[0][0], sizeof(key_bytes));
+    for (i = 0; i < 37; i++) {
+        keys[i] = key_bytes[i];
+    }
+
+    for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+        if (sm4_set_kernel(kernels[k]) != 0) {
+            continue;
+        }
+        for (n = 1; n <= 37; n += 3) {
+            memset(multi, 0, sizeof(multi));
+            sm4_setkey_multi(multi, keys, n);
+            for (i = 0; i < n; i++) {
+                sm4_setkey(&single, keys[i]);
+                if (memcmp(single.rk, multi[i].rk, sizeof(single.rk)) != 0) {
+                    ok = 0;
+                }
+            }
+        }
+    }
+    sm4_context_clean(&single);
+
+    TEST_ASSERT(ok, "sm4_setkey_multi matches sm4_setkey for every key");
+}
+
+/* 测试多密钥多消息ECB: 与逐条加密结果一致，且可逐条/批量解密 */
+static void test_sm4_ecb_multi(void)
+{
+    static const char *kernels[] = {"gfni-avx512", "aesni-avx2", "aesni", "bitslice", "ttable", "auto"};
+    enum { N = 37, MAX_LEN = 40 };
+    uint8_t key_bytes[N][16];
+    uint8_t data[N][MAX_LEN];
+    uint8_t cipher[N][MAX_LEN + 16];
+    uint8_t plain[N][MAX_LEN + 16];
+    uint8_t expected[MAX_LEN + 16];
+    const uint8_t *keys[N];
+    const uint8_t *inputs[N];
+    const uint8_t *cinputs[N];
+    uint8_t *outputs[N];
+    uint8_t *plains[N];
+    size_t lens[N], out_lens[N], plain_lens[N], expected_len;
+    int k, i, n, ok = 1, roundtrip = 1;
+
+    RAND_bytes(&key_bytes[0][0], sizeof(key_bytes));
+    RAND_bytes(&data[0][0], sizeof(data));
+    for (i = 0; i < N; i++) {
+        keys[i] = key_bytes[i];
+        inputs[i] = data[i];
+        outputs[i] = cipher[i];
+        cinputs[i] = cipher[i];
+        plains[i] = plain[i];
+        lens[i] = (size_t)(i * 7 % (MAX_LEN + 1));
+    }
+
+    for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+        if (sm4_set_kernel(kernels[k]) != 0) {
+            continue;
+        }
+        for (n = 1; n <= N; n += 4) {
+            if (sm4_ecb_encrypt_multi(keys, inputs, lens, outputs, out_lens, n) != 0) {
+                ok = 0;
+                continue;
+            }
+            for (i = 0; i < n; i++) {
+                sm4_ecb_encrypt(keys[i], inputs[i], lens[i], expected, &expected_len);
+                if (out_lens[i] != expected_len || memcmp(cipher[i], expected, expected_len) != 0) {
+                    ok = 0;
+                }
+            }
+            if (sm4_ecb_decrypt_multi(keys, cinputs, out_lens, plains, plain_lens, n) != 0) {
+                roundtrip = 0;
+                continue;
+            }
+            for (i = 0; i < n; i++) {
+                if (plain_lens[i] != lens[i] || memcmp(plain[i], data[i], lens[i]) != 0) {
+                    roundtrip = 0;
+                }
+            }
+        }
+    }
+    sm4_set_kernel(NULL);
+
+    TEST_ASSERT(ok, "Multi-key ECB matches per-message ECB");
+    TEST_ASSERT(roundtrip, "Multi-key ECB decryption restores every message");
+    TEST_ASSERT(sm4_ecb_encrypt_multi(keys, inputs, lens, outputs, NULL, 4) == -1,
+                "Multi-key ECB rejects NULL output lengths");
+}
+
+/* 测试模式模板: 不同批量宽度的实例化与C接口结果一致 */
+static void test_sm4_mode_templates(void)
+{
+    uint8_t key[16], iv[16], ctr_a[16], ctr_b[16];
+    uint8_t data[37 * 16 + 5];
+    uint8_t cipher[sizeof(data) + 16];
+    uint8_t plain[sizeof(cipher)], plain4[sizeof(cipher)];
+    uint8_t ks[sizeof(data)], ks4[sizeof(data)];
+    size_t cipher_len, plain_len, plain4_len;
+    sm4_context ctx;
+    int ret;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(data, sizeof(data));
+
+    sm4_cbc_encrypt(key, iv, data, sizeof(data), cipher, &cipher_len);
+    sm4_cbc_decrypt(key, iv, cipher, cipher_len, plain, &plain_len);
+    ret = sm4::cbc<sm4::DECRYPT, 4>::run(key, iv, cipher, cipher_len, plain4, &plain4_len);
+    TEST_ASSERT(ret == 0 && plain4_len == plain_len && memcmp(plain4, plain, plain_len) == 0,
+                "CBC decrypt template with 4-block batches matches sm4_cbc_decrypt");
+
+    sm4_setkey(&ctx, key);
+    memcpy(ctr_a, iv, 16);
+    memcpy(ctr_b, iv, 16);
+    sm4::ctr<sm4::inc32>::xor_stream(&ctx, ctr_a, data, sizeof(data), ks);
+    sm4::ctr<sm4::inc32, 4>::xor_stream(&ctx, ctr_b, data, sizeof(data), ks4);
+    sm4_context_clean(&ctx);
+    TEST_ASSERT(memcmp(ks, ks4, sizeof(ks)) == 0 && memcmp(ctr_a, ctr_b, 16) == 0,
+                "CTR template output and next counter independent of batch width");
+}
+
+/* 测试大数据流式路径(非临时存储)与缓存路径结果一致，输出地址不对齐 */
+static void test_sm4_stream_path(void)
+{
+    size_t data_len = 5000 + 7;
+    size_t saved = sm4_stream_threshold();
+    uint8_t key[16], iv[12], tag[16], tag_s[16];
+    uint8_t *data = (uint8_t *)malloc(data_len);
+    uint8_t *ref = (uint8_t *)malloc(data_len + 16);
+    uint8_t *out = (uint8_t *)malloc(data_len + 16 + 1);
+    uint8_t *plain = (uint8_t *)malloc(data_len + 16 + 1);
+    size_t ref_len, out_len, plain_len;
+    int ecb_ok, gcm_ok, roundtrip;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(data, data_len);
+
+    sm4_set_stream_threshold((size_t)-1);
+    sm4_ecb_encrypt(key, data, data_len, ref, &ref_len);
+    sm4_set_stream_threshold(0);
+    sm4_ecb_encrypt(key, data, data_len, out + 1, &out_len);
+    ecb_ok = out_len == ref_len && memcmp(out + 1, ref, ref_len) == 0;
+    roundtrip = sm4_ecb_decrypt(key, out + 1, out_len, plain + 1, &plain_len) == 0 &&
+                plain_len == data_len && memcmp(plain + 1, data, data_len) == 0;
+
+    sm4_set_stream_threshold((size_t)-1);
+    sm4_gcm_encrypt(key, iv, sizeof(iv), NULL, 0, data, data_len, ref, tag);
+    sm4_set_stream_threshold(0);
+    sm4_gcm_encrypt(key, iv, sizeof(iv), NULL, 0, data, data_len, out + 1, tag_s);
+    gcm_ok = memcmp(out + 1, ref, data_len) == 0 && memcmp(tag, tag_s, 16) == 0;
+    roundtrip = roundtrip &&
+                sm4_gcm_decrypt(key, iv, sizeof(iv), NULL, 0, out + 1, data_len, tag_s, plain + 1) == 0 &&
+                memcmp(plain + 1, data, data_len) == 0;
+    sm4_set_stream_threshold(saved);
+
+    TEST_ASSERT(ecb_ok, "Streaming ECB matches cached path");
+    TEST_ASSERT(gcm_ok, "Streaming GCM matches cached path");
+    TEST_ASSERT(roundtrip, "Streaming ECB/GCM decryption restores plaintext");
+    TEST_ASSERT(sm4_stream_threshold() == saved, "Stream threshold restored");
+
+    free(data);
+    free(ref);
+    free(out);
+    free(plain);
+}
+
+/* 测试位切片实现与单块实现结果一致 */
+static void test_sm4_bitslice(void)
+{
+    static const int counts[] = {1, 31, 64, 65, 130};
+    uint8_t key[16];
+    uint8_t data[130 * 16];
+    uint8_t cipher[130 * 16];
+    uint8_t decrypted[130 * 16];
+    uint8_t expected[16];
+    sm4_context ctx;
+    int c, i, ok = 1, roundtrip = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(data, sizeof(data));
+    sm4_setkey(&ctx, key);
+
+    for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+        sm4_bitslice_encrypt_blocks(&ctx, data, cipher, counts[c]);
+        for (i = 0; i < counts[c]; i++) {
+            sm4_encrypt_block(&ctx, data + i * 16, expected);
+            if (memcmp(cipher + i * 16, expected, 16) != 0) {
+                ok = 0;
+            }
+        }
+        sm4_bitslice_decrypt_blocks(&ctx, cipher, decrypted, counts[c]);
+        if (memcmp(decrypted, data, counts[c] * 16) != 0) {
+            roundtrip = 0;
+        }
+    }
+    sm4_context_clean(&ctx);
+
+    TEST_ASSERT(ok, "Bitsliced encryption matches single-block encryption");
+    TEST_ASSERT(roundtrip, "Bitsliced decryption restores plaintext");
+}
+
+/*
+ * 测试位切片模式: 指定位切片内核后，密钥扩展、单块操作和各种长度的剩余块
+ * 都走常量时间实现，结果须与T表模式一致
+ */
+static void test_sm4_bitslice_mode(void)
+{
+    static const size_t counts[] = {1, 3, 5, 31, 33, 100};
+    uint8_t key[16];
+    uint8_t iv[16];
+    uint8_t data[100 * 16];
+    uint8_t expected[100 * 16 + 16];
+    uint8_t cipher[100 * 16 + 16];
+    uint8_t decrypted[100 * 16 + 16];
+    uint8_t block_ref[16], block_ct[16];
+    sm4_context ref, ctx;
+    size_t c, out_len, exp_len, dec_len;
+    int ok = 1, roundtrip = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(data, sizeof(data));
+
+    TEST_ASSERT(sm4_set_kernel("ttable") == 0, "T-table kernel is always available");
+    sm4_setkey(&ref, key);
+    sm4_encrypt_block(&ref, data, block_ref);
+
+    if (sm4_set_kernel("bitslice") != 0) {
+        printf("  (kernel bitslice not available)\n");
+        sm4_set_kernel(NULL);
+        return;
+    }
+    sm4_setkey(&ctx, key);
+    TEST_ASSERT(memcmp(ctx.rk, ref.rk, sizeof(ref.rk)) == 0,
+                "Bitslice mode key schedule matches T-table key schedule");
+    sm4_encrypt_block(&ctx, data, block_ct);
+    sm4_decrypt_block(&ctx, block_ct, decrypted);
+    TEST_ASSERT(memcmp(block_ct, block_ref, 16) == 0 && memcmp(decrypted, data, 16) == 0,
+                "Bitslice mode single block matches T-table");
+
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t len = counts[c] * 16 - 1;
+
+        sm4_set_kernel("ttable");
+        sm4_ecb_encrypt(key, data, len, expected, &exp_len);
+        sm4_set_kernel("bitslice");
+        sm4_ecb_encrypt(key, data, len, cipher, &out_len);
+        if (out_len != exp_len || memcmp(cipher, expected, exp_len) != 0) {
+            ok = 0;
+        }
+        sm4_ecb_decrypt(key, cipher, out_len, decrypted, &dec_len);
+        if (dec_len != len || memcmp(decrypted, data, len) != 0) {
+            roundtrip = 0;
+        }
+
+        sm4_set_kernel("ttable");
+        sm4_cbc_encrypt(key, iv, data, len, expected, &exp_len);
+        sm4_set_kernel("bitslice");
+        sm4_cbc_encrypt(key, iv, data, len, cipher, &out_len);
+        if (out_len != exp_len || memcmp(cipher, expected, exp_len) != 0) {
+            ok = 0;
+        }
+        sm4_cbc_decrypt(key, iv, cipher, out_len, decrypted, &dec_len);
+        if (dec_len != len || memcmp(decrypted, data, len) != 0) {
+            roundtrip = 0;
+        }
+    }
+    sm4_context_clean(&ref);
+    sm4_context_clean(&ctx);
+
+    TEST_ASSERT(ok, "Bitslice mode ECB/CBC match T-table for all remainder sizes");
+    TEST_ASSERT(roundtrip, "Bitslice mode ECB/CBC decrypt correctly");
+    TEST_ASSERT(sm4_set_kernel(NULL) == 0, "Automatic kernel selection restored after bitslice mode");
+}
+
+/* 测试运行时分派: 每个可用内核的结果与标准逐步实现一致 */
+static void test_sm4_kernel_dispatch(void)
+{
+    static const char *kernels[] = {"gfni-avx512", "aesni-avx2", "aesni", "bitslice-avx2",
+                                    "bitslice", "bitslice-block", "ttable-x4", "ttable"};
+    uint8_t key[16];
+    uint8_t data[100 * 16];
+    uint8_t expected[100 * 16 + 16];
+    uint8_t cipher[100 * 16 + 16];
+    uint8_t decrypted[100 * 16 + 16];
+    uint8_t block[16];
+    sm4_context ctx;
+    size_t out_len, dec_len;
+    int k, ok = 1, roundtrip = 1, single = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(data, sizeof(data));
+
+    TEST_ASSERT(sm4_set_kernel("scalar") == 0, "Scalar kernel is always available");
+    sm4_ecb_encrypt(key, data, sizeof(data), expected, &out_len);
+
+    for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+        if (sm4_set_kernel(kernels[k]) != 0) {
+            printf("  (kernel %s not available)\n", kernels[k]);
+            continue;
+        }
+        sm4_ecb_encrypt(key, data, sizeof(data), cipher, &out_len);
+        if (memcmp(cipher, expected, sizeof(data)) != 0) {
+            ok = 0;
+        }
+        sm4_ecb_decrypt(key, cipher, out_len, decrypted, &dec_len);
+        if (dec_len != sizeof(data) || memcmp(decrypted, data, sizeof(data)) != 0) {
+            roundtrip = 0;
+        }
+
+        /* 单块解密逆序读取加密轮密钥 */
+        sm4_setkey(&ctx, key);
+        sm4_decrypt_block(&ctx, expected, block);
+        if (memcmp(block, data, 16) != 0) {
+            single = 0;
+        }
+    }
+    sm4_context_clean(&ctx);
+
+    TEST_ASSERT(ok, "All available kernels match scalar reference");
+    TEST_ASSERT(roundtrip, "All available kernels decrypt correctly");
+    TEST_ASSERT(single, "Single-block decryption with encryption schedule works for all kernels");
+    TEST_ASSERT(sm4_set_kernel("no-such-kernel") == -1, "Unknown kernel name is rejected");
+    TEST_ASSERT(sm4_set_kernel(NULL) == 0 && sm4_kernel_name() != NULL, "Automatic kernel selection restored");
+}
+
+/* 测试GHASH分派: 每个可用实现的GCM结果与4位查表实现一致 */
+static void test_sm4_ghash_dispatch(void)
+{
+    static const char *impls[] = {"vpclmul-avx512", "pclmul"};
+    static const size_t lens[] = {0, 1, 16, 100, 128, 129, 1000, 4099};
+    uint8_t key[16], iv[16], aad[77];
+    uint8_t data[4099];
+    uint8_t expected[sizeof(lens) / sizeof(lens[0])][4099 + 16];
+    uint8_t cipher[4099];
+    uint8_t tag[16];
+    size_t n, nlens = sizeof(lens) / sizeof(lens[0]);
+    int k, ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(aad, sizeof(aad));
+    RAND_bytes(data, sizeof(data));
+
+    TEST_ASSERT(sm4_set_ghash("table-4bit") == 0, "Table GHASH is always available");
+    for (n = 0; n < nlens; n++) {
+        /* 16字节IV同时覆盖J0的GHASH路径 */
+        sm4_gcm_encrypt(key, iv, 16, aad, lens[n] % sizeof(aad), data, lens[n],
+                        expected[n], expected[n] + lens[n]);
+    }
+
+    for (k = 0; k < (int)(sizeof(impls) / sizeof(impls[0])); k++) {
+        if (sm4_set_ghash(impls[k]) != 0) {
+            printf("  (ghash %s not available)\n", impls[k]);
+            continue;
+        }
+        for (n = 0; n < nlens; n++) {
+            sm4_gcm_encrypt(key, iv, 16, aad, lens[n] % sizeof(aad), data, lens[n], cipher, tag);
+            if (memcmp(cipher, expected[n], lens[n]) != 0 ||
+                memcmp(tag, expected[n] + lens[n], 16) != 0) {
+                ok = 0;
+            }
+        }
+    }
+
+    TEST_ASSERT(ok, "All available GHASH implementations match table reference");
+    TEST_ASSERT(sm4_set_ghash("no-such-ghash") == -1, "Unknown GHASH name is rejected");
+    TEST_ASSERT(sm4_set_ghash(NULL) == 0 && sm4_ghash_name() != NULL, "Automatic GHASH selection restored");
+}
+
+/* 测试 RFC 8998 SM4-GCM 测试向量 */
+static void test_sm4_gcm_rfc8998_vector(void)
+{
+    static const uint8_t key[16] = {0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef,
+                                    0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10};
+    static const uint8_t iv[12] = {0x00,0x00,0x12,0x34,0x56,0x78,0x00,0x00,
+                                   0x00,0x00,0xab,0xcd};
+    static const uint8_t aad[20] = {0xfe,0xed,0xfa,0xce,0xde,0xad,0xbe,0xef,
+                                    0xfe,0xed,0xfa,0xce,0xde,0xad,0xbe,0xef,
+                                    0xab,0xad,0xda,0xd2};
+    static const uint8_t expected_cipher[64] = {
+        0x17,0xf3,0x99,0xf0,0x8c,0x67,0xd5,0xee,0x19,0xd0,0xdc,0x99,0x69,0xc4,0xbb,0x7d,
+        0x5f,0xd4,0x6f,0xd3,0x75,0x64,0x89,0x06,0x91,0x57,0xb2,0x82,0xbb,0x20,0x07,0x35,
+        0xd8,0x27,0x10,0xca,0x5c,0x22,0xf0,0xcc,0xfa,0x7c,0xbf,0x93,0xd4,0x96,0xac,0x15,
+        0xa5,0x68,0x34,0xcb,0xcf,0x98,0xc3,0x97,0xb4,0x02,0x4a,0x26,0x91,0x23,0x3b,0x8d};
+    static const uint8_t expected_tag[16] = {0x83,0xde,0x35,0x41,0xe4,0xc2,0xb5,0x81,
+                                             0x77,0xe0,0x65,0xa9,0xbf,0x7b,0x62,0xec};
+    uint8_t plain[64];
+    uint8_t cipher[64];
+    uint8_t tag[SM4_GCM_TAG_SIZE];
+
+    /* 明文: AA*8 BB*8 CC*8 DD*8 EE*8 FF*8 EE*8 AA*8 */
+    memset(plain, 0xaa, 8);
+    memset(plain + 8, 0xbb, 8);
+    memset(plain + 16, 0xcc, 8);
+    memset(plain + 24, 0xdd, 8);
+    memset(plain + 32, 0xee, 8);
+    memset(plain + 40, 0xff, 8);
+    memset(plain + 48, 0xee, 8);
+    memset(plain + 56, 0xaa, 8);
+
+    sm4_gcm_encrypt(key, iv, 12, aad, sizeof(aad), plain, sizeof(plain), cipher, tag);
+    TEST_ASSERT(memcmp(cipher, expected_cipher, 64) == 0, "GCM ciphertext matches RFC 8998 vector");
+    TEST_ASSERT(memcmp(tag, expected_tag, 16) == 0, "GCM tag matches RFC 8998 vector");
+}
+
+/* 测试非96位IV与不完整分组(查表GHASH的部分分组与J0路径) */
+static void test_sm4_gcm_ghash_partial(void)
+{
+    static const uint8_t expected_cipher[37] = {
+        0x7d,0x16,0x65,0xb5,0xd4,0xf5,0x95,0x6e,0x97,0x7b,0xfb,0x23,0x83,0xe1,0xfe,0xc4,
+        0xd2,0x72,0x43,0x67,0x45,0x7d,0xe6,0x63,0xcb,0x7b,0xc1,0xce,0xb5,0xe4,0xcb,0xb5,
+        0x3f,0x94,0xc2,0x50,0x92};
+    static const uint8_t expected_tag16[16] = {
+        0x35,0xba,0xac,0x2e,0x0e,0x0a,0x98,0x7e,0x48,0x19,0x9a,0x17,0x2c,0x7e,0x19,0xcb};
+    static const uint8_t expected_tag7[16] = {
+        0xfa,0x97,0x14,0x8f,0xa3,0xff,0xaa,0x80,0x71,0x95,0x77,0x1d,0x5e,0xfc,0xcc,0x3f};
+    uint8_t key[16], iv[16], aad[20], plain[37];
+    uint8_t cipher[37], decrypted[37];
+    uint8_t tag[SM4_GCM_TAG_SIZE];
+    int i, ret;
+
+    for (i = 0; i < 16; i++) {
+        key[i] = (uint8_t)i;
+        iv[i] = (uint8_t)(0xf0 + i);
+    }
+    for (i = 0; i < 20; i++) {
+        aad[i] = (uint8_t)(0xa0 + i);
+    }
+    for (i = 0; i < 37; i++) {
+        plain[i] = (uint8_t)(i * 7);
+    }
+
+    sm4_gcm_encrypt(key, iv, 16, aad, sizeof(aad), plain, sizeof(plain), cipher, tag);
+    TEST_ASSERT(memcmp(cipher, expected_cipher, sizeof(cipher)) == 0, "GCM 16-byte IV ciphertext matches vector");
+    TEST_ASSERT(memcmp(tag, expected_tag16, 16) == 0, "GCM 16-byte IV tag matches vector");
+
+    ret = sm4_gcm_decrypt(key, iv, 16, aad, sizeof(aad), cipher, sizeof(cipher), tag, decrypted);
+    TEST_ASSERT(ret == 0 && memcmp(decrypted, plain, sizeof(plain)) == 0, "GCM 16-byte IV decrypts");
+
+    sm4_gcm_encrypt(key, iv, 7, aad, sizeof(aad), plain, sizeof(plain), cipher, tag);
+    TEST_ASSERT(memcmp(tag, expected_tag7, 16) == 0, "GCM 7-byte IV tag matches vector");
+}
+
 /* 测试 ECB 模式加解密往返 */
 static void test_sm4_ecb_roundtrip(void)
 {
@@ -85,6 +658,515 @@ static void test_sm4_cbc_roundtrip(void)
                 "CBC roundtrip produces original plaintext");
 }
 
+/* 测试CBC并行解密: 跨批次边界的各种长度及原地解密 */
+static void test_sm4_cbc_decrypt_parallel(void)
+{
+    static const size_t lens[] = {16, 31, 64 * 16 - 1, 64 * 16, 64 * 16 + 5, 3 * 64 * 16 + 100};
+    uint8_t key[16], iv[16];
+    uint8_t data[3 * 64 * 16 + 100];
+    uint8_t cipher[sizeof(data) + 16];
+    uint8_t plain[sizeof(data) + 16];
+    size_t c, cipher_len, plain_len;
+    int ok = 1, inplace = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(data, sizeof(data));
+
+    for (c = 0; c < sizeof(lens) / sizeof(lens[0]); c++) {
+        sm4_cbc_encrypt(key, iv, data, lens[c], cipher, &cipher_len);
+        if (sm4_cbc_decrypt(key, iv, cipher, cipher_len, plain, &plain_len) != 0 ||
+            plain_len != lens[c] || memcmp(plain, data, lens[c]) != 0) {
+            ok = 0;
+        }
+        if (sm4_cbc_decrypt(key, iv, cipher, cipher_len, cipher, &plain_len) != 0 ||
+            plain_len != lens[c] || memcmp(cipher, data, lens[c]) != 0) {
+            inplace = 0;
+        }
+    }
+
+    TEST_ASSERT(ok, "Parallel CBC decryption restores plaintext across batch boundaries");
+    TEST_ASSERT(inplace, "In-place CBC decryption restores plaintext");
+}
+
+/* 测试多消息CBC加密与逐条加密结果一致(不同长度、相同与不同IV、超过一组) */
+static void test_sm4_cbc_multi(void)
+{
+    enum { N = 83 };
+    static uint8_t data[N][80];
+    static uint8_t cipher[N][96];
+    static uint8_t expected[N][96];
+    static uint8_t iv_bytes[N][16];
+    uint8_t key[16];
+    const uint8_t *ivs[N], *same_iv[N], *inputs[N];
+    uint8_t *outputs[N];
+    size_t lens[N], out_lens[N], exp_len;
+    int i, ok = 1, shared = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(&data[0][0], sizeof(data));
+    RAND_bytes(&iv_bytes[0][0], sizeof(iv_bytes));
+    for (i = 0; i < N; i++) {
+        ivs[i] = iv_bytes[i];
+        same_iv[i] = iv_bytes[0];
+        inputs[i] = data[i];
+        outputs[i] = cipher[i];
+        lens[i] = (size_t)(i * 7) % 80;
+    }
+
+    TEST_ASSERT(sm4_cbc_encrypt_multi(key, ivs, inputs, lens, outputs, out_lens, N) == 0,
+                "Multi-buffer CBC encrypt returns 0");
+    for (i = 0; i < N; i++) {
+        sm4_cbc_encrypt(key, ivs[i], inputs[i], lens[i], expected[i], &exp_len);
+        if (out_lens[i] != exp_len || memcmp(cipher[i], expected[i], exp_len) != 0) {
+            ok = 0;
+        }
+    }
+
+    sm4_cbc_encrypt_multi(key, same_iv, inputs, lens, outputs, out_lens, N);
+    for (i = 0; i < N; i++) {
+        sm4_cbc_encrypt(key, same_iv[i], inputs[i], lens[i], expected[i], &exp_len);
+        if (out_lens[i] != exp_len || memcmp(cipher[i], expected[i], exp_len) != 0) {
+            shared = 0;
+        }
+    }
+
+    TEST_ASSERT(ok, "Multi-buffer CBC matches per-message CBC with distinct IVs");
+    TEST_ASSERT(shared, "Multi-buffer CBC matches per-message CBC with a shared IV");
+    TEST_ASSERT(sm4_cbc_encrypt_multi(key, ivs, inputs, lens, outputs, NULL, N) == -1,
+                "Multi-buffer CBC rejects NULL output lengths");
+}
+
+/* 测试ECB/CBC加密直接读取输入(不复制整段明文)，含原地加密 */
+static void test_sm4_encrypt_inplace(void)
+{
+    static const size_t lens[] = {0, 15, 16, 33, 64 * 16 + 7, 3 * 64 * 16};
+    uint8_t key[16], iv[16];
+    uint8_t data[3 * 64 * 16];
+    uint8_t expected[sizeof(data) + 16];
+    uint8_t buf[sizeof(data) + 16];
+    size_t c, exp_len, out_len;
+    int ecb_ok = 1, cbc_ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(data, sizeof(data));
+
+    for (c = 0; c < sizeof(lens) / sizeof(lens[0]); c++) {
+        sm4_ecb_encrypt(key, data, lens[c], expected, &exp_len);
+        memcpy(buf, data, lens[c]);
+        if (sm4_ecb_encrypt(key, buf, lens[c], buf, &out_len) != 0 || out_len != exp_len ||
+            memcmp(buf, expected, exp_len) != 0 ||
+            sm4_ecb_decrypt(key, buf, out_len, buf, &out_len) != 0 || out_len != lens[c] ||
+            memcmp(buf, data, lens[c]) != 0) {
+            ecb_ok = 0;
+        }
+
+        sm4_cbc_encrypt(key, iv, data, lens[c], expected, &exp_len);
+        memcpy(buf, data, lens[c]);
+        if (sm4_cbc_encrypt(key, iv, buf, lens[c], buf, &out_len) != 0 || out_len != exp_len ||
+            memcmp(buf, expected, exp_len) != 0 ||
+            sm4_cbc_decrypt(key, iv, buf, out_len, buf, &out_len) != 0 || out_len != lens[c] ||
+            memcmp(buf, data, lens[c]) != 0) {
+            cbc_ok = 0;
+        }
+    }
+
+    TEST_ASSERT(ecb_ok, "In-place ECB encryption matches and roundtrips");
+    TEST_ASSERT(cbc_ok, "In-place CBC encryption matches and roundtrips");
+}
+
+/* 测试流式CBC: 任意分段的结果与一次性加解密相同 */
+static void test_sm4_cbc_stream(void)
+{
+    static const size_t chunks[] = {1, 5, 16, 17, 31, 100, 1024, 4099};
+    uint8_t key[16], iv[16];
+    uint8_t data[5000 + 9];
+    uint8_t expected[sizeof(data) + 16];
+    uint8_t out[sizeof(data) + 16 + 16];
+    uint8_t plain[sizeof(data) + 16 + 16];
+    size_t c, off, exp_len, out_len, plain_len, n, len;
+    sm4_cbc_ctx ctx;
+    int enc_ok = 1, dec_ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(data, sizeof(data));
+    sm4_cbc_encrypt(key, iv, data, sizeof(data), expected, &exp_len);
+
+    for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        sm4_cbc_init(&ctx, key, iv, 0);
+        for (off = 0, out_len = 0; off < sizeof(data); off += len) {
+            len = sizeof(data) - off < chunks[c] ? sizeof(data) - off : chunks[c];
+            sm4_cbc_update(&ctx, data + off, len, out + out_len, &n);
+            out_len += n;
+        }
+        sm4_cbc_final(&ctx, out + out_len, &n);
+        out_len += n;
+        if (out_len != exp_len || memcmp(out, expected, exp_len) != 0) {
+            enc_ok = 0;
+        }
+
+        sm4_cbc_init(&ctx, key, iv, 1);
+        for (off = 0, plain_len = 0; off < exp_len; off += len) {
+            len = exp_len - off < chunks[c] ? exp_len - off : chunks[c];
+            sm4_cbc_update(&ctx, expected + off, len, plain + plain_len, &n);
+            plain_len += n;
+        }
+        if (sm4_cbc_final(&ctx, plain + plain_len, &n) != 0) {
+            dec_ok = 0;
+        }
+        plain_len += n;
+        if (plain_len != sizeof(data) || memcmp(plain, data, sizeof(data)) != 0) {
+            dec_ok = 0;
+        }
+    }
+
+    TEST_ASSERT(enc_ok, "Streaming CBC encryption matches one-shot encryption");
+    TEST_ASSERT(dec_ok, "Streaming CBC decryption matches one-shot decryption");
+
+    /* 截断的密文在final时报错 */
+    sm4_cbc_init(&ctx, key, iv, 1);
+    sm4_cbc_update(&ctx, expected, exp_len - 1, plain, &n);
+    TEST_ASSERT(sm4_cbc_final(&ctx, plain + n, &n) == -1, "Streaming CBC rejects truncated ciphertext");
+}
+
+/* 测试流式GCM: 任意分段(含AAD分段)的结果与一次性GCM一致 */
+static void test_sm4_gcm_stream(void)
+{
+    static const size_t chunks[] = {1, 5, 16, 17, 31, 100, 1024, 4099};
+    uint8_t key[16], iv[16], aad[45];
+    uint8_t data[5000 + 9];
+    uint8_t expected[sizeof(data)], out[sizeof(data)];
+    uint8_t tag[16], tag_s[16];
+    size_t c, off, len, alen;
+    sm4_gcm_ctx ctx;
+    int enc_ok = 1, dec_ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(aad, sizeof(aad));
+    RAND_bytes(data, sizeof(data));
+    sm4_gcm_encrypt(key, iv, 12, aad, sizeof(aad), data, sizeof(data), expected, tag);
+
+    for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        alen = chunks[c] % sizeof(aad);
+
+        sm4_gcm_init(&ctx, key, iv, 12, 0);
+        sm4_gcm_aad(&ctx, aad, alen);
+        sm4_gcm_aad(&ctx, aad + alen, sizeof(aad) - alen);
+        for (off = 0; off < sizeof(data); off += len) {
+            len = sizeof(data) - off < chunks[c] ? sizeof(data) - off : chunks[c];
+            sm4_gcm_update(&ctx, data + off, len, out + off);
+        }
+        sm4_gcm_final(&ctx, tag_s);
+        if (memcmp(out, expected, sizeof(data)) != 0 || memcmp(tag_s, tag, 16) != 0) {
+            enc_ok = 0;
+        }
+
+        /* 原地解密 */
+        sm4_gcm_init(&ctx, key, iv, 12, 1);
+        sm4_gcm_aad(&ctx, aad, alen);
+        sm4_gcm_aad(&ctx, aad + alen, sizeof(aad) - alen);
+        for (off = 0; off < sizeof(data); off += len) {
+            len = sizeof(data) - off < chunks[c] ? sizeof(data) - off : chunks[c];
+            sm4_gcm_update(&ctx, out + off, len, out + off);
+        }
+        if (sm4_gcm_final_verify(&ctx, tag) != 0 || memcmp(out, data, sizeof(data)) != 0) {
+            dec_ok = 0;
+        }
+    }
+
+    TEST_ASSERT(enc_ok, "Streaming GCM encryption matches one-shot encryption");
+    TEST_ASSERT(dec_ok, "Streaming GCM decryption verifies and matches plaintext");
+
+    /* 篡改的密文验证失败；数据开始后不能再输入AAD */
+    expected[100] ^= 1;
+    sm4_gcm_init(&ctx, key, iv, 12, 1);
+    sm4_gcm_aad(&ctx, aad, sizeof(aad));
+    sm4_gcm_update(&ctx, expected, sizeof(data), out);
+    TEST_ASSERT(sm4_gcm_aad(&ctx, aad, 1) == -1, "Streaming GCM rejects AAD after data");
+    TEST_ASSERT(sm4_gcm_final_verify(&ctx, tag) == -1, "Streaming GCM rejects tampered ciphertext");
+
+    /* 只有AAD(GMAC)时与一次性结果一致 */
+    sm4_gcm_encrypt(key, iv, 16, aad, sizeof(aad), NULL, 0, out, tag);
+    sm4_gcm_init(&ctx, key, iv, 16, 0);
+    sm4_gcm_aad(&ctx, aad, 7);
+    sm4_gcm_aad(&ctx, aad + 7, sizeof(aad) - 7);
+    sm4_gcm_final(&ctx, tag_s);
+    TEST_ASSERT(memcmp(tag, tag_s, 16) == 0, "Streaming GCM with AAD only matches one-shot tag");
+}
+
+/* 测试SM4-CTR: 标准向量、128位计数器进位、任意偏移的区间解密 */
+static void test_sm4_ctr(void)
+{
+    static const uint8_t key[16] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+                                    0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10};
+    static const uint8_t iv[16] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                   0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    static const uint8_t carry_iv[16] = {0, 0, 0, 0, 0, 0, 0, 0,
+                                         0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    static const uint8_t expected[64] = {
+        0xac, 0x32, 0x36, 0xcb, 0x97, 0x0c, 0xc2, 0x07, 0x91, 0x36, 0x4c, 0x39, 0x5a, 0x13, 0x42, 0xd1,
+        0xa3, 0xcb, 0xc1, 0x87, 0x8c, 0x6f, 0x30, 0xcd, 0x07, 0x4c, 0xce, 0x38, 0x5c, 0xdd, 0x70, 0xc7,
+        0xf2, 0x34, 0xbc, 0x0e, 0x24, 0xc1, 0x19, 0x80, 0xfd, 0x12, 0x86, 0x31, 0x0c, 0xe3, 0x7b, 0x92,
+        0x6e, 0x02, 0xfc, 0xd0, 0xfa, 0xa0, 0xba, 0xf3, 0x8b, 0x29, 0x33, 0x85, 0x1d, 0x82, 0x45, 0x14
+    };
+    static const uint8_t expected_carry[40] = {
+        0x9c, 0xd2, 0x61, 0x5a, 0x23, 0x2c, 0x88, 0x61, 0x00, 0x17, 0x91, 0x27, 0xbd, 0xfc, 0x41, 0xda,
+        0x91, 0x68, 0x6f, 0x12, 0x6f, 0xc2, 0x80, 0x2d, 0x64, 0xdf, 0x5c, 0x55, 0x10, 0x5e, 0x5a, 0x68,
+        0xfe, 0x0d, 0xb2, 0xea, 0xd4, 0xde, 0xdb, 0xa0
+    };
+    uint8_t plain[64], cipher[64], ones[40];
+    uint8_t data[3000], enc[3000], part[3000];
+    static const size_t ranges[][2] = {{0, 200}, {5, 11}, {16, 16}, {17, 1}, {999, 1500}, {2990, 10}};
+    size_t i;
+    int ok = 1;
+
+    /* 向量明文为 AA..BB..CC..DD..EE..FF..AA..BB..(各8字节) */
+    for (i = 0; i < 64; i++) {
+        plain[i] = (uint8_t)(0xaa + 0x11 * ((i / 8) % 6));
+    }
+    sm4_ctr_crypt(key, iv, 0, plain, 64, cipher);
+    TEST_ASSERT(memcmp(cipher, expected, 64) == 0, "SM4-CTR matches standard vector");
+
+    memset(ones, 0xff, sizeof(ones));
+    sm4_ctr_crypt(key, carry_iv, 0, ones, sizeof(ones), ones);
+    TEST_ASSERT(memcmp(ones, expected_carry, sizeof(ones)) == 0, "SM4-CTR counter carries across 64-bit boundary");
+
+    RAND_bytes(data, sizeof(data));
+    sm4_ctr_crypt(key, iv, 0, data, sizeof(data), enc);
+    for (i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        size_t off = ranges[i][0], len = ranges[i][1];
+
+        sm4_ctr_crypt(key, iv, off, enc + off, len, part);
+        if (memcmp(part, data + off, len) != 0) {
+            ok = 0;
+        }
+    }
+    TEST_ASSERT(ok, "SM4-CTR range decryption at arbitrary offsets");
+}
+
+/* XTS参考实现: 逐块加密，tweak逐字节左移并折回0x87，密文窃取按IEEE 1619 */
+static void ref_xts_encrypt(const uint8_t *key, uint64_t sector, const uint8_t *in, size_t len,
+                            uint8_t *out)
+{
+    sm4_context k1, k2;
+    uint8_t t[16] = {0}, b[16], cc[16];
+    size_t m = len / 16, r = len % 16, j;
+    int i, carry;
+
+    sm4_setkey(&k1, key);
+    sm4_setkey(&k2, key + 16);
+    for (i = 0; i < 8; i++) {
+        t[i] = (uint8_t)(sector >> (8 * i));
+    }
+    sm4_encrypt_block(&k2, t, t);
+
+    for (j = 0; j < m; j++) {
+        for (i = 0; i < 16; i++) b[i] = in[j * 16 + i] ^ t[i];
+        sm4_encrypt_block(&k1, b, b);
+        for (i = 0; i < 16; i++) out[j * 16 + i] = b[i] ^ t[i];
+        carry = t[15] >> 7;
+        for (i = 15; i > 0; i--) t[i] = (uint8_t)((t[i] << 1) | (t[i - 1] >> 7));
+        t[0] = (uint8_t)((t[0] << 1) ^ (carry ? 0x87 : 0));
+    }
+    if (r != 0) {
+        /* 最后一个完整块的密文前r字节成为末块，其余与末块明文拼接后用下一个tweak加密 */
+        memcpy(cc, out + (m - 1) * 16, 16);
+        memcpy(out + m * 16, cc, r);
+        memcpy(b, in + m * 16, r);
+        memcpy(b + r, cc + r, 16 - r);
+        for (i = 0; i < 16; i++) b[i] ^= t[i];
+        sm4_encrypt_block(&k1, b, b);
+        for (i = 0; i < 16; i++) out[(m - 1) * 16 + i] = b[i] ^ t[i];
+    }
+}
+
+/* 测试SM4-XTS: 与参考实现一致(含密文窃取)、原地往返、上下文逐页处理与参数检查 */
+static void test_sm4_xts(void)
+{
+    static const size_t lens[] = {16, 17, 31, 32, 100, 1024 + 15, 8192, 8192 + 5, 64 * 16 * 3 + 7};
+    static const uint64_t sectors[] = {0, 1, 0x80, 0xfedcba9876543210ULL};
+    uint8_t key[SM4_XTS_KEY_SIZE], bad_key[SM4_XTS_KEY_SIZE];
+    size_t max_len = 8192 + 5;
+    size_t saved = sm4_stream_threshold();
+    uint8_t *data = (uint8_t *)malloc(max_len);
+    uint8_t *ref = (uint8_t *)malloc(max_len);
+    uint8_t *out = (uint8_t *)malloc(max_len);
+    sm4_xts_context enc, dec;
+    size_t l, k, page;
+    int match = 1, tmpl_match = 1, roundtrip = 1, ctx_ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(data, max_len);
+
+    for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+        for (k = 0; k < sizeof(sectors) / sizeof(sectors[0]); k++) {
+            sm4_context k1, k2;
+
+            ref_xts_encrypt(key, sectors[k], data, lens[l], ref);
+            sm4_xts_encrypt(key, sectors[k], data, lens[l], out);
+            if (memcmp(out, ref, lens[l]) != 0) {
+                match = 0;
+            }
+
+            /* 模板的可移植tweak实现 */
+            sm4_setkey(&k1, key);
+            sm4_setkey(&k2, key + 16);
+            sm4::xts<sm4::ENCRYPT>::run(&k1, &k2, sectors[k], data, lens[l], out);
+            if (memcmp(out, ref, lens[l]) != 0) {
+                tmpl_match = 0;
+            }
+
+            sm4_xts_decrypt(key, sectors[k], out, lens[l], out);
+            if (memcmp(out, data, lens[l]) != 0) {
+                roundtrip = 0;
+            }
+        }
+    }
+    TEST_ASSERT(match, "XTS encryption matches reference (incl. ciphertext stealing)");
+    TEST_ASSERT(tmpl_match, "XTS template with portable tweak doubling matches reference");
+    TEST_ASSERT(roundtrip, "XTS in-place decryption restores plaintext");
+
+    /* 同一上下文逐页处理，每页使用自己的页号 */
+    sm4_xts_setkey(&enc, key, 0);
+    sm4_xts_setkey(&dec, key, 1);
+    for (page = 0; page < 3; page++) {
+        ref_xts_encrypt(key, 1000 + page, data + page * 1024, 1024, ref);
+        sm4_xts_crypt(&enc, 1000 + page, data + page * 1024, 1024, out);
+        if (memcmp(out, ref, 1024) != 0) {
+            ctx_ok = 0;
+        }
+        sm4_xts_crypt(&dec, 1000 + page, out, 1024, out);
+        if (memcmp(out, data + page * 1024, 1024) != 0) {
+            ctx_ok = 0;
+        }
+    }
+    TEST_ASSERT(ctx_ok, "XTS context processes consecutive pages with their own tweaks");
+    sm4_xts_context_clean(&enc);
+    sm4_xts_context_clean(&dec);
+
+    /* 流式路径 */
+    sm4_set_stream_threshold(0);
+    ref_xts_encrypt(key, 7, data, max_len, ref);
+    sm4_xts_encrypt(key, 7, data, max_len, out);
+    TEST_ASSERT(memcmp(out, ref, max_len) == 0, "XTS streaming path matches reference");
+    sm4_set_stream_threshold(saved);
+
+    /* 不同页号得到不同密文；短于一块、K1与K2相同时拒绝 */
+    sm4_xts_encrypt(key, 1, data, 32, ref);
+    sm4_xts_encrypt(key, 2, data, 32, out);
+    TEST_ASSERT(memcmp(out, ref, 32) != 0, "XTS ciphertext depends on the sector number");
+    TEST_ASSERT(sm4_xts_encrypt(key, 0, data, 15, out) == -1, "XTS rejects input shorter than a block");
+    memcpy(bad_key, key, 16);
+    memcpy(bad_key + 16, key, 16);
+    TEST_ASSERT(sm4_xts_encrypt(bad_key, 0, data, 32, out) == -1, "XTS rejects identical key halves");
+
+    free(data);
+    free(ref);
+    free(out);
+}
+
+/* 测试SM4-SIV: 已知答案(CMAC-SM4与SM4-CTR由OpenSSL独立计算)、确定性、篡改检测与AAD绑定 */
+static void test_sm4_siv(void)
+{
+    static const uint8_t key[SM4_SIV_KEY_SIZE] = {
+        0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8, 0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0,
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+    };
+    static const uint8_t aad[24] = {
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b,
+        0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27
+    };
+    static const uint8_t short_pt[14] = {
+        0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee
+    };
+    static const uint8_t short_ct[30] = {
+        0x9a, 0x12, 0xa8, 0xd7, 0xbd, 0x93, 0x2d, 0x58, 0x3b, 0x0e, 0x02, 0xe4, 0x5e, 0x83, 0x6a, 0x7c,
+        0x3d, 0xf7, 0xb4, 0x52, 0x31, 0x9c, 0xdd, 0xa3, 0x85, 0x30, 0xd3, 0x18, 0x2a, 0x66
+    };
+    static const char id_pt[] = "110101199003077777";
+    static const uint8_t id_ct[34] = {
+        0x24, 0x03, 0x2e, 0xbb, 0x75, 0x0d, 0x78, 0xef, 0x95, 0xa6, 0x09, 0xfc, 0xb0, 0x1e, 0xd3, 0xe1,
+        0x48, 0x06, 0xd8, 0x7c, 0x98, 0xf9, 0x42, 0x55, 0xc8, 0x9f, 0xb8, 0xd7, 0x3d, 0x4a, 0x9f, 0x7a,
+        0xcb, 0xb4
+    };
+    static const uint8_t noad_pt[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    static const uint8_t noad_ct[32] = {
+        0x49, 0xa7, 0x41, 0x21, 0xed, 0x76, 0x2c, 0x1d, 0x4b, 0x3b, 0xfe, 0xb2, 0x1f, 0xdf, 0x4b, 0xff,
+        0xf0, 0xd9, 0x79, 0x70, 0xef, 0xdc, 0x60, 0x4e, 0x67, 0xcc, 0xb4, 0x83, 0x21, 0xf3, 0x3b, 0xea
+    };
+    static const uint8_t empty_aad_ct[48] = {
+        0x2c, 0x55, 0xcd, 0x83, 0x68, 0xe3, 0x50, 0xf2, 0xae, 0x3b, 0xfb, 0x9a, 0x5a, 0x97, 0x17, 0xc6,
+        0x01, 0xa0, 0x68, 0x9b, 0xe0, 0x79, 0xa2, 0x42, 0xcb, 0x0f, 0x58, 0x83, 0x7b, 0x5c, 0x71, 0x77,
+        0x08, 0xe3, 0x5d, 0x6d, 0x6d, 0xd6, 0x5f, 0xd0, 0x9c, 0x7d, 0x1c, 0x62, 0x41, 0x8b, 0xcc, 0x84
+    };
+    uint8_t pt[32], out[64], out2[64], plain[64];
+    size_t i, big_len = 100000 + 3;
+    size_t saved = sm4_stream_threshold();
+    uint8_t *big, *big_ct, *big_ct2;
+
+    for (i = 0; i < sizeof(pt); i++) {
+        pt[i] = (uint8_t)i;
+    }
+
+    sm4_siv_encrypt(key, aad, sizeof(aad), short_pt, sizeof(short_pt), out);
+    TEST_ASSERT(memcmp(out, short_ct, sizeof(short_ct)) == 0, "SIV known answer: short plaintext");
+    sm4_siv_encrypt(key, aad, sizeof(aad), (const uint8_t *)id_pt, 18, out);
+    TEST_ASSERT(memcmp(out, id_ct, sizeof(id_ct)) == 0, "SIV known answer: 18-byte ID number");
+    sm4_siv_encrypt(key, NULL, 0, noad_pt, sizeof(noad_pt), out);
+    TEST_ASSERT(memcmp(out, noad_ct, sizeof(noad_ct)) == 0, "SIV known answer: no AAD, one block");
+    sm4_siv_encrypt(key, (const uint8_t *)"", 0, pt, 32, out);
+    TEST_ASSERT(memcmp(out, empty_aad_ct, sizeof(empty_aad_ct)) == 0,
+                "SIV known answer: empty AAD component, two blocks");
+
+    /* 确定性: 相同输入得到相同密文，AAD或明文不同则密文不同 */
+    sm4_siv_encrypt(key, aad, sizeof(aad), (const uint8_t *)id_pt, 18, out2);
+    sm4_siv_encrypt(key, aad, sizeof(aad), (const uint8_t *)id_pt, 18, out);
+    TEST_ASSERT(memcmp(out, out2, 34) == 0, "SIV is deterministic for equal inputs");
+    sm4_siv_encrypt(key, aad, 23, (const uint8_t *)id_pt, 18, out2);
+    TEST_ASSERT(memcmp(out, out2, 34) != 0, "SIV ciphertext depends on AAD");
+
+    /* 解密: 往返、原地、篡改、AAD不符 */
+    TEST_ASSERT(sm4_siv_decrypt(key, aad, sizeof(aad), out, 34, plain) == 0 &&
+                memcmp(plain, id_pt, 18) == 0, "SIV decryption restores plaintext");
+    memcpy(out2, out, 34);
+    TEST_ASSERT(sm4_siv_decrypt(key, aad, sizeof(aad), out2, 34, out2 + 16) == 0 &&
+                memcmp(out2 + 16, id_pt, 18) == 0, "SIV in-place decryption");
+    TEST_ASSERT(sm4_siv_decrypt(key, aad, 23, out, 34, plain) == -1 && plain[0] == 0,
+                "SIV rejects mismatched AAD and clears output");
+    out[20] ^= 1;
+    TEST_ASSERT(sm4_siv_decrypt(key, aad, sizeof(aad), out, 34, plain) == -1,
+                "SIV rejects tampered ciphertext");
+    TEST_ASSERT(sm4_siv_decrypt(key, NULL, 0, out, 15, plain) == -1,
+                "SIV rejects input shorter than the tag");
+
+    /* 空明文只有V */
+    TEST_ASSERT(sm4_siv_encrypt(key, aad, sizeof(aad), NULL, 0, out) == 0 &&
+                sm4_siv_decrypt(key, aad, sizeof(aad), out, 16, NULL) == 0,
+                "SIV handles empty plaintext");
+
+    /* 大数据: 流式路径与缓存路径一致 */
+    big = (uint8_t *)malloc(big_len);
+    big_ct = (uint8_t *)malloc(big_len + 16);
+    big_ct2 = (uint8_t *)malloc(big_len + 16);
+    RAND_bytes(big, big_len);
+    sm4_set_stream_threshold((size_t)-1);
+    sm4_siv_encrypt(key, aad, sizeof(aad), big, big_len, big_ct);
+    sm4_set_stream_threshold(0);
+    sm4_siv_encrypt(key, aad, sizeof(aad), big, big_len, big_ct2);
+    sm4_set_stream_threshold(saved);
+    TEST_ASSERT(memcmp(big_ct, big_ct2, big_len + 16) == 0, "SIV streaming path matches cached path");
+    TEST_ASSERT(sm4_siv_decrypt(key, aad, sizeof(aad), big_ct, big_len + 16, big_ct2) == 0 &&
+                memcmp(big_ct2, big, big_len) == 0, "SIV large roundtrip");
+    free(big);
+    free(big_ct);
+    free(big_ct2);
+}
+
 /* 测试 GCM 模式加解密往返 */
 static void test_sm4_gcm_roundtrip(void)
 {
@@ -145,6 +1227,41 @@ static void test_sm4_gcm_auth_failure(void)
     TEST_ASSERT(ret == -1, "GCM decrypt fails with tampered ciphertext");
 }
 
+/* 测试拼接GCM: 原地加解密，认证失败时不写输出(原地解密的密文保持不变) */
+static void test_sm4_gcm_inplace(void)
+{
+    uint8_t key[16], iv[12], aad[33];
+    uint8_t data[3000], ref[3000], buf[3000];
+    uint8_t tag[16], tag2[16];
+    int ret;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(aad, sizeof(aad));
+    RAND_bytes(data, sizeof(data));
+
+    sm4_gcm_encrypt(key, iv, 12, aad, sizeof(aad), data, sizeof(data), ref, tag);
+    memcpy(buf, data, sizeof(data));
+    sm4_gcm_encrypt(key, iv, 12, aad, sizeof(aad), buf, sizeof(buf), buf, tag2);
+    TEST_ASSERT(memcmp(buf, ref, sizeof(buf)) == 0 && memcmp(tag, tag2, 16) == 0,
+                "GCM in-place encrypt matches out-of-place");
+
+    ret = sm4_gcm_decrypt(key, iv, 12, aad, sizeof(aad), buf, sizeof(buf), tag, buf);
+    TEST_ASSERT(ret == 0 && memcmp(buf, data, sizeof(data)) == 0, "GCM in-place decrypt");
+
+    aad[0] ^= 1;
+    memset(buf, 0x5A, sizeof(buf));
+    ret = sm4_gcm_decrypt(key, iv, 12, aad, sizeof(aad), ref, sizeof(ref), tag, buf);
+    memset(data, 0x5A, sizeof(data));
+    TEST_ASSERT(ret == -1 && memcmp(buf, data, sizeof(buf)) == 0,
+                "GCM output is untouched when authentication fails");
+
+    memcpy(buf, ref, sizeof(ref));
+    ret = sm4_gcm_decrypt(key, iv, 12, aad, sizeof(aad), buf, sizeof(buf), tag, buf);
+    TEST_ASSERT(ret == -1 && memcmp(buf, ref, sizeof(buf)) == 0,
+                "GCM in-place decrypt keeps ciphertext when authentication fails");
+}
+
 /* 测试 GCM 大数据量 (Feature-2: 缓冲区溢出修复验证) */
 static void test_sm4_gcm_large_data(void)
 {
@@ -199,6 +1316,64 @@ static void test_sm4_gcm_very_large_data(void)
     free(decrypted);
 }
 
+/* 测试多线程GCM: 各种分段方式与单线程结果一致，含非整分组末段与原地解密 */
+static void test_sm4_gcm_mt(void)
+{
+    static const int threads[] = {2, 3, 4, 7};
+    size_t data_len = 5 * 1024 * 1024 + 37;
+    uint8_t key[16], iv[16], aad[29];
+    uint8_t *data = (uint8_t *)malloc(data_len);
+    uint8_t *expected = (uint8_t *)malloc(data_len);
+    uint8_t *out = (uint8_t *)malloc(data_len);
+    uint8_t tag[16], tag_mt[16];
+    size_t t;
+    int enc_ok = 1, dec_ok = 1;
+
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(iv, sizeof(iv));
+    RAND_bytes(aad, sizeof(aad));
+    RAND_bytes(data, data_len);
+    sm4_gcm_encrypt(key, iv, 12, aad, sizeof(aad), data, data_len, expected, tag);
+
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        if (sm4_gcm_encrypt_mt(key, iv, 12, aad, sizeof(aad), data, data_len, out, tag_mt,
+                               threads[t]) != 0 ||
+            memcmp(out, expected, data_len) != 0 || memcmp(tag_mt, tag, 16) != 0) {
+            enc_ok = 0;
+        }
+        if (sm4_gcm_decrypt_mt(key, iv, 12, aad, sizeof(aad), out, data_len, tag, out,
+                               threads[t]) != 0 ||
+            memcmp(out, data, data_len) != 0) {
+            dec_ok = 0;
+        }
+    }
+    TEST_ASSERT(enc_ok, "Multi-threaded GCM encryption matches single-threaded");
+    TEST_ASSERT(dec_ok, "Multi-threaded GCM in-place decryption verifies and matches");
+
+    /* 非12字节IV、自动线程数 */
+    sm4_gcm_encrypt(key, iv, 16, NULL, 0, data, data_len, expected, tag);
+    sm4_gcm_encrypt_mt(key, iv, 16, NULL, 0, data, data_len, out, tag_mt, 0);
+    TEST_ASSERT(memcmp(out, expected, data_len) == 0 && memcmp(tag_mt, tag, 16) == 0,
+                "Multi-threaded GCM with 16-byte IV and automatic thread count");
+
+    /* 篡改的密文验证失败且输出被清零 */
+    expected[data_len - 1] ^= 1;
+    TEST_ASSERT(sm4_gcm_decrypt_mt(key, iv, 16, NULL, 0, expected, data_len, tag, out, 4) == -1,
+                "Multi-threaded GCM rejects tampered ciphertext");
+    TEST_ASSERT(out[0] == 0 && out[data_len - 1] == 0,
+                "Multi-threaded GCM clears output on authentication failure");
+
+    /* 短输入退回单线程路径 */
+    sm4_gcm_encrypt(key, iv, 12, aad, sizeof(aad), data, 1000, expected, tag);
+    sm4_gcm_encrypt_mt(key, iv, 12, aad, sizeof(aad), data, 1000, out, tag_mt, 8);
+    TEST_ASSERT(memcmp(out, expected, 1000) == 0 && memcmp(tag_mt, tag, 16) == 0,
+                "Multi-threaded GCM falls back to single thread for short input");
+
+    free(data);
+    free(expected);
+    free(out);
+}
+
 /* 测试空输入处理 */
 static void test_sm4_empty_input(void)
 {
@@ -320,12 +1495,36 @@ int main(void)
     printf("==============\n\n");
 
     test_sm4_ecb_block_roundtrip();
+    test_sm4_standard_vector();
+    test_sm4_multiblock_consistency();
+    test_sm4_blocks_api();
+    test_sm4_setkey_dec();
+    test_sm4_setkey_multi();
+    test_sm4_ecb_multi();
+    test_sm4_mode_templates();
+    test_sm4_stream_path();
+    test_sm4_bitslice();
+    test_sm4_bitslice_mode();
+    test_sm4_kernel_dispatch();
+    test_sm4_gcm_rfc8998_vector();
+    test_sm4_gcm_ghash_partial();
+    test_sm4_ghash_dispatch();
     test_sm4_ecb_roundtrip();
     test_sm4_cbc_roundtrip();
+    test_sm4_cbc_decrypt_parallel();
+    test_sm4_cbc_multi();
+    test_sm4_encrypt_inplace();
+    test_sm4_cbc_stream();
+    test_sm4_ctr();
+    test_sm4_xts();
+    test_sm4_siv();
     test_sm4_gcm_roundtrip();
     test_sm4_gcm_auth_failure();
+    test_sm4_gcm_inplace();
+    test_sm4_gcm_stream();
     test_sm4_gcm_large_data();
     test_sm4_gcm_very_large_data();
+    test_sm4_gcm_mt();
     test_sm4_empty_input();
     test_sm4_null_params();
     test_sm4_context_clean();